@@ -13,7 +13,11 @@
 #include <epicsThread.h>
 #include <epicsExport.h>
 #include <epicsString.h>
+#include <epicsAtomic.h>
+#include <epicsRingPointer.h>
 #include <iocsh.h>
+#include <algorithm>
+#include <math.h>
 #include <drvSup.h>
 #include <registryFunction.h>
 
@@ -24,20 +28,32 @@
 #include "csbigimg.h"
 
 #include "ADSBIG.h"
+#include "ADSBIGSim.h"
 
 static void ADSBIGReadoutTaskC(void *drvPvt);
-static void ADSBIGPollingTaskC(void *drvPvt);
+static void ADSBIGTelemetryTaskC(void *drvPvt);
+static void ADSBIGBandTaskC(void *drvPvt);
+static void ADSBIGPublishTaskC(void *drvPvt);
+static void ADSBIGPreviewTaskC(void *drvPvt);
+static void ADSBIGLineCallbackC(void *drvPvt, int line);
+static void ADSBIGExposureWaitC(void *drvPvt, double seconds);
+static void ADSBIGTrackTaskC(void *drvPvt);
+static void ADSBIGTrackWaitC(void *drvPvt, double seconds);
+static void ADSBIGFitsDoneC(void *drvPvt, const ADSBIGFitsResult &result);
 
 /**
  * Constructor
  */
-ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) : 
-  ADDriver(portName, 1, NUM_DRIVER_PARAMS, 
+ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory, int simulate,
+               int usbSlot, const char *serialNumber) : 
+  ADDriver(portName, ADSBIG_NUM_ADDR, NUM_DRIVER_PARAMS, 
              maxBuffers, maxMemory, 
-             asynInt32Mask | asynInt32ArrayMask | asynDrvUserMask,
-             asynInt32Mask | asynFloat64Mask, 
+             asynInt32Mask | asynInt32ArrayMask | asynFloat64ArrayMask | asynDrvUserMask,
+             asynInt32Mask | asynFloat64Mask | asynInt32ArrayMask, 
              ASYN_CANBLOCK | ASYN_MULTIDEVICE,
-             1, 0, 0) 
+             1, 0, 0),
+    m_expJitter(ADSBIG_TIMING_WINDOW),
+    m_periodJitter(ADSBIG_TIMING_WINDOW)
 {
   int status = 0;
   const char *functionName = "ADSBIG::ADSBIG";
@@ -46,6 +62,63 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
   m_CamWidth = 0;
   m_CamHeight = 0;
   m_aborted = false;
+  m_darkBuild = false;
+  m_flatBuild = false;
+  m_pBandSrc = NULL;
+  m_pBandArray = NULL;
+  m_bandWidth = 0;
+  m_bandHeight = 0;
+  m_bandLines = 0;
+  m_bandLinesRead = 0;
+  m_bandLinesDone = 0;
+  m_bandStreaming = false;
+  m_bandActive = false;
+  m_bandCancel = false;
+  m_bandLatencySum = 0.0;
+  m_bandLatencyMax = 0.0;
+  m_bandProcTime = 0.0;
+  m_bandTailTime = 0.0;
+  m_bandCount = 0;
+  m_pBandDark = NULL;
+  m_bandDarkPedestal = 0;
+  m_pBandGain = NULL;
+  m_bandFlatTime = 0.0;
+  m_bandStats = false;
+  m_bandAccumulate = false;
+  m_bandPreview = false;
+  m_bandPreviewTime = 0.0;
+  m_bandBlack = 0;
+  m_bandWhite = 65535;
+  m_bandElectrons = 0.0f;
+  m_publishQueue = NULL;
+  m_publishPending = 0;
+  m_publishSlot = 0;
+  p_Track = NULL;
+  p_TrackImg = NULL;
+  m_TrackWidth = 0;
+  m_TrackHeight = 0;
+  m_trackAborted = false;
+  m_trackReadoutTime = 0.0;
+  m_progressPercent = 0;
+  m_progressPending = 0;
+  m_progressPeriod = ADSBIG_PROGRESS_PERIOD_DEFAULT;
+  epicsTimeGetCurrent(&m_progressTime);
+  p_Fits = NULL;
+  p_RowPool = NULL;
+  p_Codec = NULL;
+  p_Spool = NULL;
+  p_Demosaic = NULL;
+  m_pPreviewArray = NULL;
+  epicsTimeGetCurrent(&m_previewTime);
+  epicsTimeGetCurrent(&m_frameStartTime);
+  m_exposureStart = m_frameStartTime;
+  m_exposureEnd = m_frameStartTime;
+  m_readoutStart = m_frameStartTime;
+  m_readoutEnd = m_frameStartTime;
+  m_cameraExposure = 0.0;
+  m_cameraExposureValid = false;
+  m_lastExposureStart = m_frameStartTime;
+  m_haveLastStart = false;
 
   //Create the epicsEvents for signaling the readout thread.
   m_startEvent = epicsEventMustCreate(epicsEventEmpty);
@@ -58,6 +131,53 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for stop event.\n", functionName);
     return;
   }
+  m_trackStartEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_trackStartEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for tracking start event.\n", functionName);
+    return;
+  }
+  m_trackStopEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_trackStopEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for tracking stop event.\n", functionName);
+    return;
+  }
+  m_bandEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_bandEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for band event.\n", functionName);
+    return;
+  }
+  m_bandDoneEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_bandDoneEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for band done event.\n", functionName);
+    return;
+  }
+  m_telemEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_telemEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for telemetry event.\n", functionName);
+    return;
+  }
+  m_publishEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_publishEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for publish event.\n", functionName);
+    return;
+  }
+  m_publishFreeEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_publishFreeEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for publish free event.\n", functionName);
+    return;
+  }
+  m_previewEvent = epicsEventMustCreate(epicsEventEmpty);
+  if (!m_previewEvent) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsEventCreate failure for preview event.\n", functionName);
+    return;
+  }
+
+  //Single producer (readout thread), single consumer (publisher thread) queue of completed frames.
+  m_publishQueue = epicsRingPointerLocklessCreate(ADSBIG_PUB_QUEUE_SIZE);
+  if (!m_publishQueue) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s epicsRingPointerLocklessCreate failure for publish queue.\n", functionName);
+    return;
+  }
 
   //Add the params to the paramLib 
   //createParam adds the parameters to all param lists automatically (using maxAddr).
@@ -67,11 +187,186 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
   createParam(ADSBIGPercentCompleteParamString, asynParamFloat64,  &ADSBIGPercentCompleteParam);
   createParam(ADSBIGTEStatusParamString,        asynParamInt32,    &ADSBIGTEStatusParam);
   createParam(ADSBIGTEPowerParamString,         asynParamFloat64,  &ADSBIGTEPowerParam);
+  createParam(ADSBIGFrameRateParamString,       asynParamFloat64,  &ADSBIGFrameRateParam);
+  createParam(ADSBIGDeadTimeParamString,        asynParamFloat64,  &ADSBIGDeadTimeParam);
+  createParam(ADSBIGStreamingParamString,       asynParamInt32,    &ADSBIGStreamingParam);
+  createParam(ADSBIGBandLinesParamString,       asynParamInt32,    &ADSBIGBandLinesParam);
+  createParam(ADSBIGBandLatencyParamString,     asynParamFloat64,  &ADSBIGBandLatencyParam);
+  createParam(ADSBIGBandLatencyMaxParamString,  asynParamFloat64,  &ADSBIGBandLatencyMaxParam);
+  createParam(ADSBIGProcTailParamString,        asynParamFloat64,  &ADSBIGProcTailParam);
+  createParam(ADSBIGProcHiddenParamString,      asynParamFloat64,  &ADSBIGProcHiddenParam);
+  createParam(ADSBIGExpPollsParamString,        asynParamInt32,    &ADSBIGExpPollsParam);
+  createParam(ADSBIGExpCPUTimeParamString,      asynParamFloat64,  &ADSBIGExpCPUTimeParam);
+  createParam(ADSBIGPubQueueDepthParamString,   asynParamInt32,    &ADSBIGPubQueueDepthParam);
+  createParam(ADSBIGPubQueueUsedParamString,    asynParamInt32,    &ADSBIGPubQueueUsedParam);
+  createParam(ADSBIGPubDropPolicyParamString,   asynParamInt32,    &ADSBIGPubDropPolicyParam);
+  createParam(ADSBIGPubDroppedParamString,      asynParamInt32,    &ADSBIGPubDroppedParam);
+  createParam(ADSBIGPubQueueTimeParamString,    asynParamFloat64,  &ADSBIGPubQueueTimeParam);
+  createParam(ADSBIGPubAttrTimeParamString,     asynParamFloat64,  &ADSBIGPubAttrTimeParam);
+  createParam(ADSBIGPubCallbackTimeParamString, asynParamFloat64,  &ADSBIGPubCallbackTimeParam);
+  createParam(ADSBIGTimeSetupParamString,       asynParamFloat64,  &ADSBIGTimeSetupParam);
+  createParam(ADSBIGTimeSetupMeanParamString,   asynParamFloat64,  &ADSBIGTimeSetupMeanParam);
+  createParam(ADSBIGTimeSetupP99ParamString,    asynParamFloat64,  &ADSBIGTimeSetupP99Param);
+  createParam(ADSBIGTimeSetupHistParamString,   asynParamInt32Array, &ADSBIGTimeSetupHistParam);
+  createParam(ADSBIGTimeExposureParamString,    asynParamFloat64,  &ADSBIGTimeExposureParam);
+  createParam(ADSBIGTimeExposureMeanParamString, asynParamFloat64, &ADSBIGTimeExposureMeanParam);
+  createParam(ADSBIGTimeExposureP99ParamString, asynParamFloat64,  &ADSBIGTimeExposureP99Param);
+  createParam(ADSBIGTimeExposureHistParamString, asynParamInt32Array, &ADSBIGTimeExposureHistParam);
+  createParam(ADSBIGTimeReadoutParamString,     asynParamFloat64,  &ADSBIGTimeReadoutParam);
+  createParam(ADSBIGTimeReadoutMeanParamString, asynParamFloat64,  &ADSBIGTimeReadoutMeanParam);
+  createParam(ADSBIGTimeReadoutP99ParamString,  asynParamFloat64,  &ADSBIGTimeReadoutP99Param);
+  createParam(ADSBIGTimeReadoutHistParamString, asynParamInt32Array, &ADSBIGTimeReadoutHistParam);
+  createParam(ADSBIGTimeConvertParamString,     asynParamFloat64,  &ADSBIGTimeConvertParam);
+  createParam(ADSBIGTimeConvertMeanParamString, asynParamFloat64,  &ADSBIGTimeConvertMeanParam);
+  createParam(ADSBIGTimeConvertP99ParamString,  asynParamFloat64,  &ADSBIGTimeConvertP99Param);
+  createParam(ADSBIGTimeConvertHistParamString, asynParamInt32Array, &ADSBIGTimeConvertHistParam);
+  createParam(ADSBIGTimeCallbackParamString,    asynParamFloat64,  &ADSBIGTimeCallbackParam);
+  createParam(ADSBIGTimeCallbackMeanParamString, asynParamFloat64, &ADSBIGTimeCallbackMeanParam);
+  createParam(ADSBIGTimeCallbackP99ParamString, asynParamFloat64,  &ADSBIGTimeCallbackP99Param);
+  createParam(ADSBIGTimeCallbackHistParamString, asynParamInt32Array, &ADSBIGTimeCallbackHistParam);
+  createParam(ADSBIGTimeHistBinsParamString,    asynParamFloat64Array, &ADSBIGTimeHistBinsParam);
+  createParam(ADSBIGTimeResetParamString,       asynParamInt32,    &ADSBIGTimeResetParam);
+  createParam(ADSBIGExpErrorParamString,        asynParamFloat64,  &ADSBIGExpErrorParam);
+  createParam(ADSBIGReadoutRateParamString,     asynParamFloat64,  &ADSBIGReadoutRateParam);
+  createParam(ADSBIGDarkSubtractParamString,    asynParamInt32,   &ADSBIGDarkSubtractParam);
+  createParam(ADSBIGDarkNumFramesParamString,   asynParamInt32,   &ADSBIGDarkNumFramesParam);
+  createParam(ADSBIGDarkBuildParamString,       asynParamInt32,   &ADSBIGDarkBuildParam);
+  createParam(ADSBIGDarkFramesDoneParamString,  asynParamInt32,   &ADSBIGDarkFramesDoneParam);
+  createParam(ADSBIGDarkPedestalParamString,    asynParamInt32,   &ADSBIGDarkPedestalParam);
+  createParam(ADSBIGDarkTempBucketParamString,  asynParamFloat64, &ADSBIGDarkTempBucketParam);
+  createParam(ADSBIGDarkMatchedParamString,     asynParamInt32,   &ADSBIGDarkMatchedParam);
+  createParam(ADSBIGDarkCountParamString,       asynParamInt32,   &ADSBIGDarkCountParam);
+  createParam(ADSBIGDarkMemoryParamString,      asynParamFloat64, &ADSBIGDarkMemoryParam);
+  createParam(ADSBIGDarkClearParamString,       asynParamInt32,   &ADSBIGDarkClearParam);
+  createParam(ADSBIGDarkFileParamString,        asynParamOctet,   &ADSBIGDarkFileParam);
+  createParam(ADSBIGDarkSaveParamString,        asynParamInt32,   &ADSBIGDarkSaveParam);
+  createParam(ADSBIGDarkLoadParamString,        asynParamInt32,   &ADSBIGDarkLoadParam);
+  createParam(ADSBIGFlatFieldParamString,       asynParamInt32,   &ADSBIGFlatFieldParam);
+  createParam(ADSBIGFlatNumFramesParamString,   asynParamInt32,   &ADSBIGFlatNumFramesParam);
+  createParam(ADSBIGFlatBuildParamString,       asynParamInt32,   &ADSBIGFlatBuildParam);
+  createParam(ADSBIGFlatFramesDoneParamString,  asynParamInt32,   &ADSBIGFlatFramesDoneParam);
+  createParam(ADSBIGFlatValidParamString,       asynParamInt32,   &ADSBIGFlatValidParam);
+  createParam(ADSBIGFlatMatchedParamString,     asynParamInt32,   &ADSBIGFlatMatchedParam);
+  createParam(ADSBIGFlatMeanParamString,        asynParamFloat64, &ADSBIGFlatMeanParam);
+  createParam(ADSBIGFlatTimeParamString,        asynParamFloat64, &ADSBIGFlatTimeParam);
+  createParam(ADSBIGFlatClearParamString,       asynParamInt32,   &ADSBIGFlatClearParam);
+  createParam(ADSBIGFlatFileParamString,        asynParamOctet,   &ADSBIGFlatFileParam);
+  createParam(ADSBIGFlatSaveParamString,        asynParamInt32,   &ADSBIGFlatSaveParam);
+  createParam(ADSBIGFlatLoadParamString,        asynParamInt32,   &ADSBIGFlatLoadParam);
+  createParam(ADSBIGDarkRefreshParamString,     asynParamInt32,    &ADSBIGDarkRefreshParam);
+  createParam(ADSBIGDarkAgeParamString,         asynParamInt32,    &ADSBIGDarkAgeParam);
+  createParam(ADSBIGStatsEnableParamString,     asynParamInt32,    &ADSBIGStatsEnableParam);
+  createParam(ADSBIGStatsSatLevelParamString,   asynParamInt32,    &ADSBIGStatsSatLevelParam);
+  createParam(ADSBIGStatsSatUsedParamString,    asynParamInt32,    &ADSBIGStatsSatUsedParam);
+  createParam(ADSBIGStatsMinParamString,        asynParamInt32,    &ADSBIGStatsMinParam);
+  createParam(ADSBIGStatsMaxParamString,        asynParamInt32,    &ADSBIGStatsMaxParam);
+  createParam(ADSBIGStatsMeanParamString,       asynParamFloat64,  &ADSBIGStatsMeanParam);
+  createParam(ADSBIGStatsSigmaParamString,      asynParamFloat64,  &ADSBIGStatsSigmaParam);
+  createParam(ADSBIGStatsTotalParamString,      asynParamFloat64,  &ADSBIGStatsTotalParam);
+  createParam(ADSBIGStatsNumSatParamString,     asynParamInt32,    &ADSBIGStatsNumSatParam);
+  createParam(ADSBIGStatsBackgroundParamString, asynParamInt32,    &ADSBIGStatsBackgroundParam);
+  createParam(ADSBIGStatsRangeParamString,      asynParamInt32,    &ADSBIGStatsRangeParam);
+  createParam(ADSBIGStatsHistParamString,       asynParamInt32Array, &ADSBIGStatsHistParam);
+  createParam(ADSBIGTrackWaitParamString,       asynParamFloat64,  &ADSBIGTrackWaitParam);
+  createParam(ADSBIGTrackDeferredParamString,   asynParamInt32,    &ADSBIGTrackDeferredParam);
+  createParam(ADSBIGFocusParamString,           asynParamInt32,    &ADSBIGFocusParam);
+  createParam(ADSBIGTempPeriodParamString,      asynParamFloat64,  &ADSBIGTempPeriodParam);
+  createParam(ADSBIGTEPeriodParamString,        asynParamFloat64,  &ADSBIGTEPeriodParam);
+  createParam(ADSBIGProgressPeriodParamString,  asynParamFloat64,  &ADSBIGProgressPeriodParam);
+  createParam(ADSBIGLinkPeriodParamString,      asynParamFloat64,  &ADSBIGLinkPeriodParam);
+  createParam(ADSBIGLinkStatusParamString,      asynParamInt32,    &ADSBIGLinkStatusParam);
+  createParam(ADSBIGLinkErrorsParamString,      asynParamInt32,    &ADSBIGLinkErrorsParam);
+  createParam(ADSBIGTelemDeferredParamString,   asynParamInt32,    &ADSBIGTelemDeferredParam);
+  createParam(ADSBIGFitsCompressParamString,    asynParamInt32,    &ADSBIGFitsCompressParam);
+  createParam(ADSBIGFitsObjectParamString,      asynParamOctet,    &ADSBIGFitsObjectParam);
+  createParam(ADSBIGFitsTelescopeParamString,   asynParamOctet,    &ADSBIGFitsTelescopeParam);
+  createParam(ADSBIGFitsObserverParamString,    asynParamOctet,    &ADSBIGFitsObserverParam);
+  createParam(ADSBIGFitsQueueUsedParamString,   asynParamInt32,    &ADSBIGFitsQueueUsedParam);
+  createParam(ADSBIGFitsWrittenParamString,     asynParamInt32,    &ADSBIGFitsWrittenParam);
+  createParam(ADSBIGFitsDroppedParamString,     asynParamInt32,    &ADSBIGFitsDroppedParam);
+  createParam(ADSBIGFitsRateParamString,        asynParamFloat64,  &ADSBIGFitsRateParam);
+  createParam(ADSBIGFitsRatioParamString,       asynParamFloat64,  &ADSBIGFitsRatioParam);
+  createParam(ADSBIGCodecParamString,           asynParamInt32,    &ADSBIGCodecParam);
+  createParam(ADSBIGCodecRatioParamString,      asynParamFloat64,  &ADSBIGCodecRatioParam);
+  createParam(ADSBIGCodecRateParamString,       asynParamFloat64,  &ADSBIGCodecRateParam);
+  createParam(ADSBIGSpoolEnableParamString,     asynParamInt32,    &ADSBIGSpoolEnableParam);
+  createParam(ADSBIGSpoolFileParamString,       asynParamOctet,    &ADSBIGSpoolFileParam);
+  createParam(ADSBIGSpoolSizeParamString,       asynParamInt32,    &ADSBIGSpoolSizeParam);
+  createParam(ADSBIGSpoolMessageParamString,    asynParamOctet,    &ADSBIGSpoolMessageParam);
+  createParam(ADSBIGSpoolRateParamString,       asynParamFloat64,  &ADSBIGSpoolRateParam);
+  createParam(ADSBIGSpoolFillParamString,       asynParamFloat64,  &ADSBIGSpoolFillParam);
+  createParam(ADSBIGSpoolFramesParamString,     asynParamInt32,    &ADSBIGSpoolFramesParam);
+  createParam(ADSBIGSpoolOverwritesParamString, asynParamInt32,    &ADSBIGSpoolOverwritesParam);
+  createParam(ADSBIGDemosaicParamString,        asynParamInt32,    &ADSBIGDemosaicParam);
+  createParam(ADSBIGCCDBayerPatternParamString, asynParamInt32,    &ADSBIGCCDBayerPatternParam);
+  createParam(ADSBIGDemosaicTimeParamString,    asynParamFloat64,  &ADSBIGDemosaicTimeParam);
+  createParam(ADSBIGReadoutModesParamString,    asynParamOctet,    &ADSBIGReadoutModesParam);
+  createParam(ADSBIGReadoutFullTimeParamString, asynParamFloat64,  &ADSBIGReadoutFullTimeParam);
+  createParam(ADSBIGReadoutReductionParamString, asynParamFloat64, &ADSBIGReadoutReductionParam);
+  createParam(ADSBIGPreviewFactorParamString,   asynParamInt32,    &ADSBIGPreviewFactorParam);
+  createParam(ADSBIGPreviewModeParamString,     asynParamInt32,    &ADSBIGPreviewModeParam);
+  createParam(ADSBIGPreviewAutoscaleParamString, asynParamInt32,   &ADSBIGPreviewAutoscaleParam);
+  createParam(ADSBIGPreviewMaxRateParamString,  asynParamFloat64,  &ADSBIGPreviewMaxRateParam);
+  createParam(ADSBIGPreviewTimeParamString,     asynParamFloat64,  &ADSBIGPreviewTimeParam);
+  createParam(ADSBIGPreviewDroppedParamString,  asynParamInt32,    &ADSBIGPreviewDroppedParam);
+  createParam(ADSBIGConvertLevelsParamString,   asynParamInt32,    &ADSBIGConvertLevelsParam);
+  createParam(ADSBIGConvertBlackParamString,    asynParamInt32,    &ADSBIGConvertBlackParam);
+  createParam(ADSBIGConvertWhiteParamString,    asynParamInt32,    &ADSBIGConvertWhiteParam);
+  createParam(ADSBIGConvertElectronsParamString, asynParamInt32,   &ADSBIGConvertElectronsParam);
+  createParam(ADSBIGConvertEGainParamString,    asynParamFloat64,  &ADSBIGConvertEGainParam);
+  createParam(ADSBIGTimeUSTimerParamString,     asynParamInt32,    &ADSBIGTimeUSTimerParam);
+  createParam(ADSBIGExpActualParamString,       asynParamFloat64,  &ADSBIGExpActualParam);
+  createParam(ADSBIGExpCameraParamString,       asynParamFloat64,  &ADSBIGExpCameraParam);
+  createParam(ADSBIGExpJitterMeanParamString,   asynParamFloat64,  &ADSBIGExpJitterMeanParam);
+  createParam(ADSBIGExpJitterSigmaParamString,  asynParamFloat64,  &ADSBIGExpJitterSigmaParam);
+  createParam(ADSBIGExpJitterMaxParamString,    asynParamFloat64,  &ADSBIGExpJitterMaxParam);
+  createParam(ADSBIGStartPeriodParamString,     asynParamFloat64,  &ADSBIGStartPeriodParam);
+  createParam(ADSBIGStartPeriodMeanParamString, asynParamFloat64,  &ADSBIGStartPeriodMeanParam);
+  createParam(ADSBIGStartPeriodSigmaParamString, asynParamFloat64, &ADSBIGStartPeriodSigmaParam);
+  createParam(ADSBIGStartPeriodMaxParamString,  asynParamFloat64,  &ADSBIGStartPeriodMaxParam);
   createParam(ADSBIGLastParamString,            asynParamInt32,    &ADSBIGLastParam);
 
+  //Timing statistics. Each stage has its own last, mean, p99 and histogram params.
+  m_timing[ADSBIG_STAGE_SETUP].lastParam = ADSBIGTimeSetupParam;
+  m_timing[ADSBIG_STAGE_SETUP].meanParam = ADSBIGTimeSetupMeanParam;
+  m_timing[ADSBIG_STAGE_SETUP].p99Param = ADSBIGTimeSetupP99Param;
+  m_timing[ADSBIG_STAGE_SETUP].histParam = ADSBIGTimeSetupHistParam;
+  m_timing[ADSBIG_STAGE_EXPOSURE].lastParam = ADSBIGTimeExposureParam;
+  m_timing[ADSBIG_STAGE_EXPOSURE].meanParam = ADSBIGTimeExposureMeanParam;
+  m_timing[ADSBIG_STAGE_EXPOSURE].p99Param = ADSBIGTimeExposureP99Param;
+  m_timing[ADSBIG_STAGE_EXPOSURE].histParam = ADSBIGTimeExposureHistParam;
+  m_timing[ADSBIG_STAGE_READOUT].lastParam = ADSBIGTimeReadoutParam;
+  m_timing[ADSBIG_STAGE_READOUT].meanParam = ADSBIGTimeReadoutMeanParam;
+  m_timing[ADSBIG_STAGE_READOUT].p99Param = ADSBIGTimeReadoutP99Param;
+  m_timing[ADSBIG_STAGE_READOUT].histParam = ADSBIGTimeReadoutHistParam;
+  m_timing[ADSBIG_STAGE_CONVERT].lastParam = ADSBIGTimeConvertParam;
+  m_timing[ADSBIG_STAGE_CONVERT].meanParam = ADSBIGTimeConvertMeanParam;
+  m_timing[ADSBIG_STAGE_CONVERT].p99Param = ADSBIGTimeConvertP99Param;
+  m_timing[ADSBIG_STAGE_CONVERT].histParam = ADSBIGTimeConvertHistParam;
+  m_timing[ADSBIG_STAGE_CALLBACK].lastParam = ADSBIGTimeCallbackParam;
+  m_timing[ADSBIG_STAGE_CALLBACK].meanParam = ADSBIGTimeCallbackMeanParam;
+  m_timing[ADSBIG_STAGE_CALLBACK].p99Param = ADSBIGTimeCallbackP99Param;
+  m_timing[ADSBIG_STAGE_CALLBACK].histParam = ADSBIGTimeCallbackHistParam;
+  m_timingSorted.reserve(ADSBIG_TIMING_WINDOW);
+  //Lower edge of each histogram bin (ms)
+  m_timingBins.resize(ADSBIG_TIMING_BINS);
+  for (int bin=0; bin<ADSBIG_TIMING_BINS; ++bin) {
+    m_timingBins[bin] = ADSBIG_TIMING_BIN_MIN * pow(10.0, static_cast<double>(bin) / ADSBIG_TIMING_BINS_PER_DECADE);
+  }
+  resetTiming();
+
   //Connect to camera here and get library handle
-  printf("%s Connecting to camera...\n", functionName);
-  p_Cam = new CSBIGCam(DEV_USB1);
+  //The camera is selected by serial number if one is given, otherwise by USB slot.
+  if ((serialNumber != NULL) && (serialNumber[0] != '\0')) {
+    printf("%s Connecting to camera with serial number %s...\n", functionName, serialNumber);
+  } else {
+    printf("%s Connecting to camera in USB slot %d...\n", functionName, usbSlot);
+  }
+  if (simulate) {
+    p_Cam = new CSBIGCam(usbSlot, serialNumber, ADSBIGSimDrvCommand);
+  } else {
+    p_Cam = new CSBIGCam(usbSlot, serialNumber);
+  }
   PAR_ERROR cam_err = CE_NO_ERROR;
   if (p_Cam == NULL) {
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
@@ -92,8 +387,15 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
     return;
   }
 
-  printf("%s Successfully connected to camera: %s\n", 
-         functionName, p_Cam->GetCameraTypeString().c_str());
+  printf("%s Successfully connected to camera: %s (USB slot %d, serial number %s)\n", 
+         functionName, p_Cam->GetCameraTypeString().c_str(), 
+         p_Cam->GetUSBSlot(), p_Cam->GetSerialNumber().c_str());
+
+  //Sleep on our stop event while waiting for exposures, so that an abort wakes us up.
+  p_Cam->SetExposureWaitCallback(ADSBIGExposureWaitC, this);
+
+  //Reuse a recent temperature reading (from the telemetry task or an earlier frame) in GrabMain.
+  p_Cam->SetTemperatureMaxAge(ADSBIG_TEMP_PERIOD_DEFAULT);
 
   //Set some default camera modes
   p_Cam->SetActiveCCD(CCD_IMAGING);
@@ -115,6 +417,17 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
     printf("%s Camera Height: %d\n", functionName, m_CamHeight);
   }
 
+  //The readout modes (and so the binning) the CCD supports
+  int numModes = 0;
+  if ((cam_err = p_Cam->GetReadoutModeCount(numModes)) != CE_NO_ERROR) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s. Failed to read the readout modes. %s\n", 
+              functionName, p_Cam->GetErrorString(cam_err).c_str());
+    numModes = 1;
+  }
+  m_readoutModes[ADSBIG_ADDR_IMAGING].set(numModes, (p_Cam->GetCameraType() == STI_CAMERA));
+  printf("%s Readout Modes: %s\n", functionName, m_readoutModes[ADSBIG_ADDR_IMAGING].names().c_str());
+
   //SetSubFrame is called again when we change the ReadoutMode (ie. do on-chip binning).
   p_Cam->SetSubFrame(0, 0, m_CamWidth, m_CamHeight);
 
@@ -127,10 +440,35 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
     return;
   }
 
+  //The tracking CCD (if the camera has one) is used through the same driver handle from
+  //its own thread. Its readouts are serialised with the imaging CCD's by the class library.
+  p_Track = new CSBIGCam(p_Cam, CCD_TRACKING);
+  p_Track->SetExposureWaitCallback(ADSBIGTrackWaitC, this);
+  p_Track->SetTemperatureMaxAge(ADSBIG_TEMP_PERIOD_DEFAULT);
+  p_Track->SetReadoutMode(RM_1X1);
+  p_Track->SetExposureTime(0.1);
+  p_Track->SetABGState(ABG_LOW7);
+  if ((p_Track->GetFullFrame(m_TrackWidth, m_TrackHeight) != CE_NO_ERROR) || 
+      (m_TrackWidth <= 0) || (m_TrackHeight <= 0)) {
+    printf("%s No tracking CCD.\n", functionName);
+    m_TrackWidth = 0;
+    m_TrackHeight = 0;
+  } else {
+    printf("%s Tracking CCD Width: %d\n", functionName, m_TrackWidth);
+    printf("%s Tracking CCD Height: %d\n", functionName, m_TrackHeight);
+    if (p_Track->GetReadoutModeCount(numModes) != CE_NO_ERROR) {
+      numModes = 1;
+    }
+    m_readoutModes[ADSBIG_ADDR_TRACKING].set(numModes, (p_Cam->GetCameraType() == STI_CAMERA));
+  }
+  p_Track->SetSubFrame(0, 0, m_TrackWidth, m_TrackHeight);
+  p_TrackImg = new CSBIGImg();
+
   bool paramStatus = true;
   //Initialise any paramLib parameters that need passing up to device support
   paramStatus = ((setStringParam(ADManufacturer, "SBIG") == asynSuccess) && paramStatus);
   paramStatus = ((setStringParam(ADModel, p_Cam->GetCameraTypeString().c_str()) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSerialNumber, p_Cam->GetSerialNumber().c_str()) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(ADMaxSizeX, m_CamWidth) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(ADMaxSizeY, m_CamHeight) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(ADSizeX, m_CamWidth) == asynSuccess) && paramStatus);
@@ -144,14 +482,174 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
   paramStatus = ((setIntegerParam(ADImageMode, ADImageSingle) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(ADTriggerMode, ADTriggerInternal) == asynSuccess) && paramStatus); 
   paramStatus = ((setDoubleParam(ADAcquireTime, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADAcquirePeriod, 0.0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(NDDataType, NDUInt16) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADTemperatureActual, 0.0) == asynSuccess) && paramStatus);
 
   paramStatus = ((setIntegerParam(ADSBIGDarkFieldParam, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(ADSBIGReadoutModeParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGReadoutModesParam, m_readoutModes[ADSBIG_ADDR_IMAGING].names().c_str()) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGReadoutFullTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGReadoutReductionParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGConvertLevelsParam, ADSBIG_CONVERT_LEVELS_AUTO) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGConvertBlackParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGConvertWhiteParam, 65535) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGConvertElectronsParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGConvertEGainParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGTimeUSTimerParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpActualParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpCameraParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpJitterMeanParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpJitterSigmaParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpJitterMaxParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStartPeriodParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStartPeriodMeanParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStartPeriodSigmaParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStartPeriodMaxParam, 0.0) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADSBIGPercentCompleteParam, 0.0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(ADSBIGTEStatusParam, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(ADSBIGTEPowerParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGFrameRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGDeadTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStreamingParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGBandLinesParam, 64) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGBandLatencyParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGBandLatencyMaxParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGProcTailParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGProcHiddenParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGExpPollsParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpCPUTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGPubQueueDepthParam, 2) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGPubQueueUsedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGPubDropPolicyParam, ADSBIG_PUB_WAIT) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGPubDroppedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGPubQueueTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGPubAttrTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGPubCallbackTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGTimeResetParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGExpErrorParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGReadoutRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkSubtractParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkNumFramesParam, 10) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkBuildParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkFramesDoneParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkPedestalParam, 100) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGDarkTempBucketParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkMatchedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkCountParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGDarkMemoryParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkClearParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGDarkFileParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkSaveParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkLoadParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatFieldParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatNumFramesParam, 10) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatBuildParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatFramesDoneParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatValidParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatMatchedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGFlatMeanParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGFlatTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatClearParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGFlatFileParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatSaveParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFlatLoadParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkRefreshParam, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDarkAgeParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsEnableParam, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsSatLevelParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsSatUsedParam, p_Img->GetSaturationLevel()) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsMinParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsMaxParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStatsMeanParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStatsSigmaParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGStatsTotalParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsNumSatParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsBackgroundParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGStatsRangeParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFocusParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGTempPeriodParam, ADSBIG_TEMP_PERIOD_DEFAULT) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGTEPeriodParam, ADSBIG_TE_PERIOD_DEFAULT) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGProgressPeriodParam, ADSBIG_PROGRESS_PERIOD_DEFAULT) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGLinkPeriodParam, ADSBIG_LINK_PERIOD_DEFAULT) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGLinkStatusParam, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGLinkErrorsParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGTelemDeferredParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(NDAutoSave, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(NDFileWriteStatus, NDFileWriteOK) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(NDFileWriteMessage, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFitsCompressParam, ADSBIG_FITS_NONE) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGFitsObjectParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGFitsTelescopeParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGFitsObserverParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFitsQueueUsedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFitsWrittenParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGFitsDroppedParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGFitsRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGFitsRatioParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGCodecParam, ADSBIG_CODEC_NONE) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGCodecRatioParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGCodecRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGSpoolEnableParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGSpoolFileParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGSpoolSizeParam, ADSBIG_SPOOL_DEFAULT_SIZE) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(ADSBIGSpoolMessageParam, "") == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGSpoolRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGSpoolFillParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGSpoolFramesParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGSpoolOverwritesParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGDemosaicParam, ADSBIG_DEMOSAIC_NONE) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(ADSBIGCCDBayerPatternParam, ADSBIG_BAYER_NONE) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(ADSBIGDemosaicTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(NDColorMode, NDColorModeMono) == asynSuccess) && paramStatus);
+  m_statsHist.assign(HISTOGRAM_BINS, 0);
+
+  //Tracking CCD params
+  const int track = ADSBIG_ADDR_TRACKING;
+  paramStatus = ((setStringParam(track, ADManufacturer, "SBIG") == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(track, ADModel, p_Cam->GetCameraTypeString().c_str()) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(track, ADSerialNumber, p_Cam->GetSerialNumber().c_str()) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(track, ADStatusMessage, (m_TrackWidth > 0) ? "Idle" : "No tracking CCD") == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADMaxSizeX, m_TrackWidth) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADMaxSizeY, m_TrackHeight) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADSizeX, m_TrackWidth) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADSizeY, m_TrackHeight) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADBinX, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADBinY, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADMinX, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADMinY, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADNumExposures, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADNumImages, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADNumImagesCounter, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADImageMode, ADImageContinuous) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADTriggerMode, ADTriggerInternal) == asynSuccess) && paramStatus); 
+  paramStatus = ((setIntegerParam(track, ADStatus, ADStatusIdle) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADAcquire, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(track, ADAcquireTime, 0.1) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(track, ADAcquirePeriod, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, NDDataType, NDUInt16) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, NDArrayCounter, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, NDArrayCallbacks, 1) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADSBIGReadoutModeParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setStringParam(track, ADSBIGReadoutModesParam, m_readoutModes[track].names().c_str()) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(track, ADSBIGReadoutFullTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(track, ADSBIGReadoutReductionParam, 1.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(track, ADSBIGFrameRateParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(track, ADSBIGTrackWaitParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(track, ADSBIGTrackDeferredParam, 0) == asynSuccess) && paramStatus);
+
+  //Preview params. The preview is off until its NDArrayCallbacks is enabled.
+  const int preview = ADSBIG_ADDR_PREVIEW;
+  paramStatus = ((setIntegerParam(preview, NDDataType, NDUInt16) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, NDColorMode, NDColorModeMono) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, NDArrayCounter, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, NDArrayCallbacks, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, ADSBIGPreviewFactorParam, 4) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, ADSBIGPreviewModeParam, ADSBIG_PREVIEW_BIN) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, ADSBIGPreviewAutoscaleParam, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(preview, ADSBIGPreviewMaxRateParam, 5.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setDoubleParam(preview, ADSBIGPreviewTimeParam, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(preview, ADSBIGPreviewDroppedParam, 0) == asynSuccess) && paramStatus);
 
   if (!paramStatus) {
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
@@ -159,6 +657,25 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
     return;
   }
 
+  //The FITS writer threads
+  p_Fits = new ADSBIGFitsWriter(ADSBIG_FITS_THREADS, ADSBIG_FITS_QUEUE_SIZE, ADSBIGFitsDoneC, this);
+  if (!ADSBIGFitsWriter::available()) {
+    printf("%s Built without CFITSIO. FITS files can't be written.\n", functionName);
+  }
+
+  //The threads that compress the published frames and demosaic colour frames,
+  //including the calling thread (the publisher or readout thread)
+  int rowThreads = epicsThreadGetCPUs();
+  if (rowThreads > ADSBIG_ROW_POOL_MAX_THREADS) {
+    rowThreads = ADSBIG_ROW_POOL_MAX_THREADS;
+  }
+  p_RowPool = new ADSBIGRowPool("ADSBIGRows", rowThreads);
+  p_Codec = new ADSBIGCodec(p_RowPool);
+  p_Demosaic = new ADSBIGDemosaic(p_RowPool);
+
+  //The spool file is only opened when SpoolEnable is set
+  p_Spool = new ADSBIGSpool();
+
   //Create the thread that reads the data 
   status = (epicsThreadCreate("ADSBIGReadoutTask",
                             epicsThreadPriorityHigh,
@@ -171,15 +688,63 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
     return;
   }
 
-  //Create the thread that periodically reads the temperature and readout progress
-  status = (epicsThreadCreate("ADSBIGPollingTask",
+  //Create the thread that takes the tracking CCD frames
+  status = (epicsThreadCreate("ADSBIGTrackTask",
+                            epicsThreadPriorityHigh,
+                            epicsThreadGetStackSize(epicsThreadStackMedium),
+                            (EPICSTHREADFUNC)ADSBIGTrackTaskC,
+                            this) == NULL);
+  if (status) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s epicsThreadCreate failure for ADSBIGTrackTask.\n", functionName);
+    return;
+  }
+
+  //Create the thread that processes bands of lines during a streaming readout
+  status = (epicsThreadCreate("ADSBIGBandTask",
+                            epicsThreadPriorityHigh,
+                            epicsThreadGetStackSize(epicsThreadStackMedium),
+                            (EPICSTHREADFUNC)ADSBIGBandTaskC,
+                            this) == NULL);
+  if (status) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s epicsThreadCreate failure for ADSBIGBandTask.\n", functionName);
+    return;
+  }
+
+  //Create the thread that gets the attributes and does the NDArray callbacks
+  status = (epicsThreadCreate("ADSBIGPublishTask",
+                            epicsThreadPriorityMedium,
+                            epicsThreadGetStackSize(epicsThreadStackMedium),
+                            (EPICSTHREADFUNC)ADSBIGPublishTaskC,
+                            this) == NULL);
+  if (status) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s epicsThreadCreate failure for ADSBIGPublishTask.\n", functionName);
+    return;
+  }
+
+  //Create the thread that does the NDArray callbacks for the preview
+  status = (epicsThreadCreate("ADSBIGPreviewTask",
+                            epicsThreadPriorityMedium,
+                            epicsThreadGetStackSize(epicsThreadStackMedium),
+                            (EPICSTHREADFUNC)ADSBIGPreviewTaskC,
+                            this) == NULL);
+  if (status) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s epicsThreadCreate failure for ADSBIGPreviewTask.\n", functionName);
+    return;
+  }
+
+  //Create the thread that reads the camera telemetry and publishes the readout progress
+  status = (epicsThreadCreate("ADSBIGTelemetryTask",
                             epicsThreadPriorityMedium,
                             epicsThreadGetStackSize(epicsThreadStackMedium),
-                            (EPICSTHREADFUNC)ADSBIGPollingTaskC,
+                            (EPICSTHREADFUNC)ADSBIGTelemetryTaskC,
                             this) == NULL);
   if (status) {
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-              "%s epicsThreadCreate failure for ADSBIGPollingTask.\n", functionName);
+              "%s epicsThreadCreate failure for ADSBIGTelemetryTask.\n", functionName);
     return;
   }
 
@@ -192,6 +757,9 @@ ADSBIG::ADSBIG(const char *portName, int maxBuffers, size_t maxMemory) :
 ADSBIG::~ADSBIG()
 {
   printf("ERROR: ADSBIG::~ADSBIG Called.\n");
+  //The tracking CCD uses the camera's driver handle
+  delete p_Track;
+  delete p_TrackImg;
   delete p_Cam;
   delete p_Img;
 }
@@ -207,6 +775,36 @@ void ADSBIG::report(FILE *fp, int details)
    if (details > 0) {
      int ival = 0;
 
+     if (p_Cam != NULL) {
+       fprintf(fp, "  USB Slot: %d\n", p_Cam->GetUSBSlot());
+       fprintf(fp, "  Serial Number: %s\n", p_Cam->GetSerialNumber().c_str());
+     }
+     //The driver commands are shared by all the cameras in the IOC
+     unsigned long commands = 0;
+     unsigned long switches = 0;
+     unsigned long contended = 0;
+     CSBIGCam::GetArbiterCounts(commands, switches, contended);
+     fprintf(fp, "  Driver commands (all cameras): %lu, handle switches: %lu, waited: %lu\n", 
+             commands, switches, contended);
+     if (p_Cam != NULL) {
+       unsigned long count = 0;
+       unsigned long ccdInfoHits = 0;
+       unsigned long temperatureHits = 0;
+       double seconds = 0.0;
+       fprintf(fp, "  Driver commands (this camera)      count   total (ms)    mean (ms)\n");
+       for (int command=0; command<CC_LAST_COMMAND; ++command) {
+         p_Cam->GetCommandStats(static_cast<PAR_COMMAND>(command), count, seconds);
+         if (count > 0) {
+           fprintf(fp, "    %-28s %9lu %12.3f %12.4f\n", 
+                   CSBIGCam::GetCommandString(static_cast<PAR_COMMAND>(command)).c_str(), 
+                   count, seconds*1000.0, seconds*1000.0/count);
+         }
+       }
+       p_Cam->GetCacheHits(ccdInfoHits, temperatureHits);
+       fprintf(fp, "  Commands saved by cache: CCD info %lu, temperature %lu\n", 
+               ccdInfoHits, temperatureHits);
+     }
+
      getIntegerParam(ADSizeX, &ival);
      fprintf(fp, "  SizeX: %d\n", ival);
      getIntegerParam(ADSizeY, &ival);
@@ -215,6 +813,12 @@ void ADSBIG::report(FILE *fp, int details)
      fprintf(fp, "  BinX: %d\n", ival);
      getIntegerParam(ADBinY, &ival);
      fprintf(fp, "  BinY: %d\n", ival);
+     getIntegerParam(ADSBIGReadoutModeParam, &ival);
+     fprintf(fp, "  Readout Mode: %d (SBIG readout mode 0x%04X)\n", ival, 
+             (p_Cam != NULL) ? p_Cam->GetReadoutMode() : 0);
+     lock();
+     m_readoutModes[ADSBIG_ADDR_IMAGING].report(fp);
+     unlock();
      getIntegerParam(ADMaxSizeX, &ival);
      fprintf(fp, "  Max SizeX: %d\n", ival);
      getIntegerParam(ADMaxSizeY, &ival);
@@ -224,6 +828,77 @@ void ADSBIG::report(FILE *fp, int details)
      getIntegerParam(NDArraySize, &ival);
      fprintf(fp, "  NDArray Size: %d\n", ival);
 
+     const char *stageNames[ADSBIG_NUM_STAGES] = {"Setup", "Exposure", "Readout", "Convert", "Callback"};
+     double last = 0.0;
+     double mean = 0.0;
+     double p99 = 0.0;
+     fprintf(fp, "  Frame timing (ms)      last       mean        p99\n");
+     for (int stage=0; stage<ADSBIG_NUM_STAGES; ++stage) {
+       getDoubleParam(m_timing[stage].lastParam, &last);
+       getDoubleParam(m_timing[stage].meanParam, &mean);
+       getDoubleParam(m_timing[stage].p99Param, &p99);
+       fprintf(fp, "    %-12s %10.3f %10.3f %10.3f\n", stageNames[stage], last, mean, p99);
+     }
+
+     if (m_TrackWidth > 0) {
+       getIntegerParam(ADSBIG_ADDR_TRACKING, ADSBIGTrackDeferredParam, &ival);
+       fprintf(fp, "  Tracking CCD: %dx%d, last readout %.3f ms, frames deferred %d\n", 
+               m_TrackWidth, m_TrackHeight, m_trackReadoutTime * 1000.0, ival);
+       lock();
+       m_readoutModes[ADSBIG_ADDR_TRACKING].report(fp);
+       unlock();
+     } else {
+       fprintf(fp, "  Tracking CCD: None\n");
+     }
+
+     if (p_Fits != NULL) {
+       getIntegerParam(ADSBIGFitsWrittenParam, &ival);
+       fprintf(fp, "  FITS files: %s, written %d, queued %d\n", 
+               ADSBIGFitsWriter::available() ? "available" : "not available (no CFITSIO)", 
+               ival, p_Fits->pending());
+     }
+
+     if (p_Demosaic != NULL) {
+       static const char *patternNames[] = {"RGGB", "GBRG", "GRBG", "BGGR", "None"};
+       getIntegerParam(ADSBIGCCDBayerPatternParam, &ival);
+       fprintf(fp, "  CCD Bayer pattern: %s\n", 
+               ((ival >= ADSBIG_BAYER_RGGB) && (ival <= ADSBIG_BAYER_NONE)) ? patternNames[ival] : "Unknown");
+       getIntegerParam(ADSBIGDemosaicParam, &ival);
+       fprintf(fp, "  Demosaic: %s, %d thread(s)\n", 
+               (ival == ADSBIG_DEMOSAIC_BILINEAR) ? "Bilinear" : ((ival == ADSBIG_DEMOSAIC_EDGE) ? "Edge aware" : "None"), 
+               p_Demosaic->numThreads());
+     }
+
+     if ((p_Spool != NULL) && p_Spool->isOpen()) {
+       double spoolFill = 0.0;
+       double spoolRate = 0.0;
+       int spoolFrames = 0;
+       int spoolOverwrites = 0;
+       p_Spool->status(spoolFill, spoolFrames, spoolOverwrites, spoolRate);
+       fprintf(fp, "  Spool: %d frames, %.1f%% full, %d overwritten, %.1f MB/s\n", 
+               spoolFrames, spoolFill, spoolOverwrites, spoolRate);
+     }
+
+     if (p_Codec != NULL) {
+       getIntegerParam(ADSBIGCodecParam, &ival);
+       fprintf(fp, "  Frame compression: %s, %d thread(s)\n", 
+               (ival == ADSBIG_CODEC_SBIG) ? "SBIG" : "None", p_Codec->numThreads());
+     }
+
+     ADSBIGTelemetryValues telemetry = m_telemetry.read();
+     fprintf(fp, "  Telemetry: CCD temp %.2f C%s, TE power %.1f%%%s, link %s (%lu failed commands), reads deferred %d\n", 
+             telemetry.ccdTemp, telemetry.tempValid ? "" : " (not read)", 
+             telemetry.tePower, telemetry.teValid ? "" : " (not read)", 
+             telemetry.linkValid ? (telemetry.linkEstablished ? "up" : "down") : "not read", 
+             telemetry.comFailed, telemetry.deferred);
+
+     fprintf(fp, "  Master darks: %lu (%.1f MB)\n", 
+             static_cast<unsigned long>(m_darkLibrary.size()), m_darkLibrary.bytes() / 1048576.0);
+     fprintf(fp, "  Master flat: %s\n", m_flatField.valid() ? "Yes" : "No");
+     fprintf(fp, "  Last frame: min %u, max %u, mean %.2f, sigma %.2f, saturated %lu\n", 
+             m_stats.minValue(), m_stats.maxValue(), m_stats.mean(), m_stats.sigma(), 
+             static_cast<unsigned long>(m_stats.numSaturated()));
+
    }
    /* Invoke the base class method */
    ADDriver::report(fp, details);
@@ -246,17 +921,48 @@ asynStatus ADSBIG::writeInt32(asynUser *pasynUser, epicsInt32 value)
   int minY = 0;
   int sizeX = 0;
   int sizeY = 0;
-  int binning = 0;
+  int binX = 1;
+  int binY = 1;
+  std::string darkFile;
+  std::string flatFile;
+  std::string fileError;
+  std::string spoolFile;
+  std::string spoolMessage;
+  epicsInt32 spoolSize = 0;
   const char *functionName = "ADSBIG::writeInt32";
   
   asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Entry.\n", functionName);
 
+  getAddress(pasynUser, &addr);
+  if (addr == ADSBIG_ADDR_TRACKING) {
+    return writeTrackingInt32(function, value);
+  } else if (addr == ADSBIG_ADDR_PREVIEW) {
+    //The preview params are used from the next frame
+    if (function == ADSBIGPreviewFactorParam) {
+      if (value < 1) {
+        value = 1;
+      } else if (value > ADSBIG_PREVIEW_MAX_FACTOR) {
+        value = ADSBIG_PREVIEW_MAX_FACTOR;
+      }
+    }
+    status = (asynStatus) setIntegerParam(addr, function, value);
+    callParamCallbacks(addr);
+    return status;
+  }
+
   //Read the frame sizes 
   getIntegerParam(ADMinX, &minX);
   getIntegerParam(ADMinY, &minY);
   getIntegerParam(ADSizeX, &sizeX);
   getIntegerParam(ADSizeY, &sizeY);
-  getIntegerParam(ADBinX, &binning);
+  getIntegerParam(ADBinX, &binX);
+  getIntegerParam(ADBinY, &binY);
+  if (binX < 1) {
+    binX = 1;
+  }
+  if (binY < 1) {
+    binY = 1;
+  }
 
   getIntegerParam(ADStatus, &adStatus);
 
@@ -273,32 +979,19 @@ asynStatus ADSBIG::writeInt32(asynUser *pasynUser, epicsInt32 value)
       abortExposure();
     }
   } else if (function == ADSBIGDarkFieldParam) {
-    if (value == 1) {
+    if (value == ADSBIG_FRAME_DARK) {
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
                 "%s Setting Dark Field Mode.\n", functionName);
+    } else if (value == ADSBIG_FRAME_DARK_ALSO) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+                "%s Setting Dark Also Mode.\n", functionName);
     } else {
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
                 "%s Setting Light Field Mode.\n", functionName);
     }
-  } else if (function == ADSBIGReadoutModeParam) {
-      p_Cam->SetReadoutMode(value);
-      if (value == 0) {
-        binning = 1;
-      } else if (value == 1) {
-        binning = 2;
-      } else if (value == 2) {
-        binning = 3;
-      }
-      //If we change the binning, reset the frame sizes. This forces
-      //the frame sizes to be set after the binning mode.
-      //The SubFrame sizes have the be set after we know the binning anyway.
-      p_Cam->SetSubFrame(0, 0, m_CamWidth/binning, m_CamHeight/binning);
-      setIntegerParam(ADMinX, 0);
-      setIntegerParam(ADMinY, 0);
-      setIntegerParam(ADSizeX, m_CamWidth/binning);
-      setIntegerParam(ADSizeY, m_CamHeight/binning);
-      setIntegerParam(ADBinX, binning);
-      setIntegerParam(ADBinY, binning);
+  } else if ((function == ADSBIGReadoutModeParam) || (function == ADBinX) || (function == ADBinY)) {
+    status = setReadoutMode(addr, function, value);
+    getIntegerParam(function, &value);
   } else if (function == ADSBIGTEStatusParam) {
     getDoubleParam(ADTemperature, &ccd_temp_set);
     if (value == 1) {
@@ -312,29 +1005,182 @@ asynStatus ADSBIG::writeInt32(asynUser *pasynUser, epicsInt32 value)
                 functionName, p_Cam->GetErrorString(cam_err).c_str());
       status = asynError;
     }
+  } else if (function == ADSBIGBandLinesParam) {
+    if (value < 1) {
+      value = 1;
+    }
+  } else if (function == ADSBIGPubQueueDepthParam) {
+    if (value < 1) {
+      value = 1;
+    } else if (value > ADSBIG_PUB_QUEUE_SIZE) {
+      value = ADSBIG_PUB_QUEUE_SIZE;
+    }
+  } else if (function == ADSBIGPubDroppedParam) {
+    //Writing any value resets the dropped frame counter
+    value = 0;
+  } else if ((function == ADSBIGFitsWrittenParam) || (function == ADSBIGFitsDroppedParam)) {
+    value = 0;
+  } else if (function == NDAutoSave) {
+    if ((value != 0) && !ADSBIGFitsWriter::available()) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s Driver built without CFITSIO. FITS files can't be written.\n", functionName);
+      setIntegerParam(NDFileWriteStatus, NDFileWriteError);
+      setStringParam(NDFileWriteMessage, "Driver built without CFITSIO");
+      status = asynError;
+    }
+  } else if (function == ADSBIGSpoolEnableParam) {
+    if (value != 0) {
+      getStringParam(ADSBIGSpoolFileParam, spoolFile);
+      getIntegerParam(ADSBIGSpoolSizeParam, &spoolSize);
+      if (spoolFile.empty() || (spoolSize <= 0)) {
+        spoolMessage = "Set the spool file and size first";
+        value = 0;
+      } else {
+        //Allocating a big spool can take a while, so do it without the port lock.
+        //The port thread does the writes in turn, so nothing else opens or closes it.
+        setStringParam(ADSBIGSpoolMessageParam, "Opening spool");
+        callParamCallbacks();
+        unlock();
+        value = p_Spool->open(spoolFile, static_cast<size_t>(spoolSize) * 1024 * 1024, spoolMessage) ? 1 : 0;
+        lock();
+      }
+      if (value == 0) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                  "%s Spool not enabled. %s\n", functionName, spoolMessage.c_str());
+        status = asynError;
+      }
+    } else {
+      //Closing flushes the whole spool to disk
+      unlock();
+      p_Spool->close();
+      lock();
+      spoolMessage = "Spool closed";
+    }
+    setStringParam(ADSBIGSpoolMessageParam, spoolMessage.c_str());
+  } else if (function == ADSBIGTimeResetParam) {
+    if (value == 1) {
+      resetTiming();
+    }
+    value = 0;
+  } else if ((function == ADSBIGDarkBuildParam) || (function == ADSBIGFlatBuildParam)) {
+    //Building a master dark or flat is run on the readout thread like an acquisition.
+    bool *pBuild = (function == ADSBIGDarkBuildParam) ? &m_darkBuild : &m_flatBuild;
+    if ((value==1) && ((adStatus == ADStatusIdle) || (adStatus == ADStatusError) || (adStatus == ADStatusAborted))) {
+      m_Acquiring = 1;
+      m_aborted = false;
+      *pBuild = true;
+      setIntegerParam(ADStatus, ADStatusAcquire);
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Start Master Build Event.\n", functionName);
+      epicsEventSignal(this->m_startEvent);
+    } else if ((value==1) && !(*pBuild)) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s Can't build a master dark or flat while acquiring.\n", functionName);
+      value = 0;
+    } else if ((value==0) && (*pBuild)) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Abort Master Build.\n", functionName);
+      abortExposure();
+    }
+  } else if ((function == ADSBIGDarkClearParam) || (function == ADSBIGDarkSaveParam) || (function == ADSBIGDarkLoadParam) ||
+             (function == ADSBIGFlatClearParam) || (function == ADSBIGFlatSaveParam) || (function == ADSBIGFlatLoadParam)) {
+    //The band thread reads the master darks and flat during an acquisition, so they can't be changed then.
+    if ((value == 1) && (adStatus != ADStatusIdle) && (adStatus != ADStatusError) && (adStatus != ADStatusAborted)) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s Can't change the master darks or flat while acquiring.\n", functionName);
+      status = asynError;
+    } else if (value == 1) {
+      getStringParam(ADSBIGDarkFileParam, darkFile);
+      getStringParam(ADSBIGFlatFileParam, flatFile);
+      if (function == ADSBIGDarkClearParam) {
+        m_darkLibrary.clear();
+        setStringParam(ADStatusMessage, "Cleared dark library");
+      } else if (function == ADSBIGDarkSaveParam) {
+        if (m_darkLibrary.save(darkFile, fileError)) {
+          setStringParam(ADStatusMessage, "Saved dark library");
+        } else {
+          status = asynError;
+        }
+      } else if (function == ADSBIGDarkLoadParam) {
+        if (m_darkLibrary.load(darkFile, fileError)) {
+          setStringParam(ADStatusMessage, "Loaded dark library");
+        } else {
+          status = asynError;
+        }
+      } else if (function == ADSBIGFlatClearParam) {
+        m_flatField.clear();
+        setStringParam(ADStatusMessage, "Cleared master flat");
+      } else if (function == ADSBIGFlatSaveParam) {
+        if (m_flatField.save(flatFile, fileError)) {
+          setStringParam(ADStatusMessage, "Saved master flat");
+        } else {
+          status = asynError;
+        }
+      } else if (m_flatField.load(flatFile, fileError)) {
+        setStringParam(ADStatusMessage, "Loaded master flat");
+      } else {
+        status = asynError;
+      }
+      if (status != asynSuccess) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                  "%s %s.\n", functionName, fileError.c_str());
+        setStringParam(ADStatusMessage, fileError.c_str());
+      }
+      updateDarkLibraryParams();
+      updateFlatFieldParams();
+    }
+    value = 0;
+  } else if (function == ADSBIGFlatNumFramesParam) {
+    if (value < 1) {
+      value = 1;
+    }
+  } else if (function == ADNumExposures) {
+    if (value < 1) {
+      value = 1;
+    }
+  } else if (function == ADSBIGDarkRefreshParam) {
+    if (value < 0) {
+      value = 0;
+    }
+  } else if (function == ADSBIGStatsSatLevelParam) {
+    //0 means use the level GrabSetup sets for the camera. Anything else
+    //overrides it at the start of each acquisition.
+    if (value < 0) {
+      value = 0;
+    } else if (value > 65535) {
+      value = 65535;
+    }
+  } else if (function == ADSBIGDarkNumFramesParam) {
+    if (value < 1) {
+      value = 1;
+    }
+  } else if (function == ADSBIGDarkPedestalParam) {
+    if (value < 0) {
+      value = 0;
+    } else if (value > 65535) {
+      value = 65535;
+    }
   } else if (function == ADMinX) {
-    if (value > ((m_CamWidth/binning) - 1)) {
-      value = (m_CamWidth/binning) - 1;
+    if (value > ((m_CamWidth/binX) - 1)) {
+      value = (m_CamWidth/binX) - 1;
     }
-    if ((value + sizeX) > (m_CamWidth/binning)) {
-      sizeX = m_CamWidth/binning - value;
+    if ((value + sizeX) > (m_CamWidth/binX)) {
+      sizeX = m_CamWidth/binX - value;
       setIntegerParam(ADSizeX, sizeX);
     }
   } else if (function == ADMinY) {
-    if (value > ((m_CamHeight/binning) - 1)) {
-      value = (m_CamHeight/binning) - 1;
+    if (value > ((m_CamHeight/binY) - 1)) {
+      value = (m_CamHeight/binY) - 1;
     }
-    if ((value + sizeY) > (m_CamHeight/binning)) {
-      sizeY = m_CamHeight/binning - value;
+    if ((value + sizeY) > (m_CamHeight/binY)) {
+      sizeY = m_CamHeight/binY - value;
       setIntegerParam(ADSizeY, sizeY);
     }
   } else if (function == ADSizeX) {
-    if ((minX + value) > (m_CamWidth/binning)) {
-      value = m_CamWidth/binning - minX;
+    if ((minX + value) > (m_CamWidth/binX)) {
+      value = m_CamWidth/binX - minX;
     }
   } else if (function == ADSizeY) {
-    if ((minY + value) > (m_CamHeight/binning)) {
-      value = m_CamHeight/binning - minY;
+    if ((minY + value) > (m_CamHeight/binY)) {
+      value = m_CamHeight/binY - minY;
     }
   }
 
@@ -373,10 +1219,33 @@ asynStatus ADSBIG::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
   
   asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Entry.\n", functionName);
 
-  if (function == ADAcquireTime) {
+  getAddress(pasynUser, &addr);
+  if (addr == ADSBIG_ADDR_TRACKING) {
+    //The other params of the tracking CCD are only stored. The cooler is set on address 0.
+    if ((function == ADAcquireTime) && (value > 0)) {
+      p_Track->SetExposureTime(value);
+    }
+  } else if (addr == ADSBIG_ADDR_PREVIEW) {
+    //Zero publishes a preview of every frame
+    if ((function == ADSBIGPreviewMaxRateParam) && (value < 0.0)) {
+      value = 0.0;
+    }
+  } else if (function == ADAcquireTime) {
     if (value > 0) {
       p_Cam->SetExposureTime(value);
     }
+  } else if ((function == ADSBIGTempPeriodParam) || (function == ADSBIGTEPeriodParam) ||
+             (function == ADSBIGProgressPeriodParam) || (function == ADSBIGLinkPeriodParam)) {
+    //Zero disables the item. The telemetry thread picks up the new period.
+    if (value < 0.0) {
+      value = 0.0;
+    }
+    if (function == ADSBIGTempPeriodParam) {
+      setTemperatureMaxAge(value);
+    } else if (function == ADSBIGProgressPeriodParam) {
+      m_progressPeriod = value;
+    }
+    epicsEventSignal(m_telemEvent);
   } else if (function == ADTemperature) {
     getIntegerParam(ADSBIGTEStatusParam, &te_status_param);
     if (te_status_param == 1) {
@@ -412,124 +1281,2258 @@ asynStatus ADSBIG::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
 }
 
 /**
- * Abort the current aqusition.
- * This uses a function I added to the SBIG class library
- * to make it possible to abort an active exposure. Otherwise
- * the class library blocks and ties up access to the SBIGUDrv.
- */
-void ADSBIG::abortExposure(void) 
-{
-  p_Cam->AbortExposure();
-  m_aborted = true;
-}
-
-
-/**
- * Readout thread function
+ * Write asyn integer values for the tracking CCD (asyn address 1). 
+ * The readout mode and subframe are used from the next acquisition.
+ * @param function The parameter index
+ * @param value The value to write
  */
-void ADSBIG::readoutTask(void)
+asynStatus ADSBIG::writeTrackingInt32(int function, epicsInt32 value)
 {
-  epicsEventWaitStatus eventStatus;
-  epicsFloat64 timeout = 0.001;
-  bool error = false;
-  size_t dims[2];
-  int nDims = 2;
-  epicsInt32 sizeX = 0;
-  epicsInt32 sizeY = 0;
-  epicsInt32 minX = 0;
-  epicsInt32 minY = 0;
-  NDDataType_t dataType;
-  epicsInt32 iDataType = 0;
-  epicsUInt32 dataSize = 0;
-  epicsTimeStamp nowTime;
-  NDArray *pArray = NULL;
-  epicsInt32 numImagesCounter = 0;
-  epicsInt32 imageCounter = 0;
-  PAR_ERROR cam_err = CE_NO_ERROR;
+  asynStatus status = asynSuccess;
+  const int addr = ADSBIG_ADDR_TRACKING;
+  int adStatus = 0;
+  int minX = 0;
+  int minY = 0;
+  int sizeX = 0;
+  int sizeY = 0;
+  int binX = 1;
+  int binY = 1;
+  const char *functionName = "ADSBIG::writeTrackingInt32";
 
-  const char* functionName = "ADSBIG::readoutTask";
-  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Readout Thread.\n", functionName);
+  getIntegerParam(addr, ADMinX, &minX);
+  getIntegerParam(addr, ADMinY, &minY);
+  getIntegerParam(addr, ADSizeX, &sizeX);
+  getIntegerParam(addr, ADSizeY, &sizeY);
+  getIntegerParam(addr, ADBinX, &binX);
+  getIntegerParam(addr, ADBinY, &binY);
+  if (binX < 1) {
+    binX = 1;
+  }
+  if (binY < 1) {
+    binY = 1;
+  }
 
-  while (1) {
+  getIntegerParam(addr, ADStatus, &adStatus);
 
-    //Wait for a stop event, with a short timeout, to catch any that were done after last one.
-    eventStatus = epicsEventWaitWithTimeout(m_stopEvent, timeout);          
-    if (eventStatus == epicsEventWaitOK) {
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Got Stop Event Before Start Event.\n", functionName);
+  if (function == ADAcquire) {
+    if ((value==1) && ((adStatus == ADStatusIdle) || (adStatus == ADStatusError) || (adStatus == ADStatusAborted))) {
+      if (m_TrackWidth == 0) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                  "%s This camera has no tracking CCD.\n", functionName);
+        setStringParam(addr, ADStatusMessage, "No tracking CCD");
+        status = asynError;
+      } else {
+        m_trackAborted = false;
+        setIntegerParam(addr, ADStatus, ADStatusAcquire);
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Start Event.\n", functionName);
+        epicsEventSignal(this->m_trackStartEvent);
+      }
     }
-
-    lock();
-    if (!error) {
-      setStringParam(ADStatusMessage, "Idle");
+    if ((value==0) && ((adStatus != ADStatusIdle) && (adStatus != ADStatusError) && (adStatus != ADStatusAborted))) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Abort Exposure.\n", functionName);
+      p_Track->AbortExposure();
+      m_trackAborted = true;
+      epicsEventSignal(this->m_trackStopEvent);
     }
-    callParamCallbacks();
-    unlock();
+  } else if ((function == ADSBIGReadoutModeParam) || (function == ADBinX) || (function == ADBinY)) {
+    status = setReadoutMode(addr, function, value);
+    getIntegerParam(addr, function, &value);
+  } else if (m_TrackWidth == 0) {
+    //Nothing to check the frame sizes against
+  } else if (function == ADMinX) {
+    if (value > ((m_TrackWidth/binX) - 1)) {
+      value = (m_TrackWidth/binX) - 1;
+    }
+    if ((value + sizeX) > (m_TrackWidth/binX)) {
+      setIntegerParam(addr, ADSizeX, m_TrackWidth/binX - value);
+    }
+  } else if (function == ADMinY) {
+    if (value > ((m_TrackHeight/binY) - 1)) {
+      value = (m_TrackHeight/binY) - 1;
+    }
+    if ((value + sizeY) > (m_TrackHeight/binY)) {
+      setIntegerParam(addr, ADSizeY, m_TrackHeight/binY - value);
+    }
+  } else if (function == ADSizeX) {
+    if ((minX + value) > (m_TrackWidth/binX)) {
+      value = m_TrackWidth/binX - minX;
+    }
+  } else if (function == ADSizeY) {
+    if ((minY + value) > (m_TrackHeight/binY)) {
+      value = m_TrackHeight/binY - minY;
+    }
+  }
 
-    eventStatus = epicsEventWait(m_startEvent);          
-    if (eventStatus == epicsEventWaitOK) {
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Got Start Event.\n", functionName);
-      error = false;
-      setStringParam(ADStatusMessage, " ");
-      lock();
-      setIntegerParam(ADNumImagesCounter, 0);
-      setIntegerParam(ADNumExposuresCounter, 0);
+  if (status != asynSuccess) {
+    callParamCallbacks(addr);
+    return asynError;
+  }
 
-      //Sanity checks
-      if ((p_Cam == NULL) || (p_Img == NULL)) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s NULL pointer.\n", functionName);
-        break;
-      }
+  status = (asynStatus) setIntegerParam(addr, function, value);
+  if (status!=asynSuccess) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Error Setting Parameter. Asyn addr: %d, asynUser->reason: %d, value: %d\n", 
+              functionName, addr, function, value);
+    return(status);
+  }
 
-      //printf("%s Time before acqusition: ", functionName);
-      //epicsTime::getCurrent().show(0);
+  callParamCallbacks(addr);
 
-      //Read the frame sizes 
-      getIntegerParam(ADMinX, &minX);
-      getIntegerParam(ADMinY, &minY);
-      getIntegerParam(ADSizeX, &sizeX);
-      getIntegerParam(ADSizeY, &sizeY);
-      p_Cam->SetSubFrame(minX, minY, sizeX, sizeY);
+  return status;
+}
 
-      //Read what type of image we want - light field or dark field?
-      int darkField = 0;
-      getIntegerParam(ADSBIGDarkFieldParam, &darkField);
+/**
+ * Change the readout mode or the binning of a CCD. The other is changed to match: 
+ * writing the binning picks the readout mode that does it on the chip, and writing
+ * the readout mode sets the binning it fixes. Changing either resets the frame 
+ * to the full frame at the new binning.
+ * @param addr The asyn address of the CCD
+ * @param function ADSBIGReadoutModeParam, ADBinX or ADBinY
+ * @param value The value to write
+ * @return asynError if the CCD does not have the readout mode or cannot do the binning
+ */
+asynStatus ADSBIG::setReadoutMode(int addr, int function, epicsInt32 value)
+{
+  const ADSBIGReadoutModes &modes = m_readoutModes[addr];
+  int mode = 0;
+  int binX = 1;
+  int binY = 1;
+  int width = (addr == ADSBIG_ADDR_TRACKING) ? m_TrackWidth : m_CamWidth;
+  int height = (addr == ADSBIG_ADDR_TRACKING) ? m_TrackHeight : m_CamHeight;
+  const char *functionName = "ADSBIG::setReadoutMode";
 
-      if (darkField > 0) {
-        cam_err = p_Cam->GrabSetup(p_Img, SBDF_DARK_ONLY);
-      } else {
-        cam_err = p_Cam->GrabSetup(p_Img, SBDF_LIGHT_ONLY);
-      }
-      if (cam_err != CE_NO_ERROR) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+  if (modes.numModes() == 0) {
+    //Nothing to check the readout mode against
+    setIntegerParam(addr, function, value);
+    return asynSuccess;
+  }
+
+  getIntegerParam(addr, ADSBIGReadoutModeParam, &mode);
+  getIntegerParam(addr, ADBinX, &binX);
+  getIntegerParam(addr, ADBinY, &binY);
+  if (function == ADSBIGReadoutModeParam) {
+    if (!modes.binning(value, binX, binY)) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s This CCD does not have readout mode %d. It has: %s\n", 
+                functionName, value, modes.names().c_str());
+      return asynError;
+    }
+    mode = value;
+  } else {
+    if (function == ADBinX) {
+      binX = value;
+    } else {
+      binY = value;
+    }
+    mode = modes.find(binX, binY, mode);
+    if (mode < 0) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s This CCD has no readout mode for %dx%d binning. It has: %s\n", 
+                functionName, binX, binY, modes.names().c_str());
+      return asynError;
+    }
+  }
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s Readout mode %d, binning %dx%d, SBIG readout mode 0x%04X.\n", 
+            functionName, mode, binX, binY, modes.sbigMode(mode, binX, binY));
+
+  //The subframe has to be set after the binning, so start again from the full frame.
+  if (addr == ADSBIG_ADDR_IMAGING) {
+    p_Cam->SetReadoutMode(static_cast<unsigned short>(modes.sbigMode(mode, binX, binY)));
+    p_Cam->SetSubFrame(0, 0, width/binX, height/binY);
+  }
+  setIntegerParam(addr, ADSBIGReadoutModeParam, mode);
+  setIntegerParam(addr, ADBinX, binX);
+  setIntegerParam(addr, ADBinY, binY);
+  setIntegerParam(addr, ADMinX, 0);
+  setIntegerParam(addr, ADMinY, 0);
+  setIntegerParam(addr, ADSizeX, width/binX);
+  setIntegerParam(addr, ADSizeY, height/binY);
+  setDoubleParam(addr, ADSBIGReadoutFullTimeParam, modes.fullFrameTime(modes.sbigMode(mode, binX, binY)) * 1000.0);
+  setDoubleParam(addr, ADSBIGReadoutReductionParam, modes.reduction(mode, binX, binY));
+  return asynSuccess;
+}
+
+/**
+ * The SBIG readout mode (with the vertical binning in the high byte) 
+ * for the readout mode and binning params of a CCD.
+ */
+int ADSBIG::sbigReadoutMode(int addr)
+{
+  int mode = 0;
+  int binX = 1;
+  int binY = 1;
+
+  getIntegerParam(addr, ADSBIGReadoutModeParam, &mode);
+  getIntegerParam(addr, ADBinX, &binX);
+  getIntegerParam(addr, ADBinY, &binY);
+  return m_readoutModes[addr].sbigMode(mode, binX, binY);
+}
+
+/**
+ * Add the readout time of a frame to the readout time of its readout mode,
+ * and update the full frame readout time and its reduction from 1x1.
+ * @param addr The asyn address of the CCD
+ * @param sbigMode The SBIG readout mode the frame was read out in
+ * @param seconds The time taken to read out the frame
+ * @param pixels The number of pixels read out
+ */
+void ADSBIG::addReadoutTime(int addr, int sbigMode, double seconds, double pixels)
+{
+  ADSBIGReadoutModes &modes = m_readoutModes[addr];
+  int mode = sbigMode & 0xFF;
+  int binX = sbigMode >> 8;
+  int binY = binX;
+  int width = (addr == ADSBIG_ADDR_TRACKING) ? m_TrackWidth : m_CamWidth;
+  int height = (addr == ADSBIG_ADDR_TRACKING) ? m_TrackHeight : m_CamHeight;
+
+  if (!modes.binning(mode, binX, binY)) {
+    return;
+  }
+  modes.addReadout(sbigMode, seconds, pixels, static_cast<double>(width/binX) * (height/binY));
+  setDoubleParam(addr, ADSBIGReadoutFullTimeParam, modes.fullFrameTime(sbigMode) * 1000.0);
+  setDoubleParam(addr, ADSBIGReadoutReductionParam, modes.reduction(mode, binX, binY));
+}
+
+/**
+ * readInt32Array. Read the timing histograms and the pixel histogram.
+ */
+asynStatus ADSBIG::readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn)
+{
+  int function = pasynUser->reason;
+
+  if (function == ADSBIGStatsHistParam) {
+    *nIn = std::min(nElements, m_statsHist.size());
+    std::copy(m_statsHist.begin(), m_statsHist.begin() + *nIn, value);
+    return asynSuccess;
+  }
+
+  for (int stage=0; stage<ADSBIG_NUM_STAGES; ++stage) {
+    if (function == m_timing[stage].histParam) {
+      *nIn = std::min(nElements, m_timing[stage].hist.size());
+      std::copy(m_timing[stage].hist.begin(), m_timing[stage].hist.begin() + *nIn, value);
+      return asynSuccess;
+    }
+  }
+
+  return ADDriver::readInt32Array(pasynUser, value, nElements, nIn);
+}
+
+/**
+ * readFloat64Array. Read the timing histogram bins.
+ */
+asynStatus ADSBIG::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn)
+{
+  int function = pasynUser->reason;
+
+  if (function == ADSBIGTimeHistBinsParam) {
+    *nIn = std::min(nElements, m_timingBins.size());
+    std::copy(m_timingBins.begin(), m_timingBins.begin() + *nIn, value);
+    return asynSuccess;
+  }
+
+  return ADDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+}
+
+/**
+ * Add a sample to the timing statistics of a stage, and update the last,
+ * mean and p99 params and the histogram. The mean and p99 are over the 
+ * most recent ADSBIG_TIMING_WINDOW samples. This must be called with the 
+ * driver lock held.
+ * @param stage One of the ADSBIG_STAGE_ values
+ * @param seconds The time taken by the stage
+ */
+void ADSBIG::recordTiming(int stage, double seconds)
+{
+  ADSBIGTimingStat *pStat = &m_timing[stage];
+  double ms = seconds * 1000.0;
+  double sum = 0.0;
+  int bin = 0;
+
+  if (pStat->window.size() < ADSBIG_TIMING_WINDOW) {
+    pStat->window.push_back(ms);
+  } else {
+    pStat->window[pStat->next] = ms;
+  }
+  pStat->next = (pStat->next + 1) % ADSBIG_TIMING_WINDOW;
+
+  m_timingSorted.assign(pStat->window.begin(), pStat->window.end());
+  for (size_t i=0; i<m_timingSorted.size(); ++i) {
+    sum += m_timingSorted[i];
+  }
+  size_t p99Index = (m_timingSorted.size() * 99) / 100;
+  std::nth_element(m_timingSorted.begin(), m_timingSorted.begin() + p99Index, m_timingSorted.end());
+
+  if (ms > ADSBIG_TIMING_BIN_MIN) {
+    bin = static_cast<int>(floor(log10(ms / ADSBIG_TIMING_BIN_MIN) * ADSBIG_TIMING_BINS_PER_DECADE));
+    if (bin >= ADSBIG_TIMING_BINS) {
+      bin = ADSBIG_TIMING_BINS - 1;
+    }
+  }
+  pStat->hist[bin]++;
+
+  setDoubleParam(pStat->lastParam, ms);
+  setDoubleParam(pStat->meanParam, sum / m_timingSorted.size());
+  setDoubleParam(pStat->p99Param, m_timingSorted[p99Index]);
+  doCallbacksInt32Array(&pStat->hist[0], pStat->hist.size(), pStat->histParam, 0);
+}
+
+/**
+ * Clear the timing statistics for all the stages.
+ */
+void ADSBIG::resetTiming(void)
+{
+  for (int stage=0; stage<ADSBIG_NUM_STAGES; ++stage) {
+    m_timing[stage].window.clear();
+    m_timing[stage].window.reserve(ADSBIG_TIMING_WINDOW);
+    m_timing[stage].next = 0;
+    m_timing[stage].hist.assign(ADSBIG_TIMING_BINS, 0);
+    setDoubleParam(m_timing[stage].lastParam, 0.0);
+    setDoubleParam(m_timing[stage].meanParam, 0.0);
+    setDoubleParam(m_timing[stage].p99Param, 0.0);
+    doCallbacksInt32Array(&m_timing[stage].hist[0], m_timing[stage].hist.size(), m_timing[stage].histParam, 0);
+  }
+  m_expJitter.reset();
+  m_periodJitter.reset();
+  setDoubleParam(ADSBIGExpJitterMeanParam, 0.0);
+  setDoubleParam(ADSBIGExpJitterSigmaParam, 0.0);
+  setDoubleParam(ADSBIGExpJitterMaxParam, 0.0);
+  setDoubleParam(ADSBIGStartPeriodMeanParam, 0.0);
+  setDoubleParam(ADSBIGStartPeriodSigmaParam, 0.0);
+  setDoubleParam(ADSBIGStartPeriodMaxParam, 0.0);
+}
+
+/**
+ * The middle of the last exposure taken by a CSBIGCam, from its grab times.
+ * @param times The grab times of the camera
+ * @param midTime Returns the middle of the exposure
+ */
+static void grabMidpoint(const GRAB_TIMES &times, epicsTimeStamp &midTime)
+{
+  epicsTimeStamp exposureEnd;
+
+  epicsTimeFromTimespec(&midTime, &times.exposureStart);
+  epicsTimeFromTimespec(&exposureEnd, &times.exposureEnd);
+  epicsTimeAddSeconds(&midTime, epicsTimeDiffInSeconds(&exposureEnd, &midTime) / 2.0);
+}
+
+/**
+ * Add the wall clock times of the exposure just taken by GrabMain to those
+ * of the frame, and the difference between its actual and requested
+ * exposure time to the jitter statistics. The exposure runs from the
+ * middle of the start exposure command to when the exposure was seen to
+ * be complete. If the camera's microsecond timer was read, the exposure
+ * time it counted is added up as well.
+ * This must be called with the driver locked.
+ * @param exposure The number of the exposure in the frame (0 for the first)
+ * @param acquireTime The requested exposure time (in s)
+ */
+void ADSBIG::addGrabTimes(int exposure, double acquireTime)
+{
+  const GRAB_TIMES &times = p_Cam->GetGrabTimes();
+  epicsTimeStamp exposureStart;
+  double actual = 0.0;
+  double camera = 0.0;
+
+  epicsTimeFromTimespec(&exposureStart, &times.exposureStart);
+  epicsTimeFromTimespec(&m_exposureEnd, &times.exposureEnd);
+  epicsTimeFromTimespec(&m_readoutStart, &times.readoutStart);
+  epicsTimeFromTimespec(&m_readoutEnd, &times.readoutEnd);
+  if (exposure == 0) {
+    m_exposureStart = exposureStart;
+    m_cameraExposure = 0.0;
+    m_cameraExposureValid = true;
+  }
+  actual = epicsTimeDiffInSeconds(&m_exposureEnd, &exposureStart);
+  m_expJitter.add((actual - acquireTime) * 1000.0);
+
+  //The timer counts in microseconds and wraps at 32 bits
+  if (times.usTimerValid) {
+    camera = static_cast<epicsUInt32>(times.usTimerEnd - times.usTimerStart) / 1.e6;
+    m_cameraExposure += camera;
+  } else {
+    m_cameraExposureValid = false;
+  }
+
+  setDoubleParam(ADSBIGExpActualParam, actual * 1000.0);
+  setDoubleParam(ADSBIGExpCameraParam, times.usTimerValid ? camera * 1000.0 : 0.0);
+  setDoubleParam(ADSBIGExpJitterMeanParam, m_expJitter.mean());
+  setDoubleParam(ADSBIGExpJitterSigmaParam, m_expJitter.sigma());
+  setDoubleParam(ADSBIGExpJitterMaxParam, m_expJitter.maxAbs());
+}
+
+/**
+ * Attach the wall clock times of the frame to its NDArray, as seconds past
+ * the EPICS epoch, and update the start to start period statistics.
+ * The frame is time stamped with the middle of its exposures.
+ * This must be called with the driver locked.
+ * @param pArray The frame (may be NULL)
+ * @param midTime Returns the middle of the exposures
+ */
+void ADSBIG::publishGrabTimes(NDArray *pArray, epicsTimeStamp &midTime)
+{
+  epicsFloat64 exposureStart = m_exposureStart.secPastEpoch + m_exposureStart.nsec / 1.e9;
+  epicsFloat64 exposureEnd = m_exposureEnd.secPastEpoch + m_exposureEnd.nsec / 1.e9;
+  epicsFloat64 readoutStart = m_readoutStart.secPastEpoch + m_readoutStart.nsec / 1.e9;
+  epicsFloat64 readoutEnd = m_readoutEnd.secPastEpoch + m_readoutEnd.nsec / 1.e9;
+  epicsFloat64 midpoint = 0.0;
+  epicsFloat64 period = 0.0;
+
+  midTime = m_exposureStart;
+  epicsTimeAddSeconds(&midTime, epicsTimeDiffInSeconds(&m_exposureEnd, &m_exposureStart) / 2.0);
+  midpoint = midTime.secPastEpoch + midTime.nsec / 1.e9;
+
+  if (m_haveLastStart) {
+    period = epicsTimeDiffInSeconds(&m_exposureStart, &m_lastExposureStart) * 1000.0;
+    m_periodJitter.add(period);
+    setDoubleParam(ADSBIGStartPeriodParam, period);
+    setDoubleParam(ADSBIGStartPeriodMeanParam, m_periodJitter.mean());
+    setDoubleParam(ADSBIGStartPeriodSigmaParam, m_periodJitter.sigma());
+    setDoubleParam(ADSBIGStartPeriodMaxParam, m_periodJitter.maxAbs());
+  }
+  m_lastExposureStart = m_exposureStart;
+  m_haveLastStart = true;
+  //DATE-OBS and the spool use the start of the first exposure
+  m_frameStartTime = m_exposureStart;
+
+  if (pArray == NULL) {
+    return;
+  }
+  pArray->pAttributeList->add("ExposureStart", "Start of the exposure (s past the EPICS epoch)", NDAttrFloat64, &exposureStart);
+  pArray->pAttributeList->add("ExposureEnd", "End of the exposure (s past the EPICS epoch)", NDAttrFloat64, &exposureEnd);
+  pArray->pAttributeList->add("ExposureMidpoint", "Middle of the exposure (s past the EPICS epoch)", NDAttrFloat64, &midpoint);
+  pArray->pAttributeList->add("ReadoutStart", "Start of the readout (s past the EPICS epoch)", NDAttrFloat64, &readoutStart);
+  pArray->pAttributeList->add("ReadoutEnd", "End of the readout (s past the EPICS epoch)", NDAttrFloat64, &readoutEnd);
+  if (m_cameraExposureValid) {
+    epicsFloat64 cameraExposure = m_cameraExposure;
+    pArray->pAttributeList->add("CameraExposure", "Exposure time counted by the camera (s)", NDAttrFloat64, &cameraExposure);
+  }
+}
+
+/**
+ * Make the dark library key for the current exposure time, readout
+ * mode, subframe and CCD temperature.
+ */
+ADSBIGDarkKey ADSBIG::darkKey(void)
+{
+  epicsFloat64 acquireTime = 0.0;
+  epicsFloat64 temperature = 0.0;
+  epicsFloat64 tempBucket = 0.0;
+  epicsInt32 readoutMode = 0;
+  epicsInt32 minX = 0;
+  epicsInt32 minY = 0;
+  epicsInt32 sizeX = 0;
+  epicsInt32 sizeY = 0;
+
+  getDoubleParam(ADAcquireTime, &acquireTime);
+  getDoubleParam(ADTemperatureActual, &temperature);
+  getDoubleParam(ADSBIGDarkTempBucketParam, &tempBucket);
+  readoutMode = sbigReadoutMode(ADSBIG_ADDR_IMAGING);
+  getIntegerParam(ADMinX, &minX);
+  getIntegerParam(ADMinY, &minY);
+  getIntegerParam(ADSizeX, &sizeX);
+  getIntegerParam(ADSizeY, &sizeY);
+
+  return ADSBIGDarkLibrary::makeKey(acquireTime, readoutMode, minX, minY, sizeX, sizeY, 
+                                    temperature, tempBucket);
+}
+
+/**
+ * Take a number of frames with the current settings and average them.
+ * This is run on the readout thread with the driver lock held (which is
+ * released during each readout).
+ * @param dark SBDF_DARK_ONLY for dark frames, or SBDF_LIGHT_ONLY for light frames
+ * @param numFrames The number of frames to average
+ * @param pDark A master dark to subtract from each frame (NULL for none)
+ * @param pedestal The pedestal added when subtracting the master dark
+ * @param framesDoneParam The param to update with the number of frames taken
+ * @param average Set to the average of the frames, rounded to the nearest count
+ * @return false if there was an error or the acquisition was aborted
+ */
+bool ADSBIG::grabAverage(SBIG_DARK_FRAME dark, int numFrames, const epicsUInt16 *pDark, 
+                         epicsUInt16 pedestal, int framesDoneParam, std::vector<epicsUInt16> &average)
+{
+  epicsInt32 minX = 0;
+  epicsInt32 minY = 0;
+  epicsInt32 sizeX = 0;
+  epicsInt32 sizeY = 0;
+  epicsInt32 frame = 0;
+  PAR_ERROR cam_err = CE_NO_ERROR;
+  const char* functionName = "ADSBIG::grabAverage";
+
+  getIntegerParam(ADMinX, &minX);
+  getIntegerParam(ADMinY, &minY);
+  getIntegerParam(ADSizeX, &sizeX);
+  getIntegerParam(ADSizeY, &sizeY);
+
+  setIntegerParam(framesDoneParam, 0);
+  p_Cam->SetSubFrame(minX, minY, sizeX, sizeY);
+  cam_err = p_Cam->GrabSetup(p_Img, dark);
+
+  size_t nPixels = static_cast<size_t>(sizeX) * sizeY;
+  if ((cam_err == CE_NO_ERROR) && (static_cast<size_t>(p_Img->GetWidth()) * p_Img->GetHeight() != nPixels)) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Image size does not match the subframe.\n", functionName);
+    setStringParam(ADStatusMessage, "Image size error");
+    setIntegerParam(ADStatus, ADStatusError);
+    return false;
+  }
+  std::vector<epicsUInt32> sum(nPixels, 0);
+
+  while ((cam_err == CE_NO_ERROR) && (frame < numFrames)) {
+    setIntegerParam(ADStatus, ADStatusAcquire);
+    setDoubleParam(ADSBIGPercentCompleteParam, 0.0);
+    callParamCallbacks();
+    unlock();
+    cam_err = p_Cam->GrabMain(p_Img, dark);
+    lock();
+    if ((cam_err != CE_NO_ERROR) || m_aborted) {
+      break;
+    }
+    if (pDark != NULL) {
+      CSBIGImg::DarkSubtractPixels(p_Img->GetImagePointer(), pDark, static_cast<long>(nPixels), pedestal);
+    }
+    const unsigned short *pFrame = p_Img->GetImagePointer();
+    for (size_t i=0; i<nPixels; ++i) {
+      sum[i] += pFrame[i];
+    }
+    setIntegerParam(framesDoneParam, ++frame);
+  }
+  setDoubleParam(ADSBIGPercentCompleteParam, 100.0);
+
+  if (m_aborted) {
+    setStringParam(ADStatusMessage, "Aborted");
+    setIntegerParam(ADStatus, ADStatusAborted);
+    return false;
+  }
+  if (cam_err != CE_NO_ERROR) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s. CSBIGCam returned an error. %s\n", 
+              functionName, p_Cam->GetErrorString(cam_err).c_str());
+    setStringParam(ADStatusMessage, p_Cam->GetErrorString(cam_err).c_str());
+    setIntegerParam(ADStatus, ADStatusError);
+    return false;
+  }
+
+  average.resize(nPixels);
+  for (size_t i=0; i<nPixels; ++i) {
+    average[i] = static_cast<epicsUInt16>((sum[i] + numFrames/2) / numFrames);
+  }
+  return true;
+}
+
+/**
+ * Build a master dark for the current settings by averaging 
+ * ADSBIGDarkNumFrames dark frames, and add it to the dark library.
+ * This is run on the readout thread with the driver lock held.
+ * @return false if there was an error or the build was aborted
+ */
+bool ADSBIG::buildMasterDark(void)
+{
+  epicsInt32 numFrames = 0;
+  std::vector<epicsUInt16> master;
+  const char* functionName = "ADSBIG::buildMasterDark";
+
+  getIntegerParam(ADSBIGDarkNumFramesParam, &numFrames);
+  //The key is taken at the start, so it has the temperature the darks were taken at.
+  ADSBIGDarkKey key = darkKey();
+
+  setStringParam(ADStatusMessage, "Building master dark");
+  if (!grabAverage(SBDF_DARK_ONLY, numFrames, NULL, 0, ADSBIGDarkFramesDoneParam, master)) {
+    return false;
+  }
+  m_darkLibrary.add(key, master);
+  updateDarkLibraryParams();
+
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s Added master dark of %d frames. Exposure: %d, Mode: %d, Size: %dx%d, Temp bucket: %d\n", 
+            functionName, numFrames, key.exposure, key.readoutMode, key.sizeX, key.sizeY, key.tempBucket);
+  setStringParam(ADStatusMessage, "Master dark complete");
+  setIntegerParam(ADStatus, ADStatusIdle);
+  return true;
+}
+
+/**
+ * Build a master flat for the current readout mode and subframe by 
+ * averaging ADSBIGFlatNumFrames light frames of an evenly illuminated 
+ * target. If dark subtraction is enabled and there is a matching master
+ * dark, it is subtracted from each frame first.
+ * This is run on the readout thread with the driver lock held.
+ * @return false if there was an error or the build was aborted
+ */
+bool ADSBIG::buildMasterFlat(void)
+{
+  epicsInt32 numFrames = 0;
+  epicsInt32 readoutMode = 0;
+  epicsInt32 minX = 0;
+  epicsInt32 minY = 0;
+  epicsInt32 sizeX = 0;
+  epicsInt32 sizeY = 0;
+  epicsInt32 darkSubtract = 0;
+  epicsInt32 darkPedestal = 0;
+  const epicsUInt16 *pDark = NULL;
+  std::vector<epicsUInt16> master;
+  const char* functionName = "ADSBIG::buildMasterFlat";
+
+  getIntegerParam(ADSBIGFlatNumFramesParam, &numFrames);
+  readoutMode = sbigReadoutMode(ADSBIG_ADDR_IMAGING);
+  getIntegerParam(ADMinX, &minX);
+  getIntegerParam(ADMinY, &minY);
+  getIntegerParam(ADSizeX, &sizeX);
+  getIntegerParam(ADSizeY, &sizeY);
+  getIntegerParam(ADSBIGDarkSubtractParam, &darkSubtract);
+  if (darkSubtract != 0) {
+    pDark = m_darkLibrary.find(darkKey());
+    if (pDark != NULL) {
+      getIntegerParam(ADSBIGDarkPedestalParam, &darkPedestal);
+    }
+  }
+
+  setStringParam(ADStatusMessage, "Building master flat");
+  if (!grabAverage(SBDF_LIGHT_ONLY, numFrames, pDark, static_cast<epicsUInt16>(darkPedestal), 
+                   ADSBIGFlatFramesDoneParam, master)) {
+    return false;
+  }
+  m_flatField.set(readoutMode, minX, minY, sizeX, sizeY, static_cast<epicsUInt16>(darkPedestal), master);
+  updateFlatFieldParams();
+
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s Built master flat of %d frames. Dark subtracted: %d, Mean: %f\n", 
+            functionName, numFrames, (pDark != NULL), m_flatField.mean());
+  setStringParam(ADStatusMessage, "Master flat complete");
+  setIntegerParam(ADStatus, ADStatusIdle);
+  return true;
+}
+
+/**
+ * Update the params that describe the contents of the dark library.
+ */
+void ADSBIG::updateDarkLibraryParams(void)
+{
+  setIntegerParam(ADSBIGDarkCountParam, static_cast<epicsInt32>(m_darkLibrary.size()));
+  setDoubleParam(ADSBIGDarkMemoryParam, m_darkLibrary.bytes() / 1048576.0);
+}
+
+/**
+ * Update the params that describe the master flat.
+ */
+void ADSBIG::updateFlatFieldParams(void)
+{
+  setIntegerParam(ADSBIGFlatValidParam, m_flatField.valid() ? 1 : 0);
+  setDoubleParam(ADSBIGFlatMeanParam, m_flatField.mean());
+}
+
+/**
+ * Abort the current aqusition.
+ * This uses a function I added to the SBIG class library
+ * to make it possible to abort an active exposure. Otherwise
+ * the class library blocks and ties up access to the SBIGUDrv.
+ */
+void ADSBIG::abortExposure(void) 
+{
+  p_Cam->AbortExposure();
+  m_aborted = true;
+  //Wake up the readout thread if it is waiting for the next acquire period.
+  epicsEventSignal(this->m_stopEvent);
+}
+
+
+/**
+ * Called by the class library, from the readout thread, to sleep while
+ * waiting for an exposure to complete. abortExposure signals the stop
+ * event so this returns as soon as the exposure is aborted.
+ * @param seconds The maximum time to sleep
+ */
+void ADSBIG::exposureWait(double seconds)
+{
+  epicsEventWaitWithTimeout(m_stopEvent, seconds);
+}
+
+/**
+ * Set up the band processing for the next frame. In streaming mode the
+ * class library calls back after each line so that the band thread can
+ * process completed bands of lines while the rest of the frame is being
+ * read out. Otherwise the whole frame is processed in finishBands.
+ * @param pSrc The buffer the lines are read into
+ * @param pArray The output NDArray (can be NULL if there is no output)
+ * @param width The number of pixels in a line
+ * @param height The number of lines
+ * @param bandLines The number of lines in each band
+ * @param streaming Set to true to process bands during the readout
+ */
+void ADSBIG::startBands(unsigned short *pSrc, NDArray *pArray, int width, int height, int bandLines, bool streaming)
+{
+  m_pBandSrc = pSrc;
+  m_pBandArray = pArray;
+  m_bandWidth = width;
+  m_bandHeight = height;
+  m_bandLines = (bandLines > 0) ? bandLines : height;
+  m_bandStreaming = streaming;
+  m_bandCancel = false;
+  m_bandLinesDone = 0;
+  m_bandLatencySum = 0.0;
+  m_bandLatencyMax = 0.0;
+  m_bandProcTime = 0.0;
+  m_bandTailTime = 0.0;
+  m_bandCount = 0;
+  m_bandFlatTime = 0.0;
+  m_bandReadyTime.resize((height / m_bandLines) + 1);
+  epicsAtomicSetIntT(&m_bandLinesRead, 0);
+  epicsAtomicSetIntT(&m_progressPercent, 0);
+  epicsAtomicSetIntT(&m_progressPending, 0);
+
+  if (m_bandStreaming) {
+    //Clear any stale signals from the last frame before we activate
+    epicsEventTryWait(m_bandDoneEvent);
+    m_bandActive = true;
+  }
+  //The line callback also pushes the readout progress, so it is used in both modes
+  p_Cam->SetLineCallback(ADSBIGLineCallbackC, this);
+}
+
+/**
+ * Complete the band processing for the current frame. In streaming mode
+ * this waits for the band thread to process the remaining lines.
+ * @param cancel Set to true if the readout did not complete (error or abort),
+ * in which case no more bands are processed.
+ */
+void ADSBIG::finishBands(bool cancel)
+{
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+
+  p_Cam->SetLineCallback(NULL, NULL);
+  if (m_bandStreaming) {
+    if (cancel) {
+      m_bandCancel = true;
+      epicsEventSignal(m_bandEvent);
+    }
+    epicsEventWait(m_bandDoneEvent);
+  } else if (!cancel) {
+    epicsTimeGetCurrent(&startTime);
+    processBand(0, m_bandHeight);
+    epicsTimeGetCurrent(&endTime);
+    m_bandProcTime = epicsTimeDiffInSeconds(&endTime, &startTime);
+    m_bandTailTime = m_bandProcTime;
+    m_bandLatencySum = m_bandProcTime;
+    m_bandLatencyMax = m_bandProcTime;
+    m_bandCount = 1;
+  }
+}
+
+/**
+ * Called by the class library, from the readout thread, after each 
+ * line has been read out. In streaming mode this signals the band thread
+ * each time a band of lines is complete. It also pushes the readout 
+ * progress to the telemetry thread, at most once per progress period.
+ * @param line The line number that has just been read
+ */
+void ADSBIG::lineReady(int line)
+{
+  int linesRead = line + 1;
+  epicsTimeStamp now;
+
+  if (m_bandStreaming && (((linesRead % m_bandLines) == 0) || (linesRead == m_bandHeight))) {
+    epicsTimeGetCurrent(&m_bandReadyTime[line / m_bandLines]);
+    epicsAtomicSetIntT(&m_bandLinesRead, linesRead);
+    epicsEventSignal(m_bandEvent);
+  }
+
+  if (m_progressPeriod > 0.0) {
+    epicsTimeGetCurrent(&now);
+    if ((linesRead == 1) || (linesRead == m_bandHeight) || 
+        (epicsTimeDiffInSeconds(&now, &m_progressTime) >= m_progressPeriod)) {
+      m_progressTime = now;
+      epicsAtomicSetIntT(&m_progressPercent, static_cast<int>((10000.0 * linesRead) / m_bandHeight));
+      epicsAtomicSetIntT(&m_progressPending, 1);
+      epicsEventSignal(m_telemEvent);
+    }
+  }
+}
+
+/**
+ * Driver side processing of a band of lines. This is run either on the
+ * band thread while the rest of the frame is read out, or on the
+ * readout thread after the readout has finished.
+ * @param firstLine The first line in the band
+ * @param numLines The number of lines in the band
+ */
+void ADSBIG::processBand(int firstLine, int numLines)
+{
+  size_t offset = static_cast<size_t>(firstLine) * m_bandWidth;
+  size_t nPixels = static_cast<size_t>(numLines) * m_bandWidth;
+
+  //Statistics of the raw pixels, while the band is still in the cache.
+  if (m_bandStats) {
+    m_stats.accumulate(m_pBandSrc + offset, nPixels);
+  }
+
+  if ((m_pBandArray == NULL) && !m_bandPreview) {
+    return;
+  }
+
+  //Subtract the master dark in place, before any conversion.
+  if (m_pBandDark != NULL) {
+    CSBIGImg::DarkSubtractPixels(m_pBandSrc + offset, m_pBandDark + offset, 
+                                 static_cast<long>(nPixels), m_bandDarkPedestal);
+  }
+
+  //The preview is built from the dark subtracted band, before the flat field.
+  if (m_bandPreview) {
+    epicsTimeStamp startTime;
+    epicsTimeStamp endTime;
+    epicsTimeGetCurrent(&startTime);
+    m_preview.addRows(m_pBandSrc, firstLine, numLines);
+    epicsTimeGetCurrent(&endTime);
+    m_bandPreviewTime += epicsTimeDiffInSeconds(&endTime, &startTime);
+  }
+
+  if (m_pBandArray == NULL) {
+    return;
+  }
+
+  //Flat field. For Float32 this is done straight into the NDArray (and scaled 
+  //to electrons in the same pass), otherwise in place.
+  if (m_pBandGain != NULL) {
+    epicsTimeStamp startTime;
+    epicsTimeStamp endTime;
+    epicsFloat32 scale = (m_bandElectrons > 0.0f) ? m_bandElectrons : 1.0f;
+    epicsTimeGetCurrent(&startTime);
+    if ((m_pBandArray->dataType == NDFloat32) && m_bandAccumulate) {
+      ADSBIGFlatField::accumulateFloat32(m_pBandSrc + offset, m_pBandGain + offset, 
+                                         static_cast<epicsFloat32 *>(m_pBandArray->pData) + offset, 
+                                         nPixels, m_bandDarkPedestal, scale);
+    } else if (m_pBandArray->dataType == NDFloat32) {
+      ADSBIGFlatField::applyFloat32(m_pBandSrc + offset, m_pBandGain + offset, 
+                                    static_cast<epicsFloat32 *>(m_pBandArray->pData) + offset, 
+                                    nPixels, m_bandDarkPedestal, scale);
+    } else {
+      ADSBIGFlatField::applyUInt16(m_pBandSrc + offset, m_pBandGain + offset, nPixels, m_bandDarkPedestal);
+    }
+    epicsTimeGetCurrent(&endTime);
+    m_bandFlatTime += epicsTimeDiffInSeconds(&endTime, &startTime);
+    if (m_pBandArray->dataType == NDFloat32) {
+      return;
+    }
+  }
+
+  if (m_pBandArray->pData == m_pBandSrc) {
+    return;
+  }
+
+  //Convert from the class library buffer into the output NDArray, 
+  //or add to it for the second and later co-added exposures.
+  const epicsUInt16 *pIn = m_pBandSrc + offset;
+  if (m_bandAccumulate) {
+    if (m_pBandArray->dataType == NDUInt32) {
+      accumulateBand(pIn, static_cast<epicsUInt32 *>(m_pBandArray->pData) + offset, nPixels);
+    } else if (m_pBandArray->dataType == NDInt32) {
+      accumulateBand(pIn, static_cast<epicsInt32 *>(m_pBandArray->pData) + offset, nPixels);
+    } else if ((m_pBandArray->dataType == NDFloat32) && (m_bandElectrons > 0.0f)) {
+      ADSBIGConvert::addFloat32(pIn, static_cast<epicsFloat32 *>(m_pBandArray->pData) + offset, 
+                                nPixels, m_bandDarkPedestal, m_bandElectrons);
+    } else if (m_pBandArray->dataType == NDFloat32) {
+      accumulateBand(pIn, static_cast<epicsFloat32 *>(m_pBandArray->pData) + offset, nPixels);
+    }
+    return;
+  }
+  switch (m_pBandArray->dataType) {
+    case NDUInt8:
+      ADSBIGConvert::toUInt8(pIn, static_cast<epicsUInt8 *>(m_pBandArray->pData) + offset, 
+                             nPixels, m_bandBlack, m_bandWhite);
+      break;
+    case NDUInt16:
+      convertBand(pIn, static_cast<epicsUInt16 *>(m_pBandArray->pData) + offset, nPixels);
+      break;
+    case NDUInt32:
+      convertBand(pIn, static_cast<epicsUInt32 *>(m_pBandArray->pData) + offset, nPixels);
+      break;
+    case NDInt32:
+      convertBand(pIn, static_cast<epicsInt32 *>(m_pBandArray->pData) + offset, nPixels);
+      break;
+    case NDFloat32:
+      if (m_bandElectrons > 0.0f) {
+        ADSBIGConvert::toFloat32(pIn, static_cast<epicsFloat32 *>(m_pBandArray->pData) + offset, 
+                                 nPixels, m_bandDarkPedestal, m_bandElectrons);
+      } else {
+        convertBand(pIn, static_cast<epicsFloat32 *>(m_pBandArray->pData) + offset, nPixels);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Plain element by element widening copy from the native camera data.
+ */
+template <typename epicsType> 
+void ADSBIG::convertBand(const epicsUInt16 *pIn, epicsType *pOut, size_t nPixels)
+{
+  for (size_t i=0; i<nPixels; ++i) {
+    pOut[i] = static_cast<epicsType>(pIn[i]);
+  }
+}
+
+/**
+ * Widening add of the native camera data into a co-added frame. 
+ */
+template <typename epicsType> 
+void ADSBIG::accumulateBand(const epicsUInt16 *pIn, epicsType *pOut, size_t nPixels)
+{
+  for (size_t i=0; i<nPixels; ++i) {
+    pOut[i] += static_cast<epicsType>(pIn[i]);
+  }
+}
+
+
+/**
+ * Band processing thread function. In streaming mode this processes each
+ * band of lines as soon as it has been read out, and records the latency
+ * from the last line of each band arriving to the band being processed.
+ */
+void ADSBIG::bandTask(void)
+{
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+  epicsFloat64 latency = 0.0;
+  int linesRead = 0;
+  int lastLine = 0;
+
+  const char* functionName = "ADSBIG::bandTask";
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Band Thread.\n", functionName);
+
+  while (1) {
+
+    epicsEventWait(m_bandEvent);
+
+    if (!m_bandActive) {
+      continue;
+    }
+
+    if (m_bandCancel) {
+      m_bandActive = false;
+      epicsEventSignal(m_bandDoneEvent);
+      continue;
+    }
+
+    //Process whole bands, and the last partial band once the frame is complete.
+    linesRead = epicsAtomicGetIntT(&m_bandLinesRead);
+    if (linesRead == m_bandHeight) {
+      lastLine = linesRead;
+    } else {
+      lastLine = (linesRead / m_bandLines) * m_bandLines;
+    }
+
+    while (m_bandLinesDone < lastLine) {
+      int numLines = m_bandLines;
+      if ((m_bandLinesDone + numLines) > lastLine) {
+        numLines = lastLine - m_bandLinesDone;
+      }
+      epicsTimeGetCurrent(&startTime);
+      processBand(m_bandLinesDone, numLines);
+      epicsTimeGetCurrent(&endTime);
+      m_bandProcTime += epicsTimeDiffInSeconds(&endTime, &startTime);
+      latency = epicsTimeDiffInSeconds(&endTime, &m_bandReadyTime[m_bandLinesDone / m_bandLines]);
+      m_bandLatencySum += latency;
+      if (latency > m_bandLatencyMax) {
+        m_bandLatencyMax = latency;
+      }
+      m_bandCount++;
+      m_bandLinesDone += numLines;
+    }
+
+    if (m_bandLinesDone == m_bandHeight) {
+      //The tail is the processing time left after the last line arrived.
+      m_bandTailTime = epicsTimeDiffInSeconds(&endTime, &m_bandReadyTime[(m_bandHeight - 1) / m_bandLines]);
+      m_bandActive = false;
+      epicsEventSignal(m_bandDoneEvent);
+    }
+
+  }
+
+}
+
+
+/**
+ * Publish the statistics that were accumulated during the readout of
+ * a frame, as params and as NDAttributes of the frame. This is called
+ * from the readout thread with the driver lock held, as soon as the
+ * band processing for the frame is finished.
+ * @param pArray The NDArray for the frame (can be NULL if there is no output)
+ */
+void ADSBIG::publishStats(NDArray *pArray)
+{
+  epicsUInt16 minValue = 0;
+  epicsUInt16 maxValue = 0;
+  epicsFloat64 mean = 0.0;
+  epicsFloat64 sigma = 0.0;
+  epicsFloat64 total = 0.0;
+  epicsInt32 numSaturated = 0;
+  epicsInt32 background = 0;
+  epicsInt32 range = 0;
+
+  m_stats.finish();
+  minValue = m_stats.minValue();
+  maxValue = m_stats.maxValue();
+  mean = m_stats.mean();
+  sigma = m_stats.sigma();
+  total = m_stats.total();
+  numSaturated = static_cast<epicsInt32>(m_stats.numSaturated());
+  background = static_cast<epicsInt32>(m_stats.background());
+  range = static_cast<epicsInt32>(m_stats.range());
+
+  setIntegerParam(ADSBIGStatsMinParam, minValue);
+  setIntegerParam(ADSBIGStatsMaxParam, maxValue);
+  setDoubleParam(ADSBIGStatsMeanParam, mean);
+  setDoubleParam(ADSBIGStatsSigmaParam, sigma);
+  setDoubleParam(ADSBIGStatsTotalParam, total);
+  setIntegerParam(ADSBIGStatsNumSatParam, numSaturated);
+  setIntegerParam(ADSBIGStatsBackgroundParam, background);
+  setIntegerParam(ADSBIGStatsRangeParam, range);
+  const std::vector<unsigned long> &hist = m_stats.histogram();
+  for (size_t bin=0; bin<hist.size(); ++bin) {
+    m_statsHist[bin] = static_cast<epicsInt32>(hist[bin]);
+  }
+  doCallbacksInt32Array(&m_statsHist[0], m_statsHist.size(), ADSBIGStatsHistParam, 0);
+  callParamCallbacks();
+
+  if (pArray != NULL) {
+    pArray->pAttributeList->add("SBIGMinValue", "Minimum raw pixel value", NDAttrUInt16, &minValue);
+    pArray->pAttributeList->add("SBIGMaxValue", "Maximum raw pixel value", NDAttrUInt16, &maxValue);
+    pArray->pAttributeList->add("SBIGMeanValue", "Mean raw pixel value", NDAttrFloat64, &mean);
+    pArray->pAttributeList->add("SBIGSigma", "Sigma of the raw pixel values", NDAttrFloat64, &sigma);
+    pArray->pAttributeList->add("SBIGTotal", "Sum of the raw pixel values", NDAttrFloat64, &total);
+    pArray->pAttributeList->add("SBIGNumSaturated", "Number of saturated pixels", NDAttrInt32, &numSaturated);
+    pArray->pAttributeList->add("SBIGBackground", "Auto contrast background", NDAttrInt32, &background);
+    pArray->pAttributeList->add("SBIGRange", "Auto contrast range", NDAttrInt32, &range);
+  }
+}
+
+/**
+ * Hand a completed frame over to the publisher thread. This is called
+ * from the readout thread with the driver lock held. The publisher thread
+ * takes ownership of the NDArray (and releases it) in all cases.
+ * If the queue is full we either wait for space, or drop the frame,
+ * depending on the drop policy.
+ * @param pArray The NDArray to publish
+ * @param pReplayInfo The params a frame replayed from the spool was taken with,
+ *                    or NULL for a frame that has just been read out.
+ *                    Replayed frames are not written to FITS files.
+ */
+void ADSBIG::publishArray(NDArray *pArray, const ADSBIGSpoolFrameInfo *pReplayInfo)
+{
+  epicsInt32 depth = 0;
+  epicsInt32 dropPolicy = 0;
+  epicsInt32 dropped = 0;
+
+  const char* functionName = "ADSBIG::publishArray";
+
+  getIntegerParam(ADSBIGPubQueueDepthParam, &depth);
+  getIntegerParam(ADSBIGPubDropPolicyParam, &dropPolicy);
+
+  while (epicsAtomicGetIntT(&m_publishPending) >= depth) {
+    if (dropPolicy == ADSBIG_PUB_DROP_NEWEST) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, 
+                "%s Publish queue full. Dropping frame %d.\n", functionName, pArray->uniqueId);
+      getIntegerParam(ADSBIGPubDroppedParam, &dropped);
+      setIntegerParam(ADSBIGPubDroppedParam, ++dropped);
+      pArray->release();
+      return;
+    }
+    unlock();
+    epicsEventWaitWithTimeout(m_publishFreeEvent, 0.1);
+    lock();
+  }
+
+  ADSBIGPublishItem *pItem = &m_publishItems[m_publishSlot];
+  m_publishSlot = (m_publishSlot + 1) % ADSBIG_PUB_QUEUE_SIZE;
+  pItem->pArray = pArray;
+  epicsTimeGetCurrent(&pItem->queuedTime);
+  if (pReplayInfo != NULL) {
+    pItem->writeFits = false;
+    pItem->spoolInfo = *pReplayInfo;
+  } else {
+    pItem->writeFits = fitsHeader(pArray, pItem->fitsHeader);
+
+    //The params the frame was taken with, for the spool
+    pItem->spoolInfo.startTime = m_frameStartTime;
+    getDoubleParam(ADAcquireTime, &pItem->spoolInfo.acquireTime);
+    getDoubleParam(ADTemperatureActual, &pItem->spoolInfo.ccdTemp);
+    getIntegerParam(ADBinX, &pItem->spoolInfo.binX);
+    getIntegerParam(ADBinY, &pItem->spoolInfo.binY);
+    getIntegerParam(ADMinX, &pItem->spoolInfo.minX);
+    getIntegerParam(ADMinY, &pItem->spoolInfo.minY);
+    pItem->spoolInfo.readoutMode = sbigReadoutMode(ADSBIG_ADDR_IMAGING);
+    getIntegerParam(ADSBIGDarkFieldParam, &pItem->spoolInfo.darkField);
+    getIntegerParam(ADNumExposuresCounter, &pItem->spoolInfo.numExposures);
+    pItem->spoolInfo.address = ADSBIG_ADDR_IMAGING;
+  }
+
+  epicsAtomicIncrIntT(&m_publishPending);
+  epicsRingPointerPush(m_publishQueue, pItem);
+  epicsEventSignal(m_publishEvent);
+
+  setIntegerParam(ADSBIGPubQueueUsedParam, epicsAtomicGetIntT(&m_publishPending));
+}
+
+/**
+ * Compress a frame in the SBIG compressed image format (see ADSBIGCodec),
+ * for the plugins. This is called from the publisher thread, without the
+ * driver lock. Only 2D UInt16 frames can be compressed, and only if they
+ * are smaller compressed than raw.
+ * @param pArray The frame
+ * @param seconds Set to the time taken to compress it
+ * @return The compressed frame, or NULL if the frame was not compressed
+ */
+NDArray* ADSBIG::compressArray(NDArray *pArray, double &seconds)
+{
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+  NDArray *pOut = NULL;
+  size_t dims[2];
+  size_t size = 0;
+
+  const char* functionName = "ADSBIG::compressArray";
+
+  if ((pArray->dataType != NDUInt16) || (pArray->ndims != 2) || !pArray->codec.name.empty()) {
+    return NULL;
+  }
+
+  epicsTimeGetCurrent(&startTime);
+  dims[0] = pArray->dims[0].size;
+  dims[1] = pArray->dims[1].size;
+  //No bigger than the raw frame. A frame that does not compress into it is published uncompressed.
+  pOut = this->pNDArrayPool->alloc(2, dims, NDUInt16, pArray->dataSize, NULL);
+  if (pOut == NULL) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Failed to allocate compressed frame %d. Publishing it uncompressed.\n", functionName, pArray->uniqueId);
+    return NULL;
+  }
+  //Copies the IDs, time stamps and attributes, but not the data
+  this->pNDArrayPool->copy(pArray, pOut, false);
+
+  size = p_Codec->encode(static_cast<const epicsUInt16 *>(pArray->pData), static_cast<int>(dims[0]), static_cast<int>(dims[1]), 
+                         static_cast<unsigned char *>(pOut->pData), pOut->dataSize);
+  if (size == 0) {
+    pOut->release();
+    return NULL;
+  }
+  pOut->codec.name = ADSBIG_CODEC_NAME;
+  pOut->compressedSize = size;
+  epicsTimeGetCurrent(&endTime);
+  seconds = epicsTimeDiffInSeconds(&endTime, &startTime);
+
+  return pOut;
+}
+
+/**
+ * Demosaic a frame from a colour CCD into an RGB1 frame (see ADSBIGDemosaic).
+ * This is called from the readout thread with the driver lock held, and
+ * the lock is released while the frame is processed.
+ * @param pArray The raw frame. It is released if the frame is demosaiced.
+ * @param method ADSBIG_DEMOSAIC_BILINEAR or ADSBIG_DEMOSAIC_EDGE
+ * @param pattern The Bayer pattern of the frame (see ADSBIGDemosaic::framePattern)
+ * @return The RGB1 frame, or pArray if it was not demosaiced
+ */
+NDArray* ADSBIG::demosaicArray(NDArray *pArray, int method, int pattern)
+{
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+  NDArray *pOut = NULL;
+  size_t dims[3];
+  bool ok = false;
+
+  const char* functionName = "ADSBIG::demosaicArray";
+
+  if ((pArray->ndims != 2) || !ADSBIGDemosaic::supported(pArray->dataType)) {
+    return pArray;
+  }
+
+  epicsTimeGetCurrent(&startTime);
+  dims[0] = 3;
+  dims[1] = pArray->dims[0].size;
+  dims[2] = pArray->dims[1].size;
+  if ((pOut = this->pNDArrayPool->alloc(3, dims, pArray->dataType, 0, NULL)) == NULL) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Failed to allocate an RGB frame. Publishing the raw frame.\n", functionName);
+    return pArray;
+  }
+
+  unlock();
+  ok = p_Demosaic->process(pArray->pData, pOut->pData, pArray->dataType, 
+                           static_cast<int>(dims[1]), static_cast<int>(dims[2]), method, pattern);
+  lock();
+  if (!ok) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Frame is too small to demosaic. Publishing the raw frame.\n", functionName);
+    pOut->release();
+    return pArray;
+  }
+
+  //Copies the IDs, time stamps and attributes, but not the data or dimensions
+  this->pNDArrayPool->copy(pArray, pOut, false, false, false);
+  pArray->release();
+  epicsTimeGetCurrent(&endTime);
+  setDoubleParam(ADSBIGDemosaicTimeParam, epicsTimeDiffInSeconds(&endTime, &startTime) * 1000.0);
+
+  return pOut;
+}
+
+/**
+ * Fill in the FITS header for a frame from the driver params and the image
+ * header set up by the class library, and make the file name. This is
+ * called with the driver lock held, when the frame is queued for publishing.
+ * @param pArray The frame
+ * @param header The FITS header to fill in
+ * @return true if the frame should be written to a FITS file (NDAutoSave)
+ */
+bool ADSBIG::fitsHeader(NDArray *pArray, ADSBIGFitsHeader &header)
+{
+  char fullFileName[MAX_FILENAME_LEN];
+  epicsInt32 autoSave = 0;
+  epicsInt32 autoIncrement = 0;
+  epicsInt32 fileNumber = 0;
+  epicsInt32 darkField = 0;
+  epicsInt32 focusMode = 0;
+  epicsInt32 numExposures = 0;
+  epicsInt32 satLevel = 65535;
+  std::string value;
+
+  const char* functionName = "ADSBIG::fitsHeader";
+
+  getIntegerParam(NDAutoSave, &autoSave);
+  if ((autoSave == 0) || (p_Fits == NULL)) {
+    return false;
+  }
+
+  if (createFileName(MAX_FILENAME_LEN, fullFileName) != asynSuccess) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Invalid FITS file name.\n", functionName);
+    setIntegerParam(NDFileWriteStatus, NDFileWriteError);
+    setStringParam(NDFileWriteMessage, "Invalid file name");
+    return false;
+  }
+  setStringParam(NDFullFileName, fullFileName);
+  getIntegerParam(NDAutoIncrement, &autoIncrement);
+  if (autoIncrement != 0) {
+    getIntegerParam(NDFileNumber, &fileNumber);
+    setIntegerParam(NDFileNumber, fileNumber + 1);
+  }
+  header.fileName = fullFileName;
+
+  getIntegerParam(ADSBIGFitsCompressParam, &header.compression);
+  getStringParam(ADSBIGFitsObjectParam, value);
+  header.object = value;
+  getStringParam(ADSBIGFitsTelescopeParam, value);
+  header.telescope = value;
+  getStringParam(ADSBIGFitsObserverParam, value);
+  header.observer = value;
+  getStringParam(ADModel, value);
+  header.instrument = value;
+
+  getIntegerParam(ADSBIGDarkFieldParam, &darkField);
+  getIntegerParam(ADSBIGFocusParam, &focusMode);
+  if ((darkField == ADSBIG_FRAME_DARK) && (focusMode == 0)) {
+    header.imageType = "Dark Frame";
+  } else {
+    header.imageType = "Light Frame";
+  }
+
+  header.startTime = m_frameStartTime;
+  getDoubleParam(ADAcquireTime, &header.exposureTime);
+  getIntegerParam(ADNumExposuresCounter, &numExposures);
+  header.numExposures = ((focusMode != 0) || (numExposures < 1)) ? 1 : numExposures;
+  getDoubleParam(ADTemperatureActual, &header.ccdTemp);
+  getIntegerParam(ADBinX, &header.binX);
+  getIntegerParam(ADBinY, &header.binY);
+  getIntegerParam(ADMinX, &header.originX);
+  getIntegerParam(ADMinY, &header.originY);
+  header.readoutMode = sbigReadoutMode(ADSBIG_ADDR_IMAGING);
+
+  //These are set in the image header by CSBIGCam::GrabSetup (the pixel sizes are in mm)
+  header.pixelWidth = p_Img->GetPixelWidth() * 1000.0;
+  header.pixelHeight = p_Img->GetPixelHeight() * 1000.0;
+  header.eGain = p_Img->GetEGain();
+  getIntegerParam(ADSBIGStatsSatUsedParam, &satLevel);
+  header.dataMax = static_cast<long>(satLevel) * header.numExposures;
+
+  //The pedestal left in the frame by each co-added exposure. Focus frames
+  //are not dark subtracted, and the flat field removes it from Float32 frames.
+  if ((focusMode != 0) || ((pArray->dataType == NDFloat32) && (m_pBandGain != NULL))) {
+    header.pedestal = 0;
+  } else {
+    header.pedestal = static_cast<long>(m_bandDarkPedestal) * header.numExposures;
+  }
+
+  //UInt8 frames are scaled from the black to the white level. Float32 frames
+  //in electrons have the pedestal removed, and are already multiplied by the gain.
+  if (focusMode == 0) {
+    if (pArray->dataType == NDUInt8) {
+      header.pedestal = 0;
+      header.dataMax = 255;
+    } else if ((pArray->dataType == NDFloat32) && (m_bandElectrons > 0.0f)) {
+      header.pedestal = 0;
+      header.dataMax = static_cast<long>(header.dataMax * header.eGain);
+      header.eGain = 1.0;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Called from a FITS writer thread when a file has been written (or failed).
+ * @param result The outcome, size and time taken
+ */
+void ADSBIG::fitsDone(const ADSBIGFitsResult &result)
+{
+  epicsInt32 numWritten = 0;
+
+  const char* functionName = "ADSBIG::fitsDone";
+
+  lock();
+  if (result.ok) {
+    getIntegerParam(ADSBIGFitsWrittenParam, &numWritten);
+    setIntegerParam(ADSBIGFitsWrittenParam, numWritten + 1);
+    if (result.seconds > 0.0) {
+      setDoubleParam(ADSBIGFitsRateParam, (result.rawBytes / result.seconds) / 1.0e6);
+    }
+    if (result.fileBytes > 0) {
+      setDoubleParam(ADSBIGFitsRatioParam, static_cast<double>(result.rawBytes) / result.fileBytes);
+    }
+    setIntegerParam(NDFileWriteStatus, NDFileWriteOK);
+    setStringParam(NDFileWriteMessage, "");
+  } else {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Failed to write %s. %s\n", functionName, result.fileName.c_str(), result.message.c_str());
+    setIntegerParam(NDFileWriteStatus, NDFileWriteError);
+    setStringParam(NDFileWriteMessage, result.message.c_str());
+  }
+  setIntegerParam(ADSBIGFitsQueueUsedParam, p_Fits->pending());
+  callParamCallbacks();
+  unlock();
+}
+
+/**
+ * Publish the frames in a spool file again, oldest first, as if they had
+ * just been read out. The frames keep their original IDs and time stamps.
+ * They are not written to FITS files, since the header would be made from
+ * the current settings rather than those the frames were taken with.
+ * This is only allowed while the camera is idle and the spool is disabled.
+ * @param fileName The spool file
+ * @return asynStatus
+ */
+asynStatus ADSBIG::replaySpool(const char *fileName)
+{
+  ADSBIGSpoolReader reader;
+  const ADSBIGSpoolRecordHeader *pRecord = NULL;
+  const void *pData = NULL;
+  NDArray *pArray = NULL;
+  size_t dims[ADSBIG_SPOOL_MAX_DIMS] = {0};
+  std::string message;
+  epicsInt32 acquiring = 0;
+  epicsInt32 spoolEnable = 0;
+  int numFrames = 0;
+  asynStatus status = asynSuccess;
+
+  const char* functionName = "ADSBIG::replaySpool";
+
+  lock();
+  getIntegerParam(ADAcquire, &acquiring);
+  getIntegerParam(ADSBIGSpoolEnableParam, &spoolEnable);
+  if ((acquiring != 0) || (spoolEnable != 0)) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Stop acquiring and disable the spool before replaying it.\n", functionName);
+    unlock();
+    return asynError;
+  }
+
+  if ((fileName == NULL) || (!reader.open(fileName, message))) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s Failed to open spool file. %s\n", functionName, message.c_str());
+    unlock();
+    return asynError;
+  }
+
+  while (reader.next(&pRecord, &pData)) {
+    for (int dim = 0; dim < pRecord->ndims; ++dim) {
+      dims[dim] = static_cast<size_t>(pRecord->dims[dim]);
+    }
+    if ((pArray = this->pNDArrayPool->alloc(pRecord->ndims, dims, static_cast<NDDataType_t>(pRecord->dataType), 0, NULL)) == NULL) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s Failed to allocate an NDArray for frame %d.\n", functionName, pRecord->uniqueId);
+      status = asynError;
+      break;
+    }
+    //The reader has checked that the data size matches the dimensions
+    memcpy(pArray->pData, pData, static_cast<size_t>(pRecord->dataBytes));
+    pArray->uniqueId = pRecord->uniqueId;
+    pArray->timeStamp = pRecord->timeStamp;
+    pArray->epicsTS.secPastEpoch = pRecord->epicsSec;
+    pArray->epicsTS.nsec = pRecord->epicsNsec;
+    publishArray(pArray, &pRecord->info);
+    callParamCallbacks();
+    ++numFrames;
+  }
+  waitForPublisher();
+  callParamCallbacks();
+  unlock();
+
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+            "%s Replayed %d frames from %s (%llu not valid).\n", functionName, numFrames, fileName,
+            static_cast<unsigned long long>(reader.numSkipped()));
+
+  return status;
+}
+
+/**
+ * Wait for the publisher thread to deliver all the frames that have
+ * been queued. This is called from the readout thread with the driver 
+ * lock held, at the end of an acquisition.
+ */
+void ADSBIG::waitForPublisher(void)
+{
+  while (epicsAtomicGetIntT(&m_publishPending) > 0) {
+    unlock();
+    epicsEventWaitWithTimeout(m_publishFreeEvent, 0.1);
+    lock();
+  }
+  setIntegerParam(ADSBIGPubQueueUsedParam, 0);
+}
+
+/**
+ * Publisher thread function. This gets the attributes for each frame
+ * and does the NDArray callbacks, so that the readout thread can start 
+ * the next exposure without waiting for the plugins.
+ */
+void ADSBIG::publishTask(void)
+{
+  ADSBIGPublishItem item;
+  ADSBIGPublishItem *pItem = NULL;
+  epicsTimeStamp dequeuedTime;
+  epicsTimeStamp attrTime;
+  epicsTimeStamp doneTime;
+  bool fitsDropped = false;
+  epicsInt32 numDropped = 0;
+  epicsInt32 codec = ADSBIG_CODEC_NONE;
+  NDArray *pCompressed = NULL;
+  double codecTime = 0.0;
+  size_t rawSize = 0;
+  size_t compressedSize = 0;
+  bool spooled = false;
+  double spoolFill = 0.0;
+  double spoolRate = 0.0;
+  int spoolFrames = 0;
+  int spoolOverwrites = 0;
+
+  const char* functionName = "ADSBIG::publishTask";
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Publisher Thread.\n", functionName);
+
+  while (1) {
+
+    epicsEventWait(m_publishEvent);
+
+    while ((pItem = static_cast<ADSBIGPublishItem *>(epicsRingPointerPop(m_publishQueue))) != NULL) {
+      item = *pItem;
+      epicsTimeGetCurrent(&dequeuedTime);
+
+      lock();
+      //Get any attributes that have been defined for this driver
+      this->getAttributes(item.pArray->pAttributeList);
+      getIntegerParam(ADSBIGCodecParam, &codec);
+      unlock();
+      epicsTimeGetCurrent(&attrTime);
+
+      //The FITS file is written while the plugins process the frame
+      fitsDropped = (item.writeFits && !p_Fits->queue(item.pArray, item.fitsHeader));
+      if (fitsDropped) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, 
+                  "%s FITS queue full. Not writing frame %d.\n", functionName, item.pArray->uniqueId);
+      }
+
+      //The spool has the raw frame, so it can be replayed if the plugins fall behind
+      spooled = (p_Spool->isOpen() && p_Spool->append(item.pArray, item.spoolInfo));
+
+      //The plugins get the compressed frame, if it can be compressed
+      pCompressed = NULL;
+      compressedSize = 0;
+      if (codec == ADSBIG_CODEC_SBIG) {
+        rawSize = item.pArray->dims[0].size * item.pArray->dims[1].size * sizeof(epicsUInt16);
+        pCompressed = compressArray(item.pArray, codecTime);
+        if (pCompressed != NULL) {
+          item.pArray->release();
+          item.pArray = pCompressed;
+          compressedSize = pCompressed->compressedSize;
+        }
+      }
+
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Calling NDArray callback\n", functionName);
+      doCallbacksGenericPointer(item.pArray, NDArrayData, 0);
+      item.pArray->release();
+      epicsTimeGetCurrent(&doneTime);
+
+      epicsAtomicDecrIntT(&m_publishPending);
+      epicsEventSignal(m_publishFreeEvent);
+
+      lock();
+      setDoubleParam(ADSBIGPubQueueTimeParam, epicsTimeDiffInSeconds(&dequeuedTime, &item.queuedTime) * 1000.0);
+      setDoubleParam(ADSBIGPubAttrTimeParam, epicsTimeDiffInSeconds(&attrTime, &dequeuedTime) * 1000.0);
+      setDoubleParam(ADSBIGPubCallbackTimeParam, epicsTimeDiffInSeconds(&doneTime, &attrTime) * 1000.0);
+      recordTiming(ADSBIG_STAGE_CALLBACK, epicsTimeDiffInSeconds(&doneTime, &attrTime));
+      setIntegerParam(ADSBIGPubQueueUsedParam, epicsAtomicGetIntT(&m_publishPending));
+      if (fitsDropped) {
+        getIntegerParam(ADSBIGFitsDroppedParam, &numDropped);
+        setIntegerParam(ADSBIGFitsDroppedParam, numDropped + 1);
+      }
+      setIntegerParam(ADSBIGFitsQueueUsedParam, p_Fits->pending());
+      if (spooled) {
+        p_Spool->status(spoolFill, spoolFrames, spoolOverwrites, spoolRate);
+        setDoubleParam(ADSBIGSpoolFillParam, spoolFill);
+        setDoubleParam(ADSBIGSpoolRateParam, spoolRate);
+        setIntegerParam(ADSBIGSpoolFramesParam, spoolFrames);
+        setIntegerParam(ADSBIGSpoolOverwritesParam, spoolOverwrites);
+      }
+      if (compressedSize > 0) {
+        setDoubleParam(ADSBIGCodecRatioParam, static_cast<double>(rawSize) / compressedSize);
+        if (codecTime > 0.0) {
+          setDoubleParam(ADSBIGCodecRateParam, (rawSize / codecTime) / 1.0e6);
+        }
+      }
+      callParamCallbacks();
+      unlock();
+    }
+
+  }
+
+}
+
+/**
+ * Set the black and white levels for UInt8 frames. This is called from
+ * the readout thread with the driver lock held, before each frame. The
+ * auto levels are the auto contrast background and range (as chosen by
+ * CSBIGImg::AutoBackgroundAndRange) of the last frame, or the full range
+ * until there has been one, so the statistics are enabled for the frame.
+ */
+void ADSBIG::setConvertLevels(void)
+{
+  epicsInt32 levels = ADSBIG_CONVERT_LEVELS_AUTO;
+  epicsInt32 black = 0;
+  epicsInt32 white = 65535;
+  epicsInt32 range = 0;
+  epicsInt32 satLevel = 65535;
+
+  getIntegerParam(ADSBIGConvertLevelsParam, &levels);
+  if (levels == ADSBIG_CONVERT_LEVELS_MANUAL) {
+    getIntegerParam(ADSBIGConvertBlackParam, &black);
+    getIntegerParam(ADSBIGConvertWhiteParam, &white);
+  } else {
+    m_bandStats = true;
+    getIntegerParam(ADSBIGStatsBackgroundParam, &black);
+    getIntegerParam(ADSBIGStatsRangeParam, &range);
+    getIntegerParam(ADSBIGStatsSatUsedParam, &satLevel);
+    white = (range > 0) ? (black + range) : satLevel;
+  }
+  black = (black < 0) ? 0 : ((black > 65535) ? 65535 : black);
+  white = (white < 0) ? 0 : ((white > 65535) ? 65535 : white);
+  m_bandBlack = static_cast<epicsUInt16>(black);
+  m_bandWhite = static_cast<epicsUInt16>(white);
+}
+
+/**
+ * Decide whether to build a preview of the next frame. A preview is built 
+ * if the preview NDArray callbacks are enabled and at least 1/PreviewMaxRate 
+ * seconds have passed since the last one was started. This is called from 
+ * the readout thread with the driver lock held, before the first exposure.
+ * @param width The frame width
+ * @param height The frame height
+ * @return true if the band processing should build a preview of the frame
+ */
+bool ADSBIG::startPreview(int width, int height)
+{
+  const int addr = ADSBIG_ADDR_PREVIEW;
+  epicsInt32 arrayCallbacks = 0;
+  epicsInt32 factor = 1;
+  epicsInt32 mode = ADSBIG_PREVIEW_BIN;
+  epicsFloat64 maxRate = 0.0;
+  epicsTimeStamp nowTime;
+
+  m_bandPreview = false;
+  m_bandPreviewTime = 0.0;
+  getIntegerParam(addr, NDArrayCallbacks, &arrayCallbacks);
+  if (!arrayCallbacks) {
+    return false;
+  }
+  getDoubleParam(addr, ADSBIGPreviewMaxRateParam, &maxRate);
+  epicsTimeGetCurrent(&nowTime);
+  if ((maxRate > 0.0) && (epicsTimeDiffInSeconds(&nowTime, &m_previewTime) < (1.0 / maxRate))) {
+    return false;
+  }
+  getIntegerParam(addr, ADSBIGPreviewFactorParam, &factor);
+  getIntegerParam(addr, ADSBIGPreviewModeParam, &mode);
+  m_bandPreview = m_preview.start(width, height, factor, mode);
+  if (m_bandPreview) {
+    m_previewTime = nowTime;
+  }
+  return m_bandPreview;
+}
+
+/**
+ * Hand the preview of a completed frame over to the preview thread. This 
+ * is called from the readout thread with the driver lock held. Only the 
+ * latest preview is kept, so if the preview thread is still busy with 
+ * the callbacks for the last one, that one is dropped.
+ * @param uniqueId The uniqueId of the frame
+ * @param timeStamp The time stamp of the frame
+ */
+void ADSBIG::publishPreview(int uniqueId, const epicsTimeStamp &timeStamp)
+{
+  const int addr = ADSBIG_ADDR_PREVIEW;
+  size_t dims[2];
+  epicsInt32 autoscale = 0;
+  epicsInt32 dropped = 0;
+  epicsInt32 factor = m_preview.factor();
+  double low = 0.0;
+  double high = 0.0;
+  NDArray *pArray = NULL;
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+
+  const char* functionName = "ADSBIG::publishPreview";
+
+  epicsTimeGetCurrent(&startTime);
+  getIntegerParam(addr, ADSBIGPreviewAutoscaleParam, &autoscale);
+  NDDataType_t dataType = autoscale ? NDUInt8 : NDUInt16;
+  dims[0] = m_preview.width();
+  dims[1] = m_preview.height();
+  if ((pArray = this->pNDArrayPool->alloc(2, dims, dataType, 0, NULL)) == NULL) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+              "%s. ERROR: pArray is NULL.\n", functionName);
+    return;
+  }
+  if (!m_preview.finish(pArray->pData, dataType, low, high)) {
+    pArray->release();
+    return;
+  }
+  pArray->uniqueId = uniqueId;
+  pArray->timeStamp = timeStamp.secPastEpoch + timeStamp.nsec / 1.e9;
+  updateTimeStamp(&pArray->epicsTS);
+  pArray->pAttributeList->add("PreviewFactor", "Preview factor", NDAttrInt32, &factor);
+  pArray->pAttributeList->add("PreviewLow", "Lowest preview pixel", NDAttrFloat64, &low);
+  pArray->pAttributeList->add("PreviewHigh", "Highest preview pixel", NDAttrFloat64, &high);
+
+  if (m_pPreviewArray != NULL) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, 
+              "%s Preview thread busy. Dropping preview of frame %d.\n", functionName, m_pPreviewArray->uniqueId);
+    m_pPreviewArray->release();
+    getIntegerParam(addr, ADSBIGPreviewDroppedParam, &dropped);
+    setIntegerParam(addr, ADSBIGPreviewDroppedParam, dropped + 1);
+  }
+  m_pPreviewArray = pArray;
+  epicsTimeGetCurrent(&endTime);
+  setDoubleParam(addr, ADSBIGPreviewTimeParam, 
+                 (m_bandPreviewTime + epicsTimeDiffInSeconds(&endTime, &startTime)) * 1000.0);
+  callParamCallbacks(addr);
+  epicsEventSignal(m_previewEvent);
+}
+
+/**
+ * Preview thread function. This does the NDArray callbacks for the
+ * previews on asyn address 2, so that slow preview plugins never hold up
+ * the readout or the full frames.
+ */
+void ADSBIG::previewTask(void)
+{
+  const int addr = ADSBIG_ADDR_PREVIEW;
+  NDArray *pArray = NULL;
+  NDArrayInfo_t arrayInfo;
+  epicsInt32 counter = 0;
+
+  const char* functionName = "ADSBIG::previewTask";
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Preview Thread.\n", functionName);
+
+  while (1) {
+
+    epicsEventWait(m_previewEvent);
+
+    lock();
+    pArray = m_pPreviewArray;
+    m_pPreviewArray = NULL;
+    if (pArray == NULL) {
+      unlock();
+      continue;
+    }
+    pArray->getInfo(&arrayInfo);
+    getIntegerParam(addr, NDArrayCounter, &counter);
+    setIntegerParam(addr, NDArrayCounter, counter + 1);
+    setIntegerParam(addr, NDArraySizeX, static_cast<int>(pArray->dims[0].size));
+    setIntegerParam(addr, NDArraySizeY, static_cast<int>(pArray->dims[1].size));
+    setIntegerParam(addr, NDArraySize, static_cast<int>(arrayInfo.totalBytes));
+    setIntegerParam(addr, NDDataType, pArray->dataType);
+    setIntegerParam(addr, NDColorMode, NDColorModeMono);
+    callParamCallbacks(addr);
+    unlock();
+
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Calling NDArray callback\n", functionName);
+    doCallbacksGenericPointer(pArray, NDArrayData, addr);
+    pArray->release();
+  }
+
+}
+
+
+/**
+ * Focus mode frame loop, run by the readout thread with the driver lock
+ * held after GrabSetup. Light frames of the subframe are grabbed with
+ * CSBIGCam::GrabFocus straight into NDArrays and queued for the publisher,
+ * without the band processing, dark and flat correction, statistics or 
+ * timing of a normal acquisition. The frame rate is averaged over
+ * ADSBIG_FOCUS_RATE_PERIOD seconds.
+ * @param sizeX The subframe width
+ * @param sizeY The subframe height
+ * @param imageMode The image mode (ADImageMode)
+ * @param numImages The number of images in Multiple mode
+ * @return false if there was an error
+ */
+bool ADSBIG::focusAcquire(int sizeX, int sizeY, int imageMode, int numImages)
+{
+  size_t dims[2];
+  int nDims = 2;
+  epicsInt32 arrayCallbacks = 0;
+  epicsInt32 imageCounter = 0;
+  epicsInt32 numImagesCounter = 0;
+  epicsFloat64 acquireTime = 0.0;
+  epicsFloat64 acquirePeriod = 0.0;
+  epicsFloat64 elapsed = 0.0;
+  epicsFloat64 delay = 0.0;
+  epicsTimeStamp nowTime;
+  epicsTimeStamp frameStartTime;
+  epicsTimeStamp midTime;
+  epicsTimeStamp rateStartTime;
+  int rateFrames = 0;
+  bool done = false;
+  NDArray *pArray = NULL;
+  unsigned short *pDest = NULL;
+  PAR_ERROR cam_err = CE_NO_ERROR;
+
+  const char* functionName = "ADSBIG::focusAcquire";
+
+  dims[0] = sizeX;
+  dims[1] = sizeY;
+  setIntegerParam(NDArraySizeX, sizeX);
+  setIntegerParam(NDArraySizeY, sizeY);
+  setIntegerParam(NDArraySize, sizeX*sizeY*sizeof(epicsUInt16));
+  setIntegerParam(ADStatus, ADStatusAcquire);
+  setStringParam(ADStatusMessage, "Focus mode");
+  callParamCallbacks();
+  epicsTimeGetCurrent(&rateStartTime);
+
+  while (1) {
+
+    getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+    getDoubleParam(ADAcquireTime, &acquireTime);
+    pArray = NULL;
+    pDest = p_Img->GetImagePointer();
+    if (arrayCallbacks) {
+      if ((pArray = this->pNDArrayPool->alloc(nDims, dims, NDUInt16, 0, NULL)) == NULL) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                  "%s. ERROR: pArray is NULL.\n", 
+                  functionName);
+      } else {
+        pDest = static_cast<unsigned short *>(pArray->pData);
+      }
+    }
+
+    epicsTimeGetCurrent(&frameStartTime);
+    m_frameStartTime = frameStartTime;
+    unlock();
+    cam_err = p_Cam->GrabFocus(pDest);
+    lock();
+
+    if (m_aborted) {
+      if (pArray != NULL) {
+        pArray->release();
+      }
+      setIntegerParam(ADStatus, ADStatusAborted);
+      return true;
+    }
+    if (cam_err != CE_NO_ERROR) {
+      if (pArray != NULL) {
+        pArray->release();
+      }
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s. CSBIGCam::GrabFocus returned an error. %s\n", 
+                functionName, p_Cam->GetErrorString(cam_err).c_str());
+      setStringParam(ADStatusMessage, p_Cam->GetErrorString(cam_err).c_str());
+      setIntegerParam(ADStatus, ADStatusError);
+      return false;
+    }
+
+    getIntegerParam(ADNumImagesCounter, &numImagesCounter);
+    numImagesCounter++;
+    done = ((imageMode == ADImageSingle) || 
+            ((imageMode == ADImageMultiple) && (numImagesCounter >= numImages)));
+
+    epicsTimeGetCurrent(&nowTime);
+    rateFrames++;
+    elapsed = epicsTimeDiffInSeconds(&nowTime, &rateStartTime);
+    if ((elapsed >= ADSBIG_FOCUS_RATE_PERIOD) || done) {
+      setDoubleParam(ADSBIGFrameRateParam, rateFrames / elapsed);
+      setDoubleParam(ADSBIGDeadTimeParam, ((elapsed / rateFrames) > acquireTime) ? (elapsed / rateFrames) - acquireTime : 0.0);
+      rateStartTime = nowTime;
+      rateFrames = 0;
+    }
+
+    getIntegerParam(NDArrayCounter, &imageCounter);
+    imageCounter++;
+    setIntegerParam(NDArrayCounter, imageCounter);
+    setIntegerParam(ADNumImagesCounter, numImagesCounter);
+
+    if (pArray != NULL) {
+      grabMidpoint(p_Cam->GetGrabTimes(), midTime);
+      pArray->uniqueId = imageCounter;
+      pArray->timeStamp = midTime.secPastEpoch + midTime.nsec / 1.e9;
+      updateTimeStamp(&pArray->epicsTS);
+      //The publisher thread does the attributes and callbacks, and releases the array.
+      publishArray(pArray, NULL);
+    }
+    callParamCallbacks();
+
+    if (done) {
+      break;
+    }
+
+    getDoubleParam(ADAcquirePeriod, &acquirePeriod);
+    delay = acquirePeriod - epicsTimeDiffInSeconds(&nowTime, &frameStartTime);
+    if (delay > 0) {
+      unlock();
+      //abortExposure signals the stop event, so this returns early on a stop.
+      epicsEventWaitWithTimeout(m_stopEvent, delay);
+      lock();
+      if (m_aborted) {
+        setIntegerParam(ADStatus, ADStatusAborted);
+        return true;
+      }
+    }
+
+  }
+
+  return true;
+}
+
+/**
+ * Readout thread function
+ *
+ * GrabSetup is done once per acquisition. In Multiple and Continuous
+ * image modes we then loop on GrabMain, honouring ADAcquirePeriod
+ * between the start of each frame.
+ */
+void ADSBIG::readoutTask(void)
+{
+  epicsEventWaitStatus eventStatus;
+  epicsFloat64 timeout = 0.001;
+  bool error = false;
+  bool acquiring = false;
+  size_t dims[2];
+  int nDims = 2;
+  epicsInt32 sizeX = 0;
+  epicsInt32 sizeY = 0;
+  epicsInt32 minX = 0;
+  epicsInt32 minY = 0;
+  NDDataType_t dataType;
+  epicsInt32 iDataType = 0;
+  epicsUInt32 dataSize = 0;
+  epicsTimeStamp nowTime;
+  epicsTimeStamp acqStartTime;
+  epicsTimeStamp frameStartTime;
+  epicsTimeStamp lastFrameTime;
+  epicsTimeStamp setupStartTime;
+  epicsTimeStamp midTime;
+  NDArray *pArray = NULL;
+  epicsInt32 numImagesCounter = 0;
+  epicsInt32 imageCounter = 0;
+  epicsInt32 imageMode = 0;
+  epicsInt32 numImages = 0;
+  epicsInt32 adStatus = 0;
+  epicsInt32 streaming = 0;
+  epicsInt32 bandLines = 0;
+  epicsInt32 darkSubtract = 0;
+  epicsInt32 darkPedestal = 0;
+  epicsInt32 flatField = 0;
+  epicsInt32 useUSTimer = 0;
+  epicsInt32 satLevel = 65535;
+  epicsInt32 readoutMode = 0;
+  epicsInt32 darkRefresh = 0;
+  epicsInt32 darkAge = 0;
+  epicsInt32 statsEnable = 0;
+  epicsInt32 numExposures = 1;
+  epicsInt32 focusMode = 0;
+  epicsInt32 demosaic = 0;
+  epicsInt32 ccdPattern = 0;
+  epicsInt32 colorMode = NDColorModeMono;
+  epicsInt32 convertElectrons = 0;
+  int bayerPattern = ADSBIG_BAYER_NONE;
+  epicsFloat64 exposureTime = 0.0;
+  epicsFloat64 expectedTime = 0.0;
+  epicsFloat64 readoutTime = 0.0;
+  epicsFloat64 convertTime = 0.0;
+  epicsFloat64 flatTime = 0.0;
+  epicsFloat64 eGain = 0.0;
+  unsigned long readoutLines = 0;
+  bool haveDark = false;
+  bool reuseDark = false;
+  epicsFloat64 acquireTime = 0.0;
+  epicsFloat64 acquirePeriod = 0.0;
+  epicsFloat64 framePeriod = 0.0;
+  epicsFloat64 delay = 0.0;
+  PAR_ERROR cam_err = CE_NO_ERROR;
+
+  const char* functionName = "ADSBIG::readoutTask";
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Readout Thread.\n", functionName);
+
+  while (1) {
+
+    //Wait for a stop event, with a short timeout, to catch any that were done after last one.
+    eventStatus = epicsEventWaitWithTimeout(m_stopEvent, timeout);          
+    if (eventStatus == epicsEventWaitOK) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Got Stop Event Before Start Event.\n", functionName);
+    }
+
+    lock();
+    if (!error) {
+      setStringParam(ADStatusMessage, "Idle");
+    }
+    callParamCallbacks();
+    unlock();
+
+    eventStatus = epicsEventWait(m_startEvent);          
+    if (eventStatus == epicsEventWaitOK) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Got Start Event.\n", functionName);
+      error = false;
+      setStringParam(ADStatusMessage, " ");
+      lock();
+      setIntegerParam(ADNumImagesCounter, 0);
+      setIntegerParam(ADNumExposuresCounter, 0);
+      setDoubleParam(ADSBIGFrameRateParam, 0.0);
+      setDoubleParam(ADSBIGDeadTimeParam, 0.0);
+
+      //Sanity checks
+      if ((p_Cam == NULL) || (p_Img == NULL)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s NULL pointer.\n", functionName);
+        break;
+      }
+
+      //Build a master dark or flat instead of doing a normal acquisition
+      if (m_darkBuild || m_flatBuild) {
+        error = m_darkBuild ? !buildMasterDark() : !buildMasterFlat();
+        m_darkBuild = false;
+        m_flatBuild = false;
+        m_aborted = false;
+        setIntegerParam(ADSBIGDarkBuildParam, 0);
+        setIntegerParam(ADSBIGFlatBuildParam, 0);
+        callParamCallbacks();
+        unlock();
+        continue;
+      }
+
+      epicsTimeGetCurrent(&acqStartTime);
+      lastFrameTime = acqStartTime;
+      m_haveLastStart = false;
+      getIntegerParam(ADSBIGTimeUSTimerParam, &useUSTimer);
+      p_Cam->SetUseUSTimer(useUSTimer ? TRUE : FALSE);
+
+      //Read the frame sizes 
+      getIntegerParam(ADMinX, &minX);
+      getIntegerParam(ADMinY, &minY);
+      getIntegerParam(ADSizeX, &sizeX);
+      getIntegerParam(ADSizeY, &sizeY);
+      p_Cam->SetSubFrame(minX, minY, sizeX, sizeY);
+
+      //Read the image mode. The frame size and readout mode are fixed for the whole acquisition.
+      getIntegerParam(ADImageMode, &imageMode);
+      getIntegerParam(ADNumImages, &numImages);
+
+      //Read what type of image we want - light field, dark field, or light field
+      //with a dark subtracted by the camera as it is read out?
+      int darkField = 0;
+      getIntegerParam(ADSBIGDarkFieldParam, &darkField);
+      SBIG_DARK_FRAME frameType = SBDF_LIGHT_ONLY;
+      if (darkField == ADSBIG_FRAME_DARK) {
+        frameType = SBDF_DARK_ONLY;
+      } else if (darkField == ADSBIG_FRAME_DARK_ALSO) {
+        frameType = SBDF_DARK_ALSO;
+      }
+      //In dark also mode the dark is kept so it can be reused by the next frames.
+      getIntegerParam(ADSBIGDarkRefreshParam, &darkRefresh);
+      darkAge = 0;
+      haveDark = false;
+      if (frameType == SBDF_DARK_ALSO) {
+        m_darkAlsoCache.resize(static_cast<size_t>(sizeX) * sizeY);
+      }
+
+      epicsTimeGetCurrent(&setupStartTime);
+      cam_err = p_Cam->GrabSetup(p_Img, frameType);
+      epicsTimeGetCurrent(&nowTime);
+      recordTiming(ADSBIG_STAGE_SETUP, epicsTimeDiffInSeconds(&nowTime, &setupStartTime));
+      if (cam_err != CE_NO_ERROR) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
                 "%s. CSBIGCam::GrabSetup returned an error. %s\n", 
               functionName, p_Cam->GetErrorString(cam_err).c_str());
         error = true;
         setStringParam(ADStatusMessage, p_Cam->GetErrorString(cam_err).c_str());
+        setIntegerParam(ADStatus, ADStatusError);
       } 
+      //GrabSetup sets the saturation level in the image header for the camera
+      //type (4095 for the 12-bit cameras). Only override it if the user asked to.
+      getIntegerParam(ADSBIGStatsSatLevelParam, &satLevel);
+      if (satLevel > 0) {
+        p_Img->SetSaturationLevel(static_cast<unsigned short>(satLevel));
+      }
+      setIntegerParam(ADSBIGStatsSatUsedParam, p_Img->GetSaturationLevel());
+
+      unsigned short binX = 0;
+      unsigned short binY = 0;
+      p_Img->GetBinning(binX, binY);
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " binX: %d\n", binY);
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " binY: %d\n", binX);
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " PixelHeight: %f\n", p_Img->GetPixelHeight());
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " PixelWidth: %f\n", p_Img->GetPixelWidth());
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Height: %d\n", p_Img->GetHeight());
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Width: %d\n", p_Img->GetWidth());
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Readout Mode: %d\n", p_Cam->GetReadoutMode());
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Dark Field: %d\n", darkField);
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Image Mode: %d\n", imageMode);
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " EGain: %f\n", p_Img->GetEGain());
+
+      //The electronic gain of the readout mode (e-/ADU), for Float32 frames in electrons
+      setDoubleParam(ADSBIGConvertEGainParam, p_Img->GetEGain());
+
+      //Find the master dark to subtract from each light frame during the readout.
+      //The flat field removes the pedestal, which is only there if the frames are dark subtracted.
+      m_pBandDark = NULL;
+      m_bandDarkPedestal = (frameType == SBDF_DARK_ALSO) ? ADSBIG_CAMERA_PEDESTAL : 0;
+      getIntegerParam(ADSBIGDarkSubtractParam, &darkSubtract);
+      if ((darkSubtract != 0) && (frameType == SBDF_LIGHT_ONLY)) {
+        m_pBandDark = m_darkLibrary.find(darkKey());
+        if (m_pBandDark != NULL) {
+          getIntegerParam(ADSBIGDarkPedestalParam, &darkPedestal);
+          m_bandDarkPedestal = static_cast<epicsUInt16>(darkPedestal);
+        } else {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, 
+                    "%s No master dark for these settings. Frames will not be dark subtracted.\n", functionName);
+        }
+      }
+      setIntegerParam(ADSBIGDarkMatchedParam, (m_pBandDark != NULL) ? 1 : 0);
+
+      //The master flat must have been taken with the same readout mode and subframe.
+      m_pBandGain = NULL;
+      getIntegerParam(ADSBIGFlatFieldParam, &flatField);
+      readoutMode = sbigReadoutMode(ADSBIG_ADDR_IMAGING);
+      if ((flatField != 0) && (frameType != SBDF_DARK_ONLY)) {
+        if (m_flatField.matches(readoutMode, minX, minY, sizeX, sizeY)) {
+          m_pBandGain = m_flatField.gain();
+        } else {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, 
+                    "%s No master flat for this readout mode and subframe. Frames will not be flat fielded.\n", functionName);
+        }
+      }
+      setIntegerParam(ADSBIGFlatMatchedParam, (m_pBandGain != NULL) ? 1 : 0);
+
+      //The Bayer pattern of the frames, from the CCD pattern, the subframe origin and the binning
+      getIntegerParam(ADSBIGDemosaicParam, &demosaic);
+      getIntegerParam(ADSBIGCCDBayerPatternParam, &ccdPattern);
+      bayerPattern = ADSBIGDemosaic::framePattern(ccdPattern, binX, binY, minX, minY);
+      if (bayerPattern != ADSBIG_BAYER_NONE) {
+        setIntegerParam(NDBayerPattern, bayerPattern);
+      } else if ((ccdPattern != ADSBIG_BAYER_NONE) && (demosaic != ADSBIG_DEMOSAIC_NONE)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, 
+                  "%s Binned frames have no Bayer pattern. Frames will not be demosaiced.\n", functionName);
+      }
+
+      acquiring = !error;
+
+      //Focus mode loops light frames of the subframe with its own lean frame loop.
+      getIntegerParam(ADSBIGFocusParam, &focusMode);
+      if (acquiring && (focusMode != 0)) {
+        error = !focusAcquire(sizeX, sizeY, imageMode, numImages);
+        acquiring = false;
+      }
+
+      while (acquiring) {
+
+        //Read the output data type. This can change between frames.
+        int arrayCallbacks = 0;
+        getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+        getIntegerParam(NDDataType, &iDataType);
+        dataType = static_cast<NDDataType_t>(iDataType);
+        if (dataType == NDUInt8) {
+          dataSize = sizeX*sizeY*sizeof(epicsUInt8);
+        } else if (dataType == NDUInt16) {
+          dataSize = sizeX*sizeY*sizeof(epicsUInt16);
+        } else if (dataType == NDUInt32) {
+          dataSize = sizeX*sizeY*sizeof(epicsUInt32);
+        } else if (dataType == NDInt32) {
+          dataSize = sizeX*sizeY*sizeof(epicsInt32);
+        } else if (dataType == NDFloat32) {
+          dataSize = sizeX*sizeY*sizeof(epicsFloat32);
+        } else {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                    "%s. ERROR: We can't handle this data type. dataType: %d\n", 
+                    functionName, dataType);
+          error = true;
+          dataSize = 0;
+          setIntegerParam(ADStatus, ADStatusError);
+          break;
+        }
+        setIntegerParam(NDArraySize, dataSize);
+
+        //Co-added exposures are summed into 32 bit pixels, so that they don't overflow.
+        getIntegerParam(ADNumExposures, &numExposures);
+        if ((numExposures > 1) && (dataType != NDUInt32) && (dataType != NDInt32) && (dataType != NDFloat32)) {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                    "%s. ERROR: NumExposures > 1 needs the UInt32, Int32 or Float32 data type. dataType: %d\n", 
+                    functionName, dataType);
+          error = true;
+          setStringParam(ADStatusMessage, "NumExposures > 1 needs UInt32, Int32 or Float32");
+          setIntegerParam(ADStatus, ADStatusError);
+          break;
+        }
+        if (numExposures < 1) {
+          numExposures = 1;
+        }
+
+        //For the native data type we read the lines straight into an NDArray
+        //from the pool, so that frames reach the plugins without a copy. 
+        //Otherwise we read into the class library image buffer and convert
+        //into the NDArray in processBand.
+        dims[0] = sizeX;
+        dims[1] = sizeY;
+        pArray = NULL;
+        unsigned short *pDest = NULL;
+        if (arrayCallbacks) {
+          if ((pArray = this->pNDArrayPool->alloc(nDims, dims, dataType, 0, NULL)) == NULL) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                      "%s. ERROR: pArray is NULL.\n", 
+                      functionName);
+          } else if (dataType == NDUInt16) {
+            pDest = static_cast<unsigned short *>(pArray->pData);
+          }
+        }
+
+        //Set up the band processing. In streaming mode this runs during the readout.
+        getIntegerParam(ADSBIGStreamingParam, &streaming);
+        getIntegerParam(ADSBIGBandLinesParam, &bandLines);
+        getIntegerParam(ADSBIGStatsEnableParam, &statsEnable);
+        m_bandStats = (statsEnable != 0);
+
+        //UInt8 frames are scaled from the black to the white level. The auto levels are 
+        //the auto contrast background and range of the last frame, so they need the statistics.
+        if (dataType == NDUInt8) {
+          setConvertLevels();
+        }
+        //Float32 frames can be scaled to electrons, with the pedestal removed
+        m_bandElectrons = 0.0f;
+        if (dataType == NDFloat32) {
+          getIntegerParam(ADSBIGConvertElectronsParam, &convertElectrons);
+          getDoubleParam(ADSBIGConvertEGainParam, &eGain);
+          if ((convertElectrons != 0) && (eGain > 0.0)) {
+            m_bandElectrons = static_cast<epicsFloat32>(eGain);
+          }
+        }
+        if (m_bandStats) {
+          getIntegerParam(ADSBIGStatsSatUsedParam, &satLevel);
+          m_stats.reset(static_cast<epicsUInt16>(satLevel));
+        }
 
-      unsigned short binX = 0;
-      unsigned short binY = 0;
-      p_Img->GetBinning(binX, binY);
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " binX: %d\n", binY);
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " binY: %d\n", binX);
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " PixelHeight: %f\n", p_Img->GetPixelHeight());
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " PixelWidth: %f\n", p_Img->GetPixelWidth());
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Height: %d\n", p_Img->GetHeight());
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Width: %d\n", p_Img->GetWidth());
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Readout Mode: %d\n", p_Cam->GetReadoutMode());
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, " Dark Field: %d\n", darkField);
+        epicsTimeGetCurrent(&frameStartTime);
+        m_frameStartTime = frameStartTime;
+        midTime = frameStartTime;
+        setIntegerParam(ADStatus, ADStatusAcquire);
+        setIntegerParam(ADNumExposuresCounter, 0);
+        exposureTime = 0.0;
+        expectedTime = 0.0;
+        readoutTime = 0.0;
+        readoutLines = 0;
+        convertTime = 0.0;
+        flatTime = 0.0;
+        getDoubleParam(ADAcquireTime, &acquireTime);
+        startPreview(sizeX, sizeY);
 
-      if (!error) {
+        //Do the exposures. With more than one, each is added into the NDArray 
+        //as it is read out, and only the sum is published.
+        for (int exposure=0; (exposure<numExposures) && !m_aborted; ++exposure) {
+          m_bandAccumulate = (exposure > 0);
+          startBands(((pDest != NULL) ? pDest : p_Img->GetImagePointer()), pArray, 
+                     sizeX, sizeY, bandLines, (streaming != 0));
 
-        //Do exposure
-        callParamCallbacks();
-        unlock();
-        if (darkField > 0) {
-          cam_err = p_Cam->GrabMain(p_Img, SBDF_DARK_ONLY);
-        } else {
-          cam_err = p_Cam->GrabMain(p_Img, SBDF_LIGHT_ONLY);
+          setDoubleParam(ADSBIGPercentCompleteParam, 0.0);
+          callParamCallbacks();
+          //In dark also mode, take a new dark every darkRefresh frames (or only once if it is 0).
+          reuseDark = haveDark && ((darkRefresh == 0) || (darkAge < darkRefresh));
+          unlock();
+          if (frameType == SBDF_DARK_ALSO) {
+            cam_err = p_Cam->GrabMain(p_Img, frameType, pDest, &m_darkAlsoCache[0], reuseDark ? TRUE : FALSE);
+          } else {
+            cam_err = p_Cam->GrabMain(p_Img, frameType, pDest);
+          }
+          finishBands((cam_err != CE_NO_ERROR) || m_aborted);
+          lock();
+          if (frameType == SBDF_DARK_ALSO) {
+            setIntegerParam(ADSBIGDarkAgeParam, reuseDark ? darkAge : 0);
+            if ((cam_err != CE_NO_ERROR) || m_aborted) {
+              haveDark = false;
+            } else if (reuseDark) {
+              darkAge++;
+            } else {
+              haveDark = true;
+              darkAge = 1;
+            }
+          }
+          if ((cam_err != CE_NO_ERROR) || m_aborted) {
+            break;
+          }
+          setIntegerParam(ADNumExposuresCounter, exposure + 1);
+          addGrabTimes(exposure, acquireTime);
+
+          //Add up the time taken by each exposure. A dark also exposure with a new dark is two exposures.
+          exposureTime += p_Cam->GetExposureWallTime();
+          expectedTime += ((frameType == SBDF_DARK_ALSO) && !reuseDark) ? 2.0*acquireTime : acquireTime;
+          readoutTime += p_Cam->GetReadoutTime();
+          readoutLines += p_Cam->GetReadoutLines();
+          convertTime += m_bandProcTime;
+          flatTime += m_bandFlatTime;
         }
-        lock();
+        if ((cam_err == CE_NO_ERROR) && !m_aborted && m_bandStats) {
+          publishStats(pArray);
+        }
+        if ((cam_err == CE_NO_ERROR) && !m_aborted) {
+          publishGrabTimes(pArray, midTime);
+        }
+        //Colour frames are published as RGB1, or tagged with their Bayer pattern if they are not demosaiced
+        colorMode = NDColorModeMono;
+        if ((cam_err == CE_NO_ERROR) && !m_aborted && (pArray != NULL) && (bayerPattern != ADSBIG_BAYER_NONE)) {
+          colorMode = NDColorModeBayer;
+          if (demosaic != ADSBIG_DEMOSAIC_NONE) {
+            pArray = demosaicArray(pArray, demosaic, bayerPattern);
+            if (pArray->ndims == 3) {
+              colorMode = NDColorModeRGB1;
+            }
+          }
+          pArray->pAttributeList->add("BayerPattern", "Bayer pattern", NDAttrInt32, &bayerPattern);
+        }
+        if (pArray != NULL) {
+          pArray->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
+          if (dataType == NDUInt8) {
+            epicsInt32 black = m_bandBlack;
+            epicsInt32 white = m_bandWhite;
+            pArray->pAttributeList->add("ConvertBlack", "UInt8 black level", NDAttrInt32, &black);
+            pArray->pAttributeList->add("ConvertWhite", "UInt8 white level", NDAttrInt32, &white);
+          } else if (m_bandElectrons > 0.0f) {
+            pArray->pAttributeList->add("EGain", "Electronic gain (e-/ADU) the frame is scaled by", NDAttrFloat64, &eGain);
+          }
+        }
+        setIntegerParam(NDColorMode, colorMode);
+        setIntegerParam(NDArraySize, (colorMode == NDColorModeRGB1) ? 3*dataSize : dataSize);
         if (cam_err != CE_NO_ERROR) {
           asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
                     "%s. CSBIGCam::GrabMain returned an error. %s\n", 
@@ -539,13 +3542,48 @@ void ADSBIG::readoutTask(void)
         }
 
         setDoubleParam(ADSBIGPercentCompleteParam, 100.0);
+        //Number of exposure complete queries sent to the camera, and the CPU time spent waiting.
+        setIntegerParam(ADSBIGExpPollsParam, static_cast<epicsInt32>(p_Cam->GetExposurePollCount()));
+        setDoubleParam(ADSBIGExpCPUTimeParam, p_Cam->GetExposureWaitCPUTime() * 1000.0);
 
         if (!m_aborted) { 
-        
-        unsigned short *pData = p_Img->GetImagePointer();
-        
-        //printf("%s Time after acqusition: ", functionName);
-        //epicsTime::getCurrent().show(0);
+
+        //Achieved frame rate and dead time (the part of each frame period not spent exposing).
+        epicsTimeGetCurrent(&nowTime);
+        framePeriod = epicsTimeDiffInSeconds(&nowTime, &lastFrameTime);
+        lastFrameTime = nowTime;
+        if (framePeriod > 0) {
+          setDoubleParam(ADSBIGFrameRateParam, 1.0/framePeriod);
+          setDoubleParam(ADSBIGDeadTimeParam, ((framePeriod > numExposures*acquireTime) ? (framePeriod - numExposures*acquireTime) : 0.0));
+        }
+
+        //Where the time went for this frame. The exposure is compared with the requested time.
+        if (!error) {
+          recordTiming(ADSBIG_STAGE_EXPOSURE, exposureTime);
+          setDoubleParam(ADSBIGExpErrorParam, (exposureTime - expectedTime) * 1000.0);
+          recordTiming(ADSBIG_STAGE_READOUT, readoutTime);
+          if (readoutTime > 0) {
+            setDoubleParam(ADSBIGReadoutRateParam, readoutLines / readoutTime);
+          }
+          addReadoutTime(ADSBIG_ADDR_IMAGING, p_Cam->GetReadoutMode(), readoutTime, 
+                         static_cast<double>(readoutLines) * sizeX);
+          if (m_bandCount > 0) {
+            recordTiming(ADSBIG_STAGE_CONVERT, convertTime);
+          }
+          setDoubleParam(ADSBIGFlatTimeParam, flatTime * 1000.0);
+        }
+
+        //Band processing latency, and how much of the processing was hidden behind the readout.
+        if (m_bandCount > 0) {
+          setDoubleParam(ADSBIGBandLatencyParam, (m_bandLatencySum / m_bandCount) * 1000.0);
+          setDoubleParam(ADSBIGBandLatencyMaxParam, m_bandLatencyMax * 1000.0);
+          setDoubleParam(ADSBIGProcTailParam, m_bandTailTime * 1000.0);
+          if ((m_bandProcTime > 0) && (m_bandProcTime > m_bandTailTime)) {
+            setDoubleParam(ADSBIGProcHiddenParam, ((m_bandProcTime - m_bandTailTime) / m_bandProcTime) * 100.0);
+          } else {
+            setDoubleParam(ADSBIGProcHiddenParam, 0.0);
+          }
+        }
 
         //Update counters
         getIntegerParam(NDArrayCounter, &imageCounter);
@@ -556,67 +3594,76 @@ void ADSBIG::readoutTask(void)
         setIntegerParam(ADNumImagesCounter, numImagesCounter);
 
         //NDArray callbacks
-        int arrayCallbacks = 0;
-        getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
-        getIntegerParam(NDDataType, &iDataType);
-        dataType = static_cast<NDDataType_t>(iDataType);
-        if (dataType == NDUInt8) {
-          dataSize = sizeX*sizeY*sizeof(epicsUInt8);
-        } else if (dataType == NDUInt16) {
-          dataSize = sizeX*sizeY*sizeof(epicsUInt16);
-        } else if (dataType == NDUInt32) {
-          dataSize = sizeX*sizeY*sizeof(epicsUInt32);
-        } else {
-          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-                    "%s. ERROR: We can't handle this data type. dataType: %d\n", 
-                    functionName, dataType);
-          error = true;
-          dataSize = 0;
-        }
-        setIntegerParam(NDArraySize, dataSize);
-        
         if (!error) {
           
+          if (m_bandPreview) {
+            publishPreview(imageCounter, midTime);
+          }
           if (arrayCallbacks) {
-            //Allocate an NDArray
-            dims[0] = sizeX;
-            dims[1] = sizeY;
-            if ((pArray = this->pNDArrayPool->alloc(nDims, dims, dataType, 0, NULL)) == NULL) {
-              asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-                        "%s. ERROR: pArray is NULL.\n", 
-                        functionName);
-            } else {
-              epicsTimeGetCurrent(&nowTime);
+            if (pArray != NULL) {
               pArray->uniqueId = imageCounter;
-              pArray->timeStamp = nowTime.secPastEpoch + nowTime.nsec / 1.e9;
+              pArray->timeStamp = midTime.secPastEpoch + midTime.nsec / 1.e9;
               updateTimeStamp(&pArray->epicsTS);
-              //Get any attributes that have been defined for this driver
-              this->getAttributes(pArray->pAttributeList);
-              //We copy data because the SBIG class library holds onto the original buffer until the next acqusition
-              asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
-                        "%s: Copying data. dataSize: %d\n", functionName, dataSize);
-              memcpy(pArray->pData, pData, dataSize);
-                
-              unlock();
-              asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Calling NDArray callback\n", functionName);
-              doCallbacksGenericPointer(pArray, NDArrayData, 0);
-              lock();
-              pArray->release();
+              //The publisher thread does the attributes and callbacks, and releases the array.
+              publishArray(pArray, NULL);
+              pArray = NULL;
             }
             
           }
           
-          setIntegerParam(ADStatus, ADStatusIdle);
-          
         } else {
           setIntegerParam(ADStatus, ADStatusError);
         }
 
         } else { //end if (!m_aborted)
           setIntegerParam(ADStatus, ADStatusAborted);
-          m_aborted = false;
         }
-        
+        m_bandPreview = false;
+
+        if (pArray != NULL) {
+          pArray->release();
+          pArray = NULL;
+        }
+
+        //Decide if we are done, or need to wait for the next acquire period.
+        if (error || m_aborted) {
+          acquiring = false;
+        } else if (imageMode == ADImageSingle) {
+          acquiring = false;
+        } else if ((imageMode == ADImageMultiple) && (numImagesCounter >= numImages)) {
+          acquiring = false;
+        }
+
+        if (acquiring) {
+          getDoubleParam(ADAcquirePeriod, &acquirePeriod);
+          epicsTimeGetCurrent(&nowTime);
+          delay = acquirePeriod - epicsTimeDiffInSeconds(&nowTime, &frameStartTime);
+          if (delay > 0) {
+            setIntegerParam(ADStatus, ADStatusWaiting);
+            callParamCallbacks();
+            unlock();
+            //abortExposure signals the stop event, so this returns early on a stop.
+            epicsEventWaitWithTimeout(m_stopEvent, delay);
+            lock();
+            if (m_aborted) {
+              setIntegerParam(ADStatus, ADStatusAborted);
+              acquiring = false;
+            }
+          }
+        }
+
+      } //end of while(acquiring)
+
+      m_aborted = false;
+      m_pBandDark = NULL;
+      m_pBandGain = NULL;
+
+      //Make sure all the frames have been delivered before we complete the acquisition.
+      waitForPublisher();
+
+      getIntegerParam(ADStatus, &adStatus);
+      if ((adStatus != ADStatusError) && (adStatus != ADStatusAborted)) {
+        setIntegerParam(ADStatus, ADStatusIdle);
       }
       
       callParamCallbacks();
@@ -638,23 +3685,307 @@ void ADSBIG::readoutTask(void)
 }
 
 /**
- * polling thread function
+ * Called by the class library, from the tracking thread, to sleep while
+ * waiting for a tracking exposure to complete.
+ * @param seconds The maximum time to sleep
+ */
+void ADSBIG::trackWait(double seconds)
+{
+  epicsEventWaitWithTimeout(m_trackStopEvent, seconds);
+}
+
+/**
+ * Wait until a tracking frame can be taken without holding up the imaging 
+ * CCD. That is when the imaging CCD is not acquiring, or when its exposure 
+ * has long enough left to run for the whole tracking frame. Otherwise we wait
+ * for the imaging readout to finish. This is called without the driver lock.
+ * @param frameTime The expected tracking exposure plus readout time (seconds)
+ * @param waited Returns the time spent waiting (seconds)
+ * @param deferred Returns true if the frame had to wait for the imaging CCD
+ * @return false if the tracking acquisition was aborted while waiting
+ */
+bool ADSBIG::waitForTrackingGap(double frameTime, double &waited, bool &deferred)
+{
+  GRAB_STATE camState = GS_IDLE;
+  double camPercentComplete = 0.0;
+  epicsTimeStamp startTime;
+  epicsTimeStamp nowTime;
+
+  epicsTimeGetCurrent(&startTime);
+  deferred = false;
+  while (!m_trackAborted) {
+    p_Cam->GetGrabState(camState, camPercentComplete);
+    if ((camState == GS_EXPOSING_LIGHT) || (camState == GS_EXPOSING_DARK)) {
+      if (p_Cam->GetExposureRemaining() > (frameTime + ADSBIG_TRACK_MARGIN)) {
+        break;
+      }
+    } else if ((camState != GS_DIGITIZING_LIGHT) && (camState != GS_DIGITIZING_DARK)) {
+      break;
+    }
+    deferred = true;
+    epicsEventWaitWithTimeout(m_trackStopEvent, ADSBIG_TRACK_POLL);
+  }
+  epicsTimeGetCurrent(&nowTime);
+  waited = epicsTimeDiffInSeconds(&nowTime, &startTime);
+
+  return !m_trackAborted;
+}
+
+/**
+ * Tracking thread function
+ *
+ * Takes frames from the tracking CCD and publishes them on asyn address 1.
+ * Each frame is fitted into a gap in the imaging CCD's exposure, since the 
+ * two CCDs can't be read out at the same time. The frames are always UInt16.
+ */
+void ADSBIG::trackTask(void)
+{
+  const int addr = ADSBIG_ADDR_TRACKING;
+  bool acquiring = false;
+  bool deferred = false;
+  size_t dims[2];
+  int nDims = 2;
+  epicsInt32 sizeX = 0;
+  epicsInt32 sizeY = 0;
+  epicsInt32 minX = 0;
+  epicsInt32 minY = 0;
+  epicsInt32 readoutMode = 0;
+  epicsInt32 imageMode = 0;
+  epicsInt32 numImages = 0;
+  epicsInt32 numImagesCounter = 0;
+  epicsInt32 imageCounter = 0;
+  epicsInt32 arrayCallbacks = 0;
+  epicsInt32 numDeferred = 0;
+  epicsInt32 adStatus = 0;
+  epicsFloat64 acquireTime = 0.0;
+  epicsFloat64 acquirePeriod = 0.0;
+  epicsFloat64 framePeriod = 0.0;
+  epicsFloat64 waited = 0.0;
+  epicsFloat64 delay = 0.0;
+  epicsTimeStamp nowTime;
+  epicsTimeStamp frameStartTime;
+  epicsTimeStamp lastFrameTime;
+  epicsTimeStamp midTime;
+  NDArray *pArray = NULL;
+  unsigned short *pDest = NULL;
+  PAR_ERROR cam_err = CE_NO_ERROR;
+
+  const char* functionName = "ADSBIG::trackTask";
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Tracking Thread.\n", functionName);
+
+  while (1) {
+
+    //Clear any stop event that was done after the last acquisition.
+    epicsEventWaitWithTimeout(m_trackStopEvent, 0.001);
+
+    epicsEventWait(m_trackStartEvent);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Got Start Event.\n", functionName);
+
+    lock();
+    setIntegerParam(addr, ADNumImagesCounter, 0);
+    setDoubleParam(addr, ADSBIGFrameRateParam, 0.0);
+    setStringParam(addr, ADStatusMessage, " ");
+
+    //The frame size and readout mode are fixed for the whole acquisition.
+    getIntegerParam(addr, ADMinX, &minX);
+    getIntegerParam(addr, ADMinY, &minY);
+    getIntegerParam(addr, ADSizeX, &sizeX);
+    getIntegerParam(addr, ADSizeY, &sizeY);
+    readoutMode = sbigReadoutMode(addr);
+    getIntegerParam(addr, ADImageMode, &imageMode);
+    getIntegerParam(addr, ADNumImages, &numImages);
+    p_Track->SetReadoutMode(static_cast<unsigned short>(readoutMode));
+    p_Track->SetSubFrame(minX, minY, sizeX, sizeY);
+    callParamCallbacks(addr);
+    unlock();
+
+    cam_err = p_Track->GrabSetup(p_TrackImg, SBDF_LIGHT_ONLY);
+
+    lock();
+    acquiring = true;
+    if (cam_err != CE_NO_ERROR) {
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                "%s. CSBIGCam::GrabSetup returned an error. %s\n", 
+                functionName, p_Track->GetErrorString(cam_err).c_str());
+      setStringParam(addr, ADStatusMessage, p_Track->GetErrorString(cam_err).c_str());
+      setIntegerParam(addr, ADStatus, ADStatusError);
+      acquiring = false;
+    }
+    //An empty subframe is the full frame
+    sizeX = p_TrackImg->GetWidth();
+    sizeY = p_TrackImg->GetHeight();
+    epicsTimeGetCurrent(&lastFrameTime);
+
+    while (acquiring) {
+
+      getIntegerParam(addr, NDArrayCallbacks, &arrayCallbacks);
+      getDoubleParam(addr, ADAcquireTime, &acquireTime);
+      setIntegerParam(addr, ADStatus, ADStatusWaiting);
+      callParamCallbacks(addr);
+      unlock();
+
+      //Wait for a gap in the imaging CCD's exposure long enough for this frame.
+      acquiring = waitForTrackingGap(acquireTime + m_trackReadoutTime, waited, deferred);
+      //Don't move the shutter while the imaging CCD is exposing.
+      p_Track->SetLightShutter((p_Cam->GetExposureRemaining() > 0.0) ? SC_LEAVE_SHUTTER : SC_OPEN_SHUTTER);
+
+      lock();
+      if (!acquiring) {
+        setIntegerParam(addr, ADStatus, ADStatusAborted);
+        break;
+      }
+      setDoubleParam(addr, ADSBIGTrackWaitParam, waited * 1000.0);
+      if (deferred) {
+        getIntegerParam(addr, ADSBIGTrackDeferredParam, &numDeferred);
+        setIntegerParam(addr, ADSBIGTrackDeferredParam, numDeferred + 1);
+      }
+
+      //Read the lines straight into an NDArray from the pool
+      dims[0] = sizeX;
+      dims[1] = sizeY;
+      pArray = NULL;
+      pDest = NULL;
+      if (arrayCallbacks) {
+        if ((pArray = this->pNDArrayPool->alloc(nDims, dims, NDUInt16, 0, NULL)) == NULL) {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                    "%s. ERROR: pArray is NULL.\n", 
+                    functionName);
+        } else {
+          pDest = static_cast<unsigned short *>(pArray->pData);
+        }
+      }
+
+      epicsTimeGetCurrent(&frameStartTime);
+      setIntegerParam(addr, ADStatus, ADStatusAcquire);
+      callParamCallbacks(addr);
+      unlock();
+      cam_err = p_Track->GrabMain(p_TrackImg, SBDF_LIGHT_ONLY, pDest);
+      lock();
+      m_trackReadoutTime = p_Track->GetReadoutTime();
+
+      if (m_trackAborted) {
+        setIntegerParam(addr, ADStatus, ADStatusAborted);
+        acquiring = false;
+      } else if (cam_err != CE_NO_ERROR) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                  "%s. CSBIGCam::GrabMain returned an error. %s\n", 
+                  functionName, p_Track->GetErrorString(cam_err).c_str());
+        setStringParam(addr, ADStatusMessage, p_Track->GetErrorString(cam_err).c_str());
+        setIntegerParam(addr, ADStatus, ADStatusError);
+        acquiring = false;
+      } else {
+        epicsTimeGetCurrent(&nowTime);
+        framePeriod = epicsTimeDiffInSeconds(&nowTime, &lastFrameTime);
+        lastFrameTime = nowTime;
+        if (framePeriod > 0) {
+          setDoubleParam(addr, ADSBIGFrameRateParam, 1.0/framePeriod);
+        }
+        addReadoutTime(addr, readoutMode, m_trackReadoutTime, 
+                       static_cast<double>(p_Track->GetReadoutLines()) * sizeX);
+
+        getIntegerParam(addr, NDArrayCounter, &imageCounter);
+        imageCounter++;
+        setIntegerParam(addr, NDArrayCounter, imageCounter);
+        getIntegerParam(addr, ADNumImagesCounter, &numImagesCounter);
+        numImagesCounter++;
+        setIntegerParam(addr, ADNumImagesCounter, numImagesCounter);
+        setIntegerParam(addr, NDArraySizeX, sizeX);
+        setIntegerParam(addr, NDArraySizeY, sizeY);
+        setIntegerParam(addr, NDArraySize, sizeX*sizeY*sizeof(epicsUInt16));
+
+        //The frames are small, so the callbacks are done from this thread.
+        if (pArray != NULL) {
+          grabMidpoint(p_Track->GetGrabTimes(), midTime);
+          pArray->uniqueId = imageCounter;
+          pArray->timeStamp = midTime.secPastEpoch + midTime.nsec / 1.e9;
+          updateTimeStamp(&pArray->epicsTS);
+          this->getAttributes(pArray->pAttributeList);
+          callParamCallbacks(addr);
+          unlock();
+          doCallbacksGenericPointer(pArray, NDArrayData, addr);
+          lock();
+        }
+
+        if (imageMode == ADImageSingle) {
+          acquiring = false;
+        } else if ((imageMode == ADImageMultiple) && (numImagesCounter >= numImages)) {
+          acquiring = false;
+        }
+      }
+
+      if (pArray != NULL) {
+        pArray->release();
+        pArray = NULL;
+      }
+
+      if (acquiring) {
+        getDoubleParam(addr, ADAcquirePeriod, &acquirePeriod);
+        epicsTimeGetCurrent(&nowTime);
+        delay = acquirePeriod - epicsTimeDiffInSeconds(&nowTime, &frameStartTime);
+        if (delay > 0) {
+          setIntegerParam(addr, ADStatus, ADStatusWaiting);
+          callParamCallbacks(addr);
+          unlock();
+          epicsEventWaitWithTimeout(m_trackStopEvent, delay);
+          lock();
+          if (m_trackAborted) {
+            setIntegerParam(addr, ADStatus, ADStatusAborted);
+            acquiring = false;
+          }
+        }
+      }
+
+    } //end of while(acquiring)
+
+    m_trackAborted = false;
+    getIntegerParam(addr, ADStatus, &adStatus);
+    if ((adStatus != ADStatusError) && (adStatus != ADStatusAborted)) {
+      setIntegerParam(addr, ADStatus, ADStatusIdle);
+      setStringParam(addr, ADStatusMessage, "Idle");
+    }
+    //Complete Acquire callback
+    setIntegerParam(addr, ADAcquire, 0);
+    callParamCallbacks(addr);
+    unlock();
+
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+              "%s Completed tracking acqusition.\n", functionName);
+
+  } //end of while(1)
+
+}
+
+/**
+ * Telemetry thread function. Each camera telemetry item is read at its own 
+ * rate. The camera is never asked while a CCD is being read out (the read is
+ * deferred instead), and the port lock is never held while asking it. The 
+ * readout progress is pushed by the readout thread and published from here.
  */
-void ADSBIG::pollingTask(void)
+void ADSBIG::telemetryTask(void)
 {
-  epicsFloat64 timeout = 1.0;
   PAR_ERROR cam_err = CE_NO_ERROR;
   MY_LOGICAL te_status = FALSE;
   double ccd_temp_set = 0.0;
   double ccd_temp = 0.0;
   double te_power = 0.0;
+  GetLinkStatusResults linkStatus;
+  ADSBIGTelemetryValues values;
+  epicsTimeStamp now;
+  double wait = 0.0;
+  double period = 0.0;
+  int adStatus = 0;
+  bool tempDue = false;
+  bool teDue = false;
+  bool linkDue = false;
 
-  const char* functionName = "ADSBIG::pollingTask";
-  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Polling Thread.\n", functionName);
+  const char* functionName = "ADSBIG::telemetryTask";
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s Started Telemetry Thread.\n", functionName);
 
   while (1) {
 
-    epicsThreadSleep(timeout);
+    //Wake up when the next item is due, when the readout thread pushes 
+    //its progress, or when a period is changed.
+    epicsEventWaitWithTimeout(m_telemEvent, wait);
 
     //Sanity checks
     if ((p_Cam == NULL) || (p_Img == NULL)) {
@@ -664,44 +3995,137 @@ void ADSBIG::pollingTask(void)
 
     lock();
 
-    GRAB_STATE camState = GS_IDLE;
-    double camPercentComplete = 0.0;
-    int adStatus = 0;
-    getIntegerParam(ADStatus, &adStatus);
-    if ((adStatus == ADStatusAcquire || adStatus == ADStatusReadout)) {
-      p_Cam->GetGrabState(camState, camPercentComplete);
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
-                "%s Cam State: %d. Percent Complete: %f\n", 
-                functionName, camState, (camPercentComplete*100.0));
-      if ((camState == GS_DIGITIZING_DARK) || (camState == GS_DIGITIZING_LIGHT)) {
+    getDoubleParam(ADSBIGTempPeriodParam, &period);
+    m_telemSchedule.setPeriod(ADSBIG_TELEM_TEMPERATURE, period);
+    getDoubleParam(ADSBIGTEPeriodParam, &period);
+    m_telemSchedule.setPeriod(ADSBIG_TELEM_TE_POWER, period);
+    getDoubleParam(ADSBIGLinkPeriodParam, &period);
+    m_telemSchedule.setPeriod(ADSBIG_TELEM_LINK, period);
+
+    //The readout thread clears any pending progress (with the lock held) when
+    //it starts a frame, so this can't be left over from the last one.
+    if (epicsAtomicGetIntT(&m_progressPending) != 0) {
+      epicsAtomicSetIntT(&m_progressPending, 0);
+      getIntegerParam(ADStatus, &adStatus);
+      if ((adStatus == ADStatusAcquire) || (adStatus == ADStatusReadout)) {
         setIntegerParam(ADStatus, ADStatusReadout);
+        setDoubleParam(ADSBIGPercentCompleteParam, epicsAtomicGetIntT(&m_progressPercent) / 100.0);
+        callParamCallbacks();
       }
-      setDoubleParam(ADSBIGPercentCompleteParam, (camPercentComplete*100.0));
-    } else {
-      if ((cam_err = p_Cam->QueryTemperatureStatus(te_status, ccd_temp, ccd_temp_set, te_power)) != CE_NO_ERROR) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-                  "%s. CSBIGCam::QueryTemperatureStatus returned an error. %s\n", 
-                  functionName, p_Cam->GetErrorString(cam_err).c_str());
+    }
+
+    unlock();
+
+    epicsTimeGetCurrent(&now);
+    tempDue = m_telemSchedule.due(ADSBIG_TELEM_TEMPERATURE, now);
+    teDue = m_telemSchedule.due(ADSBIG_TELEM_TE_POWER, now);
+    linkDue = m_telemSchedule.due(ADSBIG_TELEM_LINK, now);
+
+    if (tempDue || teDue || linkDue) {
+      if (!p_Cam->TryLockReadout()) {
+        //A CCD is being read out. Try again shortly.
+        if (tempDue) {
+          m_telemSchedule.defer(ADSBIG_TELEM_TEMPERATURE, now, ADSBIG_TELEM_RETRY);
+        }
+        if (teDue) {
+          m_telemSchedule.defer(ADSBIG_TELEM_TE_POWER, now, ADSBIG_TELEM_RETRY);
+        }
+        if (linkDue) {
+          m_telemSchedule.defer(ADSBIG_TELEM_LINK, now, ADSBIG_TELEM_RETRY);
+        }
+        values.deferred++;
       } else {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
-                  "%s Temperature Status: %d, %f, %f, %f\n", 
-                  functionName, te_status, ccd_temp, ccd_temp_set, te_power);
-        setDoubleParam(ADTemperatureActual, ccd_temp);
-        setDoubleParam(ADTemperature, ccd_temp_set);
-        setIntegerParam(ADSBIGTEStatusParam, te_status);
-        setDoubleParam(ADSBIGTEPowerParam, te_power*100.0);
+        //The temperature and TE power come from the same command
+        if (tempDue || teDue) {
+          if ((cam_err = p_Cam->QueryTemperatureStatus(te_status, ccd_temp, ccd_temp_set, te_power)) != CE_NO_ERROR) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                      "%s. CSBIGCam::QueryTemperatureStatus returned an error. %s\n", 
+                      functionName, p_Cam->GetErrorString(cam_err).c_str());
+          } else {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
+                      "%s Temperature Status: %d, %f, %f, %f\n", 
+                      functionName, te_status, ccd_temp, ccd_temp_set, te_power);
+            if (tempDue) {
+              values.tempValid = true;
+              values.ccdTemp = ccd_temp;
+              values.ccdTempSetpoint = ccd_temp_set;
+            }
+            if (teDue) {
+              values.teValid = true;
+              values.teEnabled = te_status;
+              values.tePower = te_power*100.0;
+            }
+          }
+          if (tempDue) {
+            m_telemSchedule.done(ADSBIG_TELEM_TEMPERATURE, now);
+          }
+          if (teDue) {
+            m_telemSchedule.done(ADSBIG_TELEM_TE_POWER, now);
+          }
+        }
+        if (linkDue) {
+          if ((cam_err = p_Cam->GetLinkStatus(linkStatus)) != CE_NO_ERROR) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                      "%s. CSBIGCam::GetLinkStatus returned an error. %s\n", 
+                      functionName, p_Cam->GetErrorString(cam_err).c_str());
+            values.linkEstablished = 0;
+          } else {
+            values.linkEstablished = linkStatus.linkEstablished ? 1 : 0;
+            values.comFailed = linkStatus.comFailed;
+          }
+          values.linkValid = true;
+          m_telemSchedule.done(ADSBIG_TELEM_LINK, now);
+        }
+        p_Cam->UnlockReadout();
       }
-    }
 
-    callParamCallbacks();
+      m_telemetry.write(values);
+      lock();
+      publishTelemetry(values);
+      unlock();
+    }
 
-    unlock();
+    epicsTimeGetCurrent(&now);
+    wait = m_telemSchedule.timeToNext(now, ADSBIG_TELEM_MAX_WAIT);
 
   }
 
   asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s: ERROR: Exiting ADSBIGPollingTask main loop.\n", functionName);
+            "%s: ERROR: Exiting ADSBIGTelemetryTask main loop.\n", functionName);
+
+}
+
+/**
+ * Copy the camera telemetry into the params. Call this with the lock held.
+ * @param values The telemetry values
+ */
+void ADSBIG::publishTelemetry(const ADSBIGTelemetryValues &values)
+{
+  if (values.tempValid) {
+    setDoubleParam(ADTemperatureActual, values.ccdTemp);
+    setDoubleParam(ADTemperature, values.ccdTempSetpoint);
+  }
+  if (values.teValid) {
+    setIntegerParam(ADSBIGTEStatusParam, values.teEnabled);
+    setDoubleParam(ADSBIGTEPowerParam, values.tePower);
+  }
+  if (values.linkValid) {
+    setIntegerParam(ADSBIGLinkStatusParam, values.linkEstablished);
+    setIntegerParam(ADSBIGLinkErrorsParam, static_cast<epicsInt32>(values.comFailed));
+  }
+  setIntegerParam(ADSBIGTelemDeferredParam, values.deferred);
+  callParamCallbacks();
+}
 
+/**
+ * A CCD temperature reading no older than this is used for the frame header
+ * instead of asking the camera again.
+ * @param seconds The temperature telemetry period (0 always asks the camera)
+ */
+void ADSBIG::setTemperatureMaxAge(double seconds)
+{
+  p_Cam->SetTemperatureMaxAge(seconds);
+  p_Track->SetTemperatureMaxAge(seconds);
 }
 
 
@@ -712,11 +4136,59 @@ static void ADSBIGReadoutTaskC(void *drvPvt)
   
   pPvt->readoutTask();
 }
-static void ADSBIGPollingTaskC(void *drvPvt)
+static void ADSBIGTelemetryTaskC(void *drvPvt)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->telemetryTask();
+}
+static void ADSBIGBandTaskC(void *drvPvt)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->bandTask();
+}
+static void ADSBIGPublishTaskC(void *drvPvt)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->publishTask();
+}
+static void ADSBIGPreviewTaskC(void *drvPvt)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->previewTask();
+}
+static void ADSBIGLineCallbackC(void *drvPvt, int line)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->lineReady(line);
+}
+static void ADSBIGExposureWaitC(void *drvPvt, double seconds)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->exposureWait(seconds);
+}
+static void ADSBIGTrackTaskC(void *drvPvt)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->trackTask();
+}
+static void ADSBIGTrackWaitC(void *drvPvt, double seconds)
+{
+  ADSBIG *pPvt = (ADSBIG *)drvPvt;
+  
+  pPvt->trackWait(seconds);
+}
+static void ADSBIGFitsDoneC(void *drvPvt, const ADSBIGFitsResult &result)
 {
   ADSBIG *pPvt = (ADSBIG *)drvPvt;
   
-  pPvt->pollingTask();
+  pPvt->fitsDone(result);
 }
 
 
@@ -730,14 +4202,18 @@ extern "C" {
  * @param portName The Asyn port name to use
  * @param maxBuffers Used by asynPortDriver (set to -1 for unlimited)
  * @param maxMemory Used by asynPortDriver (set to -1 for unlimited)
+ * @param simulate Set to 1 to use a simulated camera instead of the SBIG driver (see ADSBIGSimConfig)
+ * @param usbSlot The USB slot of the camera, 0 to 7 for DEV_USB1 to DEV_USB8 (used if serialNumber is not set)
+ * @param serialNumber The serial number of the camera (NULL or empty to use usbSlot)
  */
-  asynStatus ADSBIGConfig(const char *portName, int maxBuffers, size_t maxMemory)
+  asynStatus ADSBIGConfig(const char *portName, int maxBuffers, size_t maxMemory, int simulate,
+                          int usbSlot, const char *serialNumber)
   {
     asynStatus status = asynSuccess;
     
     /*Instantiate class.*/
     try {
-      new ADSBIG(portName, maxBuffers, maxMemory);
+      new ADSBIG(portName, maxBuffers, maxMemory, simulate, usbSlot, serialNumber);
     } catch (...) {
       printf("Unknown exception caught when trying to construct ADSBIG.\n");
       status = asynError;
@@ -747,25 +4223,66 @@ extern "C" {
   }
 
 
+/**
+ * Publish the frames in a spool file again, through an existing driver (see ADSBIG::replaySpool).
+ * @param portName The Asyn port name of the driver
+ * @param fileName The spool file
+ */
+  asynStatus ADSBIGSpoolReplay(const char *portName, const char *fileName)
+  {
+    ADSBIG *pPvt = NULL;
+
+    //findAsynPortDriver finds any asynPortDriver, so check that it is an ADSBIG
+    if (portName != NULL) {
+      pPvt = dynamic_cast<ADSBIG *>(static_cast<asynPortDriver *>(findAsynPortDriver(portName)));
+    }
+    if (pPvt == NULL) {
+      printf("ADSBIGSpoolReplay: No ADSBIG port called %s.\n", (portName != NULL) ? portName : "");
+      return asynError;
+    }
+
+    return pPvt->replaySpool(fileName);
+  }
+
+
  /* Code for iocsh registration */
   
   /* ADSBIGConfig */
   static const iocshArg ADSBIGConfigArg0 = {"Port name", iocshArgString};
   static const iocshArg ADSBIGConfigArg1 = {"Max Buffers", iocshArgInt};
   static const iocshArg ADSBIGConfigArg2 = {"Max Memory", iocshArgInt};
+  static const iocshArg ADSBIGConfigArg3 = {"Simulate", iocshArgInt};
+  static const iocshArg ADSBIGConfigArg4 = {"USB Slot", iocshArgInt};
+  static const iocshArg ADSBIGConfigArg5 = {"Serial Number", iocshArgString};
   static const iocshArg * const ADSBIGConfigArgs[] =  {&ADSBIGConfigArg0,
                                                          &ADSBIGConfigArg1,
-                                                         &ADSBIGConfigArg2};
+                                                         &ADSBIGConfigArg2,
+                                                         &ADSBIGConfigArg3,
+                                                         &ADSBIGConfigArg4,
+                                                         &ADSBIGConfigArg5};
   
-  static const iocshFuncDef configADSBIG = {"ADSBIGConfig", 3, ADSBIGConfigArgs};
+  static const iocshFuncDef configADSBIG = {"ADSBIGConfig", 6, ADSBIGConfigArgs};
   static void configADSBIGCallFunc(const iocshArgBuf *args)
   {
-    ADSBIGConfig(args[0].sval, args[1].ival, args[2].ival);
+    ADSBIGConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival, args[5].sval);
+  }
+
+  /* ADSBIGSpoolReplay */
+  static const iocshArg ADSBIGSpoolReplayArg0 = {"Port name", iocshArgString};
+  static const iocshArg ADSBIGSpoolReplayArg1 = {"Spool File", iocshArgString};
+  static const iocshArg * const ADSBIGSpoolReplayArgs[] =  {&ADSBIGSpoolReplayArg0,
+                                                              &ADSBIGSpoolReplayArg1};
+  
+  static const iocshFuncDef replayADSBIGSpool = {"ADSBIGSpoolReplay", 2, ADSBIGSpoolReplayArgs};
+  static void replayADSBIGSpoolCallFunc(const iocshArgBuf *args)
+  {
+    ADSBIGSpoolReplay(args[0].sval, args[1].sval);
   }
 
   static void ADSBIGRegister(void)
   {
     iocshRegister(&configADSBIG, configADSBIGCallFunc);
+    iocshRegister(&replayADSBIGSpool, replayADSBIGSpoolCallFunc);
   }
   
   epicsExportRegistrar(ADSBIGRegister);
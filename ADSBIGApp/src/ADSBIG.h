@@ -13,6 +13,7 @@
 #define ADSBIG_H
 
 #include <stddef.h>
+#include <vector>
 
 #include <epicsTime.h>
 #include <epicsTypes.h>
@@ -21,38 +22,306 @@
 #include <epicsMutex.h>
 #include <epicsString.h>
 #include <epicsStdio.h>
+#include <epicsRingPointer.h>
 #include <cantProceed.h>
 
 #include <asynOctetSyncIO.h>
 
 #include "ADDriver.h"
 
+#include "ADSBIGDark.h"
+#include "ADSBIGFlat.h"
+#include "ADSBIGStats.h"
+#include "ADSBIGTelemetry.h"
+#include "ADSBIGFits.h"
+#include "ADSBIGCodec.h"
+#include "ADSBIGSpool.h"
+#include "ADSBIGDemosaic.h"
+#include "ADSBIGReadout.h"
+#include "ADSBIGPreview.h"
+#include "ADSBIGConvert.h"
+#include "ADSBIGJitter.h"
+
 #define ADSBIGFirstParamString              "ADSBIG_FIRST"
 #define ADSBIGDarkFieldParamString          "ADSBIG_DARK_FIELD"
 #define ADSBIGReadoutModeParamString        "ADSBIG_READOUT_MODE"
 #define ADSBIGPercentCompleteParamString    "ADSBIG_PERCENT_COMPLETE"
 #define ADSBIGTEStatusParamString           "ADSBIG_TE_STATUS"
 #define ADSBIGTEPowerParamString            "ADSBIG_TE_POWER"
+#define ADSBIGFrameRateParamString          "ADSBIG_FRAME_RATE"
+#define ADSBIGDeadTimeParamString           "ADSBIG_DEAD_TIME"
+#define ADSBIGStreamingParamString          "ADSBIG_STREAMING"
+#define ADSBIGBandLinesParamString          "ADSBIG_BAND_LINES"
+#define ADSBIGBandLatencyParamString        "ADSBIG_BAND_LATENCY"
+#define ADSBIGBandLatencyMaxParamString     "ADSBIG_BAND_LATENCY_MAX"
+#define ADSBIGProcTailParamString           "ADSBIG_PROC_TAIL"
+#define ADSBIGProcHiddenParamString         "ADSBIG_PROC_HIDDEN"
+#define ADSBIGExpPollsParamString           "ADSBIG_EXP_POLLS"
+#define ADSBIGExpCPUTimeParamString         "ADSBIG_EXP_CPU_TIME"
+#define ADSBIGPubQueueDepthParamString      "ADSBIG_PUB_QUEUE_DEPTH"
+#define ADSBIGPubQueueUsedParamString       "ADSBIG_PUB_QUEUE_USED"
+#define ADSBIGPubDropPolicyParamString      "ADSBIG_PUB_DROP_POLICY"
+#define ADSBIGPubDroppedParamString         "ADSBIG_PUB_DROPPED"
+#define ADSBIGPubQueueTimeParamString       "ADSBIG_PUB_QUEUE_TIME"
+#define ADSBIGPubAttrTimeParamString        "ADSBIG_PUB_ATTR_TIME"
+#define ADSBIGPubCallbackTimeParamString    "ADSBIG_PUB_CALLBACK_TIME"
+#define ADSBIGTimeSetupParamString          "ADSBIG_TIME_SETUP"
+#define ADSBIGTimeSetupMeanParamString      "ADSBIG_TIME_SETUP_MEAN"
+#define ADSBIGTimeSetupP99ParamString       "ADSBIG_TIME_SETUP_P99"
+#define ADSBIGTimeSetupHistParamString      "ADSBIG_TIME_SETUP_HIST"
+#define ADSBIGTimeExposureParamString       "ADSBIG_TIME_EXPOSURE"
+#define ADSBIGTimeExposureMeanParamString   "ADSBIG_TIME_EXPOSURE_MEAN"
+#define ADSBIGTimeExposureP99ParamString    "ADSBIG_TIME_EXPOSURE_P99"
+#define ADSBIGTimeExposureHistParamString   "ADSBIG_TIME_EXPOSURE_HIST"
+#define ADSBIGTimeReadoutParamString        "ADSBIG_TIME_READOUT"
+#define ADSBIGTimeReadoutMeanParamString    "ADSBIG_TIME_READOUT_MEAN"
+#define ADSBIGTimeReadoutP99ParamString     "ADSBIG_TIME_READOUT_P99"
+#define ADSBIGTimeReadoutHistParamString    "ADSBIG_TIME_READOUT_HIST"
+#define ADSBIGTimeConvertParamString        "ADSBIG_TIME_CONVERT"
+#define ADSBIGTimeConvertMeanParamString    "ADSBIG_TIME_CONVERT_MEAN"
+#define ADSBIGTimeConvertP99ParamString     "ADSBIG_TIME_CONVERT_P99"
+#define ADSBIGTimeConvertHistParamString    "ADSBIG_TIME_CONVERT_HIST"
+#define ADSBIGTimeCallbackParamString       "ADSBIG_TIME_CALLBACK"
+#define ADSBIGTimeCallbackMeanParamString   "ADSBIG_TIME_CALLBACK_MEAN"
+#define ADSBIGTimeCallbackP99ParamString    "ADSBIG_TIME_CALLBACK_P99"
+#define ADSBIGTimeCallbackHistParamString   "ADSBIG_TIME_CALLBACK_HIST"
+#define ADSBIGTimeHistBinsParamString       "ADSBIG_TIME_HIST_BINS"
+#define ADSBIGTimeResetParamString          "ADSBIG_TIME_RESET"
+#define ADSBIGExpErrorParamString           "ADSBIG_EXP_ERROR"
+#define ADSBIGReadoutRateParamString        "ADSBIG_READOUT_RATE"
+#define ADSBIGDarkSubtractParamString       "ADSBIG_DARK_SUBTRACT"
+#define ADSBIGDarkNumFramesParamString      "ADSBIG_DARK_NUM_FRAMES"
+#define ADSBIGDarkBuildParamString          "ADSBIG_DARK_BUILD"
+#define ADSBIGDarkFramesDoneParamString     "ADSBIG_DARK_FRAMES_DONE"
+#define ADSBIGDarkPedestalParamString       "ADSBIG_DARK_PEDESTAL"
+#define ADSBIGDarkTempBucketParamString     "ADSBIG_DARK_TEMP_BUCKET"
+#define ADSBIGDarkMatchedParamString        "ADSBIG_DARK_MATCHED"
+#define ADSBIGDarkCountParamString          "ADSBIG_DARK_COUNT"
+#define ADSBIGDarkMemoryParamString         "ADSBIG_DARK_MEMORY"
+#define ADSBIGDarkClearParamString          "ADSBIG_DARK_CLEAR"
+#define ADSBIGDarkFileParamString           "ADSBIG_DARK_FILE"
+#define ADSBIGDarkSaveParamString           "ADSBIG_DARK_SAVE"
+#define ADSBIGDarkLoadParamString           "ADSBIG_DARK_LOAD"
+#define ADSBIGFlatFieldParamString          "ADSBIG_FLAT_FIELD"
+#define ADSBIGFlatNumFramesParamString      "ADSBIG_FLAT_NUM_FRAMES"
+#define ADSBIGFlatBuildParamString          "ADSBIG_FLAT_BUILD"
+#define ADSBIGFlatFramesDoneParamString     "ADSBIG_FLAT_FRAMES_DONE"
+#define ADSBIGFlatValidParamString          "ADSBIG_FLAT_VALID"
+#define ADSBIGFlatMatchedParamString        "ADSBIG_FLAT_MATCHED"
+#define ADSBIGFlatMeanParamString           "ADSBIG_FLAT_MEAN"
+#define ADSBIGFlatTimeParamString           "ADSBIG_FLAT_TIME"
+#define ADSBIGFlatClearParamString          "ADSBIG_FLAT_CLEAR"
+#define ADSBIGFlatFileParamString           "ADSBIG_FLAT_FILE"
+#define ADSBIGFlatSaveParamString           "ADSBIG_FLAT_SAVE"
+#define ADSBIGFlatLoadParamString           "ADSBIG_FLAT_LOAD"
+#define ADSBIGDarkRefreshParamString        "ADSBIG_DARK_REFRESH"
+#define ADSBIGDarkAgeParamString            "ADSBIG_DARK_AGE"
+#define ADSBIGStatsEnableParamString        "ADSBIG_STATS_ENABLE"
+#define ADSBIGStatsSatLevelParamString      "ADSBIG_STATS_SAT_LEVEL"
+#define ADSBIGStatsSatUsedParamString       "ADSBIG_STATS_SAT_USED"
+#define ADSBIGStatsMinParamString           "ADSBIG_STATS_MIN"
+#define ADSBIGStatsMaxParamString           "ADSBIG_STATS_MAX"
+#define ADSBIGStatsMeanParamString          "ADSBIG_STATS_MEAN"
+#define ADSBIGStatsSigmaParamString         "ADSBIG_STATS_SIGMA"
+#define ADSBIGStatsTotalParamString         "ADSBIG_STATS_TOTAL"
+#define ADSBIGStatsNumSatParamString        "ADSBIG_STATS_NUM_SAT"
+#define ADSBIGStatsBackgroundParamString    "ADSBIG_STATS_BACKGROUND"
+#define ADSBIGStatsRangeParamString         "ADSBIG_STATS_RANGE"
+#define ADSBIGStatsHistParamString          "ADSBIG_STATS_HIST"
+#define ADSBIGTrackWaitParamString          "ADSBIG_TRACK_WAIT"
+#define ADSBIGTrackDeferredParamString      "ADSBIG_TRACK_DEFERRED"
+#define ADSBIGFocusParamString              "ADSBIG_FOCUS"
+#define ADSBIGTempPeriodParamString         "ADSBIG_TEMP_PERIOD"
+#define ADSBIGTEPeriodParamString           "ADSBIG_TE_PERIOD"
+#define ADSBIGProgressPeriodParamString     "ADSBIG_PROGRESS_PERIOD"
+#define ADSBIGLinkPeriodParamString         "ADSBIG_LINK_PERIOD"
+#define ADSBIGLinkStatusParamString         "ADSBIG_LINK_STATUS"
+#define ADSBIGLinkErrorsParamString         "ADSBIG_LINK_ERRORS"
+#define ADSBIGTelemDeferredParamString      "ADSBIG_TELEM_DEFERRED"
+#define ADSBIGFitsCompressParamString       "ADSBIG_FITS_COMPRESS"
+#define ADSBIGFitsObjectParamString         "ADSBIG_FITS_OBJECT"
+#define ADSBIGFitsTelescopeParamString      "ADSBIG_FITS_TELESCOPE"
+#define ADSBIGFitsObserverParamString       "ADSBIG_FITS_OBSERVER"
+#define ADSBIGFitsQueueUsedParamString      "ADSBIG_FITS_QUEUE_USED"
+#define ADSBIGFitsWrittenParamString        "ADSBIG_FITS_WRITTEN"
+#define ADSBIGFitsDroppedParamString        "ADSBIG_FITS_DROPPED"
+#define ADSBIGFitsRateParamString           "ADSBIG_FITS_RATE"
+#define ADSBIGFitsRatioParamString          "ADSBIG_FITS_RATIO"
+#define ADSBIGCodecParamString              "ADSBIG_CODEC"
+#define ADSBIGCodecRatioParamString         "ADSBIG_CODEC_RATIO"
+#define ADSBIGCodecRateParamString          "ADSBIG_CODEC_RATE"
+#define ADSBIGSpoolEnableParamString        "ADSBIG_SPOOL_ENABLE"
+#define ADSBIGSpoolFileParamString          "ADSBIG_SPOOL_FILE"
+#define ADSBIGSpoolSizeParamString          "ADSBIG_SPOOL_SIZE"
+#define ADSBIGSpoolMessageParamString       "ADSBIG_SPOOL_MESSAGE"
+#define ADSBIGSpoolRateParamString          "ADSBIG_SPOOL_RATE"
+#define ADSBIGSpoolFillParamString          "ADSBIG_SPOOL_FILL"
+#define ADSBIGSpoolFramesParamString        "ADSBIG_SPOOL_FRAMES"
+#define ADSBIGSpoolOverwritesParamString    "ADSBIG_SPOOL_OVERWRITES"
+#define ADSBIGDemosaicParamString           "ADSBIG_DEMOSAIC"
+#define ADSBIGCCDBayerPatternParamString    "ADSBIG_CCD_BAYER_PATTERN"
+#define ADSBIGDemosaicTimeParamString       "ADSBIG_DEMOSAIC_TIME"
+#define ADSBIGReadoutModesParamString       "ADSBIG_READOUT_MODES"
+#define ADSBIGReadoutFullTimeParamString    "ADSBIG_READOUT_FULL_TIME"
+#define ADSBIGReadoutReductionParamString   "ADSBIG_READOUT_REDUCTION"
+#define ADSBIGPreviewFactorParamString      "ADSBIG_PREVIEW_FACTOR"
+#define ADSBIGPreviewModeParamString        "ADSBIG_PREVIEW_MODE"
+#define ADSBIGPreviewAutoscaleParamString   "ADSBIG_PREVIEW_AUTOSCALE"
+#define ADSBIGPreviewMaxRateParamString     "ADSBIG_PREVIEW_MAX_RATE"
+#define ADSBIGPreviewTimeParamString        "ADSBIG_PREVIEW_TIME"
+#define ADSBIGPreviewDroppedParamString     "ADSBIG_PREVIEW_DROPPED"
+#define ADSBIGConvertLevelsParamString      "ADSBIG_CONVERT_LEVELS"
+#define ADSBIGConvertBlackParamString       "ADSBIG_CONVERT_BLACK"
+#define ADSBIGConvertWhiteParamString       "ADSBIG_CONVERT_WHITE"
+#define ADSBIGConvertElectronsParamString   "ADSBIG_CONVERT_ELECTRONS"
+#define ADSBIGConvertEGainParamString       "ADSBIG_CONVERT_EGAIN"
+#define ADSBIGTimeUSTimerParamString        "ADSBIG_TIME_US_TIMER"
+#define ADSBIGExpActualParamString          "ADSBIG_EXP_ACTUAL"
+#define ADSBIGExpCameraParamString          "ADSBIG_EXP_CAMERA"
+#define ADSBIGExpJitterMeanParamString      "ADSBIG_EXP_JITTER_MEAN"
+#define ADSBIGExpJitterSigmaParamString     "ADSBIG_EXP_JITTER_SIGMA"
+#define ADSBIGExpJitterMaxParamString       "ADSBIG_EXP_JITTER_MAX"
+#define ADSBIGStartPeriodParamString        "ADSBIG_START_PERIOD"
+#define ADSBIGStartPeriodMeanParamString    "ADSBIG_START_PERIOD_MEAN"
+#define ADSBIGStartPeriodSigmaParamString   "ADSBIG_START_PERIOD_SIGMA"
+#define ADSBIGStartPeriodMaxParamString     "ADSBIG_START_PERIOD_MAX"
 #define ADSBIGLastParamString               "ADSBIG_LAST"
 
+//Asyn addresses. The tracking CCD has its own NDArray stream and frame params.
+//The preview of the imaging CCD frames has its own NDArray stream.
+#define ADSBIG_ADDR_IMAGING 0
+#define ADSBIG_ADDR_TRACKING 1
+#define ADSBIG_ADDR_PREVIEW 2
+#define ADSBIG_NUM_ADDR 3
+
+//A tracking frame is only started during an imaging exposure if it will
+//finish this long (in seconds) before the imaging readout is due.
+#define ADSBIG_TRACK_MARGIN 0.05
+//How often (in seconds) a tracking frame that is waiting for a gap checks the imaging CCD
+#define ADSBIG_TRACK_POLL 0.01
+
+//In focus mode the frame rate is averaged over this many seconds
+#define ADSBIG_FOCUS_RATE_PERIOD 1.0
+
+//Frame types (ADSBIGDarkFieldParam)
+#define ADSBIG_FRAME_LIGHT 0
+#define ADSBIG_FRAME_DARK 1
+#define ADSBIG_FRAME_DARK_ALSO 2
+
+//Pedestal the SBIG driver adds when it subtracts a dark line (SBDF_DARK_ALSO)
+#define ADSBIG_CAMERA_PEDESTAL 100
+
+//Default telemetry periods (in seconds). A CCD temperature reading no older than
+//the temperature period is also used for the frame header.
+#define ADSBIG_TEMP_PERIOD_DEFAULT 1.0
+#define ADSBIG_TE_PERIOD_DEFAULT 1.0
+#define ADSBIG_PROGRESS_PERIOD_DEFAULT 0.1
+#define ADSBIG_LINK_PERIOD_DEFAULT 10.0
+//A camera telemetry read that is deferred because a CCD is being read out 
+//is tried again after this many seconds
+#define ADSBIG_TELEM_RETRY 0.05
+//Longest time (in seconds) the telemetry thread sleeps with nothing to do
+#define ADSBIG_TELEM_MAX_WAIT 1.0
+
+//Maximum number of frames waiting to be published (or being published)
+#define ADSBIG_PUB_QUEUE_SIZE 16
+
+//FITS writer threads, and the most frames waiting to be written (or being written)
+#define ADSBIG_FITS_THREADS 2
+#define ADSBIG_FITS_QUEUE_SIZE 16
+
+//Compression of the published frames (ADSBIGCodecParam)
+#define ADSBIG_CODEC_NONE 0
+#define ADSBIG_CODEC_SBIG 1
+
+//Most threads used to compress or demosaic a frame (fewer on machines with fewer CPUs)
+#define ADSBIG_ROW_POOL_MAX_THREADS 4
+
+//Default size of the frame spool ring (in MB)
+#define ADSBIG_SPOOL_DEFAULT_SIZE 1024
+
+//Publish queue drop policy
+#define ADSBIG_PUB_WAIT 0
+#define ADSBIG_PUB_DROP_NEWEST 1
+
+//Stages of each frame that are timed
+#define ADSBIG_STAGE_SETUP    0
+#define ADSBIG_STAGE_EXPOSURE 1
+#define ADSBIG_STAGE_READOUT  2
+#define ADSBIG_STAGE_CONVERT  3
+#define ADSBIG_STAGE_CALLBACK 4
+#define ADSBIG_NUM_STAGES     5
+
+//The mean and p99 are over this many of the most recent frames
+#define ADSBIG_TIMING_WINDOW 1000
+//Logarithmic histogram bins, starting at ADSBIG_TIMING_BIN_MIN ms
+#define ADSBIG_TIMING_BINS 64
+#define ADSBIG_TIMING_BINS_PER_DECADE 8
+#define ADSBIG_TIMING_BIN_MIN 0.01
+
 class ADSBIG : public ADDriver {
 
  public:
-  ADSBIG(const char *portName, int maxBuffers, size_t maxMemory);
+  ADSBIG(const char *portName, int maxBuffers, size_t maxMemory, int simulate,
+         int usbSlot, const char *serialNumber);
   virtual ~ADSBIG();
 
   virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
   virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+  virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn);
+  virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn);
 
   virtual void report(FILE *fp, int details);
 
   void readoutTask(void);
-  void pollingTask(void);
+  void telemetryTask(void);
+  void bandTask(void);
+  void lineReady(int line);
+  void exposureWait(double seconds);
+  void publishTask(void);
+  void previewTask(void);
+  void trackTask(void);
+  void trackWait(double seconds);
+  void fitsDone(const ADSBIGFitsResult &result);
+  asynStatus replaySpool(const char *fileName);
 
  private:
   
   //Private functions go here
   void abortExposure(void);
+  void startBands(unsigned short *pSrc, NDArray *pArray, int width, int height, int bandLines, bool streaming);
+  void finishBands(bool cancel);
+  void processBand(int firstLine, int numLines);
+  void publishArray(NDArray *pArray, const ADSBIGSpoolFrameInfo *pReplayInfo);
+  void setConvertLevels(void);
+  bool startPreview(int width, int height);
+  void publishPreview(int uniqueId, const epicsTimeStamp &timeStamp);
+  bool fitsHeader(NDArray *pArray, ADSBIGFitsHeader &header);
+  NDArray* compressArray(NDArray *pArray, double &seconds);
+  NDArray* demosaicArray(NDArray *pArray, int method, int pattern);
+  void waitForPublisher(void);
+  template <typename epicsType> void convertBand(const epicsUInt16 *pIn, epicsType *pOut, size_t nPixels);
+  template <typename epicsType> void accumulateBand(const epicsUInt16 *pIn, epicsType *pOut, size_t nPixels);
+  void recordTiming(int stage, double seconds);
+  void resetTiming(void);
+  void addGrabTimes(int exposure, double acquireTime);
+  void publishGrabTimes(NDArray *pArray, epicsTimeStamp &midTime);
+  ADSBIGDarkKey darkKey(void);
+  bool grabAverage(SBIG_DARK_FRAME dark, int numFrames, const epicsUInt16 *pDark, 
+                   epicsUInt16 pedestal, int framesDoneParam, std::vector<epicsUInt16> &average);
+  bool buildMasterDark(void);
+  bool buildMasterFlat(void);
+  void updateDarkLibraryParams(void);
+  void updateFlatFieldParams(void);
+  void publishStats(NDArray *pArray);
+  void publishTelemetry(const ADSBIGTelemetryValues &values);
+  void setTemperatureMaxAge(double seconds);
+  asynStatus writeTrackingInt32(int function, epicsInt32 value);
+  asynStatus setReadoutMode(int addr, int function, epicsInt32 value);
+  int sbigReadoutMode(int addr);
+  void addReadoutTime(int addr, int sbigMode, double seconds, double pixels);
+  bool focusAcquire(int sizeX, int sizeY, int imageMode, int numImages);
+  bool waitForTrackingGap(double frameTime, double &waited, bool &deferred);
 
   //Private static data members
 
@@ -64,9 +333,142 @@ class ADSBIG : public ADDriver {
   int m_CamHeight;
   bool m_aborted;
   
+  bool m_darkBuild;
+  bool m_flatBuild;
+  
   epicsEventId m_startEvent;
   epicsEventId m_stopEvent;
 
+  //The tracking CCD, run from its own thread through the camera's driver handle
+  CSBIGCam *p_Track;
+  CSBIGImg *p_TrackImg;
+  int m_TrackWidth;
+  int m_TrackHeight;
+  bool m_trackAborted;
+  double m_trackReadoutTime;
+  epicsEventId m_trackStartEvent;
+  epicsEventId m_trackStopEvent;
+
+  //Band processing state for the frame being read out
+  epicsEventId m_bandEvent;
+  epicsEventId m_bandDoneEvent;
+  unsigned short *m_pBandSrc;
+  NDArray *m_pBandArray;
+  int m_bandWidth;
+  int m_bandHeight;
+  int m_bandLines;
+  int m_bandLinesRead;
+  int m_bandLinesDone;
+  bool m_bandStreaming;
+  volatile bool m_bandActive;
+  volatile bool m_bandCancel;
+  std::vector<epicsTimeStamp> m_bandReadyTime;
+  double m_bandLatencySum;
+  double m_bandLatencyMax;
+  double m_bandProcTime;
+  double m_bandTailTime;
+  int m_bandCount;
+  const epicsUInt16 *m_pBandDark;
+  epicsUInt16 m_bandDarkPedestal;
+  const epicsFloat32 *m_pBandGain;
+  double m_bandFlatTime;
+  bool m_bandStats;
+  bool m_bandAccumulate;
+  bool m_bandPreview;
+  double m_bandPreviewTime;
+  //Black and white levels for UInt8 frames, and the scale to electrons for Float32 frames (0 if not scaled)
+  epicsUInt16 m_bandBlack;
+  epicsUInt16 m_bandWhite;
+  epicsFloat32 m_bandElectrons;
+
+  //Camera telemetry. The readout progress (in hundredths of a percent) is pushed 
+  //by the readout thread at most once per m_progressPeriod.
+  ADSBIGTelemetrySnapshot m_telemetry;
+  ADSBIGTelemetrySchedule m_telemSchedule;
+  epicsEventId m_telemEvent;
+  int m_progressPercent;
+  int m_progressPending;
+  double m_progressPeriod;
+  epicsTimeStamp m_progressTime;
+
+  //Statistics of the raw pixels, accumulated during the readout
+  ADSBIGStats m_stats;
+  std::vector<epicsInt32> m_statsHist;
+
+  //Master darks, for subtracting from the light frames
+  ADSBIGDarkLibrary m_darkLibrary;
+  //Last dark taken in ADSBIG_FRAME_DARK_ALSO mode, for reuse by the following frames
+  std::vector<epicsUInt16> m_darkAlsoCache;
+  //Master flat, for flat fielding the light frames
+  ADSBIGFlatField m_flatField;
+
+  //Readout modes of each CCD (by asyn address)
+  ADSBIGReadoutModes m_readoutModes[ADSBIG_NUM_ADDR];
+
+  //Completed frames waiting for the publisher thread
+  struct ADSBIGPublishItem {
+    NDArray *pArray;
+    epicsTimeStamp queuedTime;
+    bool writeFits;
+    ADSBIGFitsHeader fitsHeader;
+    ADSBIGSpoolFrameInfo spoolInfo;
+  };
+  epicsEventId m_publishEvent;
+  epicsEventId m_publishFreeEvent;
+  epicsRingPointerId m_publishQueue;
+  ADSBIGPublishItem m_publishItems[ADSBIG_PUB_QUEUE_SIZE];
+  int m_publishSlot;
+  int m_publishPending;
+
+  //Writes the published frames to FITS files (NDAutoSave)
+  ADSBIGFitsWriter *p_Fits;
+  //Threads that split the codec and demosaic passes by rows. The publisher
+  //and readout threads share them, one pass at a time.
+  ADSBIGRowPool *p_RowPool;
+  //Compresses the published frames (used only by the publisher thread)
+  ADSBIGCodec *p_Codec;
+  //Demosaics colour frames (used by the readout thread)
+  ADSBIGDemosaic *p_Demosaic;
+  //Keeps a copy of every published frame (used by the publisher thread)
+  ADSBIGSpool *p_Spool;
+  //Preview of the frame being read out (built by the band processing), the time 
+  //the last preview was started, and the latest preview waiting for the preview thread
+  ADSBIGPreview m_preview;
+  epicsTimeStamp m_previewTime;
+  NDArray *m_pPreviewArray;
+  epicsEventId m_previewEvent;
+  //Start of the frame being read out, for DATE-OBS
+  epicsTimeStamp m_frameStartTime;
+  //Wall clock times of the frame from the class library. With more than one exposure 
+  //the start is that of the first exposure, and the end and readout those of the last.
+  epicsTimeStamp m_exposureStart;
+  epicsTimeStamp m_exposureEnd;
+  epicsTimeStamp m_readoutStart;
+  epicsTimeStamp m_readoutEnd;
+  //Exposure time counted by the camera's microsecond timer (in s), if it has one
+  double m_cameraExposure;
+  bool m_cameraExposureValid;
+  //Start of the last published frame, for the start to start period
+  epicsTimeStamp m_lastExposureStart;
+  bool m_haveLastStart;
+  //Actual minus requested exposure time, and start to start period (in ms)
+  ADSBIGJitter m_expJitter;
+  ADSBIGJitter m_periodJitter;
+
+  //Timing statistics for each stage of a frame (in ms)
+  struct ADSBIGTimingStat {
+    int lastParam;
+    int meanParam;
+    int p99Param;
+    int histParam;
+    std::vector<double> window;
+    size_t next;
+    std::vector<epicsInt32> hist;
+  };
+  ADSBIGTimingStat m_timing[ADSBIG_NUM_STAGES];
+  std::vector<double> m_timingSorted;
+  std::vector<epicsFloat64> m_timingBins;
+
   //Parameter library indices
   int ADSBIGFirstParam;
   #define ADSBIG_FIRST_PARAM ADSBIGFirstParam
@@ -75,6 +477,143 @@ class ADSBIG : public ADDriver {
   int ADSBIGPercentCompleteParam;
   int ADSBIGTEStatusParam;
   int ADSBIGTEPowerParam;
+  int ADSBIGFrameRateParam;
+  int ADSBIGDeadTimeParam;
+  int ADSBIGStreamingParam;
+  int ADSBIGBandLinesParam;
+  int ADSBIGBandLatencyParam;
+  int ADSBIGBandLatencyMaxParam;
+  int ADSBIGProcTailParam;
+  int ADSBIGProcHiddenParam;
+  int ADSBIGExpPollsParam;
+  int ADSBIGExpCPUTimeParam;
+  int ADSBIGPubQueueDepthParam;
+  int ADSBIGPubQueueUsedParam;
+  int ADSBIGPubDropPolicyParam;
+  int ADSBIGPubDroppedParam;
+  int ADSBIGPubQueueTimeParam;
+  int ADSBIGPubAttrTimeParam;
+  int ADSBIGPubCallbackTimeParam;
+  int ADSBIGTimeSetupParam;
+  int ADSBIGTimeSetupMeanParam;
+  int ADSBIGTimeSetupP99Param;
+  int ADSBIGTimeSetupHistParam;
+  int ADSBIGTimeExposureParam;
+  int ADSBIGTimeExposureMeanParam;
+  int ADSBIGTimeExposureP99Param;
+  int ADSBIGTimeExposureHistParam;
+  int ADSBIGTimeReadoutParam;
+  int ADSBIGTimeReadoutMeanParam;
+  int ADSBIGTimeReadoutP99Param;
+  int ADSBIGTimeReadoutHistParam;
+  int ADSBIGTimeConvertParam;
+  int ADSBIGTimeConvertMeanParam;
+  int ADSBIGTimeConvertP99Param;
+  int ADSBIGTimeConvertHistParam;
+  int ADSBIGTimeCallbackParam;
+  int ADSBIGTimeCallbackMeanParam;
+  int ADSBIGTimeCallbackP99Param;
+  int ADSBIGTimeCallbackHistParam;
+  int ADSBIGTimeHistBinsParam;
+  int ADSBIGTimeResetParam;
+  int ADSBIGExpErrorParam;
+  int ADSBIGReadoutRateParam;
+  int ADSBIGDarkSubtractParam;
+  int ADSBIGDarkNumFramesParam;
+  int ADSBIGDarkBuildParam;
+  int ADSBIGDarkFramesDoneParam;
+  int ADSBIGDarkPedestalParam;
+  int ADSBIGDarkTempBucketParam;
+  int ADSBIGDarkMatchedParam;
+  int ADSBIGDarkCountParam;
+  int ADSBIGDarkMemoryParam;
+  int ADSBIGDarkClearParam;
+  int ADSBIGDarkFileParam;
+  int ADSBIGDarkSaveParam;
+  int ADSBIGDarkLoadParam;
+  int ADSBIGFlatFieldParam;
+  int ADSBIGFlatNumFramesParam;
+  int ADSBIGFlatBuildParam;
+  int ADSBIGFlatFramesDoneParam;
+  int ADSBIGFlatValidParam;
+  int ADSBIGFlatMatchedParam;
+  int ADSBIGFlatMeanParam;
+  int ADSBIGFlatTimeParam;
+  int ADSBIGFlatClearParam;
+  int ADSBIGFlatFileParam;
+  int ADSBIGFlatSaveParam;
+  int ADSBIGFlatLoadParam;
+  int ADSBIGDarkRefreshParam;
+  int ADSBIGDarkAgeParam;
+  int ADSBIGStatsEnableParam;
+  int ADSBIGStatsSatLevelParam;
+  int ADSBIGStatsSatUsedParam;
+  int ADSBIGStatsMinParam;
+  int ADSBIGStatsMaxParam;
+  int ADSBIGStatsMeanParam;
+  int ADSBIGStatsSigmaParam;
+  int ADSBIGStatsTotalParam;
+  int ADSBIGStatsNumSatParam;
+  int ADSBIGStatsBackgroundParam;
+  int ADSBIGStatsRangeParam;
+  int ADSBIGStatsHistParam;
+  int ADSBIGTrackWaitParam;
+  int ADSBIGTrackDeferredParam;
+  int ADSBIGFocusParam;
+  int ADSBIGTempPeriodParam;
+  int ADSBIGTEPeriodParam;
+  int ADSBIGProgressPeriodParam;
+  int ADSBIGLinkPeriodParam;
+  int ADSBIGLinkStatusParam;
+  int ADSBIGLinkErrorsParam;
+  int ADSBIGTelemDeferredParam;
+  int ADSBIGFitsCompressParam;
+  int ADSBIGFitsObjectParam;
+  int ADSBIGFitsTelescopeParam;
+  int ADSBIGFitsObserverParam;
+  int ADSBIGFitsQueueUsedParam;
+  int ADSBIGFitsWrittenParam;
+  int ADSBIGFitsDroppedParam;
+  int ADSBIGFitsRateParam;
+  int ADSBIGFitsRatioParam;
+  int ADSBIGCodecParam;
+  int ADSBIGCodecRatioParam;
+  int ADSBIGCodecRateParam;
+  int ADSBIGSpoolEnableParam;
+  int ADSBIGSpoolFileParam;
+  int ADSBIGSpoolSizeParam;
+  int ADSBIGSpoolMessageParam;
+  int ADSBIGSpoolRateParam;
+  int ADSBIGSpoolFillParam;
+  int ADSBIGSpoolFramesParam;
+  int ADSBIGSpoolOverwritesParam;
+  int ADSBIGDemosaicParam;
+  int ADSBIGCCDBayerPatternParam;
+  int ADSBIGDemosaicTimeParam;
+  int ADSBIGReadoutModesParam;
+  int ADSBIGReadoutFullTimeParam;
+  int ADSBIGReadoutReductionParam;
+  int ADSBIGPreviewFactorParam;
+  int ADSBIGPreviewModeParam;
+  int ADSBIGPreviewAutoscaleParam;
+  int ADSBIGPreviewMaxRateParam;
+  int ADSBIGPreviewTimeParam;
+  int ADSBIGPreviewDroppedParam;
+  int ADSBIGConvertLevelsParam;
+  int ADSBIGConvertBlackParam;
+  int ADSBIGConvertWhiteParam;
+  int ADSBIGConvertElectronsParam;
+  int ADSBIGConvertEGainParam;
+  int ADSBIGTimeUSTimerParam;
+  int ADSBIGExpActualParam;
+  int ADSBIGExpCameraParam;
+  int ADSBIGExpJitterMeanParam;
+  int ADSBIGExpJitterSigmaParam;
+  int ADSBIGExpJitterMaxParam;
+  int ADSBIGStartPeriodParam;
+  int ADSBIGStartPeriodMeanParam;
+  int ADSBIGStartPeriodSigmaParam;
+  int ADSBIGStartPeriodMaxParam;
   int ADSBIGLastParam;
   #define ADSBIG_LAST_PARAM ADSBIGLastParam
   
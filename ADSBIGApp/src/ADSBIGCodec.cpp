@@ -0,0 +1,452 @@
+/**
+ * SBIG compressed image codec for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsEndian.h>
+#include <epicsStdio.h>
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "csbigimg.h"
+
+#include "ADSBIGCodec.h"
+
+//Pixels checked at a time when looking for deltas that do not fit in a byte
+#define ADSBIG_CODEC_BLOCK 16
+
+/**
+ * Constructor.
+ * @param pPool The threads that encode and decode rows. This can be
+ * shared with other users, and must outlive the codec.
+ */
+ADSBIGCodec::ADSBIGCodec(ADSBIGRowPool *pPool) :
+  m_pPool(pPool), m_pass(PASS_SIZE), m_width(0), m_error(0),
+  m_pSrcImage(NULL), m_pDestImage(NULL), m_pSrcData(NULL), m_pDestData(NULL)
+{
+  m_mutex = epicsMutexMustCreate();
+}
+
+/**
+ * Destructor.
+ */
+ADSBIGCodec::~ADSBIGCodec()
+{
+  epicsMutexDestroy(m_mutex);
+}
+
+/**
+ * @return The number of threads used, including the calling thread
+ */
+int ADSBIGCodec::numThreads(void) const
+{
+  return m_pPool->numThreads();
+}
+
+/**
+ * @return The largest possible size of an encoded image (every row raw)
+ */
+size_t ADSBIGCodec::maxEncodedSize(int width, int height)
+{
+  return static_cast<size_t>(height) * (2 * static_cast<size_t>(width) + 2);
+}
+
+/**
+ * Size one row. The row is raw if the deltas would not make it any smaller.
+ * @param pRow The pixels
+ * @param width The number of pixels
+ * @return The size of the encoded row in bytes, including the 2 byte length
+ */
+size_t ADSBIGCodec::encodedRowSize(const epicsUInt16 *pRow, int width)
+{
+  size_t numLarge = 0;
+  size_t size = 0;
+
+  //Each delta is one byte, or three if it does not fit in [-127,127].
+  //The two comparisons are ORed as integers rather than with ||, so there is no branch.
+  for (int i=1; i<width; ++i) {
+    int delta = static_cast<int>(pRow[i]) - static_cast<int>(pRow[i-1]);
+    numLarge += static_cast<size_t>((delta < -127) | (delta > 127));
+  }
+
+  size = 2 + static_cast<size_t>(width - 1) + 2 * numLarge;
+  if (size >= 2 * static_cast<size_t>(width)) {
+    size = 2 * static_cast<size_t>(width);
+  }
+  return size + 2;
+}
+
+/**
+ * Encode one row. This gives the same bytes as CSBIGImg::CompressSBIGData.
+ * @param pRow The pixels
+ * @param width The number of pixels
+ * @param pOut The output, which must have room for rowSize bytes
+ * @param rowSize The size from encodedRowSize
+ */
+void ADSBIGCodec::encodeRow(const epicsUInt16 *pRow, int width, unsigned char *pOut, size_t rowSize)
+{
+  size_t length = rowSize - 2;
+  unsigned char *pCode = pOut + 2;
+  int i = 1;
+
+  pOut[0] = static_cast<unsigned char>(length & 0xFF);
+  pOut[1] = static_cast<unsigned char>(length >> 8);
+
+  if (length == 2 * static_cast<size_t>(width)) {
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE
+    memcpy(pCode, pRow, length);
+#else
+    for (i=0; i<width; ++i) {
+      *pCode++ = static_cast<unsigned char>(pRow[i] & 0xFF);
+      *pCode++ = static_cast<unsigned char>(pRow[i] >> 8);
+    }
+#endif
+    return;
+  }
+
+  *pCode++ = static_cast<unsigned char>(pRow[0] & 0xFF);
+  *pCode++ = static_cast<unsigned char>(pRow[0] >> 8);
+
+  while (i < width) {
+    //Write whole blocks of small deltas without testing each pixel
+    if ((i + ADSBIG_CODEC_BLOCK) <= width) {
+      int large = 0;
+      for (int j=i; j<(i + ADSBIG_CODEC_BLOCK); ++j) {
+        int delta = static_cast<int>(pRow[j]) - static_cast<int>(pRow[j-1]);
+        large |= (delta < -127) | (delta > 127);
+      }
+      if (!large) {
+        for (int j=0; j<ADSBIG_CODEC_BLOCK; ++j) {
+          pCode[j] = static_cast<unsigned char>(pRow[i+j] - pRow[i+j-1]);
+        }
+        pCode += ADSBIG_CODEC_BLOCK;
+        i += ADSBIG_CODEC_BLOCK;
+        continue;
+      }
+    }
+
+    int end = ((i + ADSBIG_CODEC_BLOCK) < width) ? (i + ADSBIG_CODEC_BLOCK) : width;
+    for (; i<end; ++i) {
+      int delta = static_cast<int>(pRow[i]) - static_cast<int>(pRow[i-1]);
+      if ((delta >= -127) && (delta <= 127)) {
+        *pCode++ = static_cast<unsigned char>(delta);
+      } else {
+        *pCode++ = 0x80;
+        *pCode++ = static_cast<unsigned char>(pRow[i] & 0xFF);
+        *pCode++ = static_cast<unsigned char>(pRow[i] >> 8);
+      }
+    }
+  }
+}
+
+/**
+ * Decode one row, with the same checks as CSBIGImg::ReadCompressedImage.
+ * @param pIn The encoded row, starting with its 2 byte length
+ * @param rowSize The size of the encoded row in bytes, including the length
+ * @param width The number of pixels
+ * @param pRow The output pixels
+ * @return false if the row is not valid
+ */
+bool ADSBIGCodec::decodeRow(const unsigned char *pIn, size_t rowSize, int width, epicsUInt16 *pRow)
+{
+  size_t length = static_cast<size_t>(pIn[0]) | (static_cast<size_t>(pIn[1]) << 8);
+  const unsigned char *pCode = pIn + 2;
+  const unsigned char *pEnd = pCode + length;
+  epicsUInt16 value = 0;
+  int i = 1;
+
+  if ((length + 2 != rowSize) || (length > 2 * static_cast<size_t>(width)) ||
+      (length < static_cast<size_t>(width) + 1)) {
+    return false;
+  }
+
+  if (length == 2 * static_cast<size_t>(width)) {
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE
+    memcpy(pRow, pCode, length);
+#else
+    for (i=0; i<width; ++i) {
+      pRow[i] = static_cast<epicsUInt16>(pCode[2*i] | (pCode[2*i+1] << 8));
+    }
+#endif
+    return true;
+  }
+
+  value = static_cast<epicsUInt16>(pCode[0] | (pCode[1] << 8));
+  pCode += 2;
+  pRow[0] = value;
+
+  while ((i < width) && (pCode < pEnd)) {
+    //Deltas up to the next 0x80 (found with memchr, which is vectorized)
+    size_t available = static_cast<size_t>(pEnd - pCode);
+    size_t remaining = static_cast<size_t>(width - i);
+    size_t run = (available < remaining) ? available : remaining;
+    const unsigned char *pEscape = static_cast<const unsigned char *>(memchr(pCode, 0x80, run));
+    if (pEscape != NULL) {
+      run = static_cast<size_t>(pEscape - pCode);
+    }
+    for (size_t j=0; j<run; ++j) {
+      value = static_cast<epicsUInt16>(value + static_cast<signed char>(pCode[j]));
+      pRow[i+j] = value;
+    }
+    pCode += run;
+    i += static_cast<int>(run);
+
+    if (pEscape != NULL) {
+      if ((pEnd - pCode) < 3) {
+        return false;
+      }
+      value = static_cast<epicsUInt16>(pCode[1] | (pCode[2] << 8));
+      pRow[i++] = value;
+      pCode += 3;
+    }
+  }
+
+  return ((i == width) && (pCode == pEnd));
+}
+
+/**
+ * Encode an image.
+ * @param pImage The pixels, width*height
+ * @param width The image width
+ * @param height The image height
+ * @param pOut The output
+ * @param outSize The size of the output (maxEncodedSize is always enough)
+ * @return The size of the encoded image in bytes, or 0 if it did not fit in the output
+ */
+size_t ADSBIGCodec::encode(const epicsUInt16 *pImage, int width, int height, unsigned char *pOut, size_t outSize)
+{
+  size_t totalSize = 0;
+
+  if ((width < 1) || (height < 1)) {
+    return 0;
+  }
+
+  epicsMutexMustLock(m_mutex);
+  m_width = width;
+  m_pSrcImage = pImage;
+  m_pDestData = pOut;
+  m_rowSizes.resize(height);
+  m_rowOffsets.resize(height);
+
+  run(PASS_SIZE, height);
+
+  for (int row=0; row<height; ++row) {
+    m_rowOffsets[row] = totalSize;
+    totalSize += m_rowSizes[row];
+  }
+
+  if (totalSize <= outSize) {
+    run(PASS_ENCODE, height);
+  } else {
+    totalSize = 0;
+  }
+  epicsMutexUnlock(m_mutex);
+
+  return totalSize;
+}
+
+/**
+ * Decode an image.
+ * @param pIn The encoded image
+ * @param inSize The size of the encoded image in bytes
+ * @param width The image width
+ * @param height The image height
+ * @param pImage The output pixels, width*height
+ * @return false if the encoded image is not valid
+ */
+bool ADSBIGCodec::decode(const unsigned char *pIn, size_t inSize, int width, int height, epicsUInt16 *pImage)
+{
+  size_t offset = 0;
+  bool ok = true;
+
+  if ((width < 1) || (height < 1)) {
+    return false;
+  }
+
+  epicsMutexMustLock(m_mutex);
+  m_width = width;
+  m_pSrcData = pIn;
+  m_pDestImage = pImage;
+  m_rowSizes.resize(height);
+  m_rowOffsets.resize(height);
+
+  //Find the rows. Only the lengths are read here.
+  for (int row=0; row<height; ++row) {
+    if ((offset + 2) > inSize) {
+      ok = false;
+      break;
+    }
+    m_rowOffsets[row] = offset;
+    m_rowSizes[row] = (static_cast<size_t>(pIn[offset]) | (static_cast<size_t>(pIn[offset+1]) << 8)) + 2;
+    offset += m_rowSizes[row];
+    if (offset > inSize) {
+      ok = false;
+      break;
+    }
+  }
+
+  if (ok) {
+    run(PASS_DECODE, height);
+    ok = (m_error == 0);
+  }
+  epicsMutexUnlock(m_mutex);
+
+  return ok;
+}
+
+/**
+ * Run a pass over all the rows, on the worker threads and the calling
+ * thread, and wait for it to finish. Called with m_mutex held.
+ */
+void ADSBIGCodec::run(Pass pass, int height)
+{
+  m_pass = pass;
+  m_error = 0;
+  m_pPool->run(this, height, (static_cast<size_t>(m_width) * height) >= ADSBIG_CODEC_MIN_PARALLEL);
+}
+
+void ADSBIGCodec::processRows(int thread, int firstRow, int numRows)
+{
+  for (int row=firstRow; row<(firstRow + numRows); ++row) {
+    switch (m_pass) {
+    case PASS_SIZE:
+      m_rowSizes[row] = encodedRowSize(m_pSrcImage + static_cast<size_t>(row) * m_width, m_width);
+      break;
+    case PASS_ENCODE:
+      encodeRow(m_pSrcImage + static_cast<size_t>(row) * m_width, m_width,
+                m_pDestData + m_rowOffsets[row], m_rowSizes[row]);
+      break;
+    case PASS_DECODE:
+      if (!decodeRow(m_pSrcData + m_rowOffsets[row], m_rowSizes[row], m_width,
+                     m_pDestImage + static_cast<size_t>(row) * m_width)) {
+        epicsAtomicSetIntT(&m_error, 1);
+      }
+      break;
+    }
+  }
+}
+
+
+/*************************************************************************************/
+/** The following functions have C linkage, and can be called directly or from iocsh */
+
+extern "C" {
+
+/**
+ * Round trip test and benchmark of the codec. The image is encoded and
+ * decoded repeats times with one thread and then with numThreads, checked
+ * against the original, and the rates are printed.
+ * @param fileName An SBIG image file to use (read with CSBIGImg), or empty for a simulated star field
+ * @param width The width of the simulated image
+ * @param height The height of the simulated image
+ * @param repeats The number of times to encode and decode
+ * @param numThreads The number of threads to compare with one thread
+ */
+  int ADSBIGCodecTest(const char *fileName, int width, int height, int repeats, int numThreads)
+  {
+    std::vector<epicsUInt16> image;
+    std::vector<epicsUInt16> decoded;
+    std::vector<unsigned char> encoded;
+    CSBIGImg sbigImg;
+    epicsTimeStamp startTime;
+    epicsTimeStamp endTime;
+    size_t encodedSize = 0;
+    int failed = 0;
+
+    if ((fileName != NULL) && (strlen(fileName) > 0)) {
+      if (sbigImg.OpenImage(fileName) != SBFE_NO_ERROR) {
+        printf("ADSBIGCodecTest: Failed to read %s\n", fileName);
+        return -1;
+      }
+      width = sbigImg.GetWidth();
+      height = sbigImg.GetHeight();
+      image.assign(sbigImg.GetImagePointer(), sbigImg.GetImagePointer() + static_cast<size_t>(width) * height);
+    } else {
+      //Sky background with read noise, and a few saturated stars so that some deltas do not fit
+      unsigned int seed = 12345;
+      width = (width > 0) ? width : 3326;
+      height = (height > 0) ? height : 2504;
+      image.resize(static_cast<size_t>(width) * height);
+      for (size_t pixel=0; pixel<image.size(); ++pixel) {
+        seed = seed * 1103515245 + 12345;
+        image[pixel] = static_cast<epicsUInt16>(1000 + ((seed >> 16) % 64));
+        if (((seed >> 8) & 0x3FFF) == 0) {
+          image[pixel] = 65535;
+        }
+      }
+    }
+    repeats = (repeats > 0) ? repeats : 10;
+    numThreads = (numThreads > 0) ? numThreads : epicsThreadGetCPUs();
+
+    decoded.resize(image.size());
+    encoded.resize(ADSBIGCodec::maxEncodedSize(width, height));
+    double rawMB = (image.size() * sizeof(epicsUInt16)) / 1.0e6;
+
+    for (int pass=0; pass<2; ++pass) {
+      ADSBIGRowPool pool("ADSBIGCodecTest", (pass == 0) ? 1 : numThreads);
+      ADSBIGCodec codec(&pool);
+
+      epicsTimeGetCurrent(&startTime);
+      for (int repeat=0; repeat<repeats; ++repeat) {
+        encodedSize = codec.encode(&image[0], width, height, &encoded[0], encoded.size());
+      }
+      epicsTimeGetCurrent(&endTime);
+      double encodeTime = epicsTimeDiffInSeconds(&endTime, &startTime) / repeats;
+
+      bool ok = true;
+      epicsTimeGetCurrent(&startTime);
+      for (int repeat=0; repeat<repeats; ++repeat) {
+        ok = codec.decode(&encoded[0], encodedSize, width, height, &decoded[0]) && ok;
+      }
+      epicsTimeGetCurrent(&endTime);
+      double decodeTime = epicsTimeDiffInSeconds(&endTime, &startTime) / repeats;
+
+      ok = ok && (encodedSize > 0) && (decoded == image);
+      if (!ok) {
+        failed = 1;
+      }
+      printf("ADSBIGCodecTest: %dx%d, %d thread(s), ratio %.2f, encode %.1f MB/s, decode %.1f MB/s, round trip %s\n",
+             width, height, codec.numThreads(), (encodedSize > 0) ? (rawMB * 1.0e6) / encodedSize : 0.0,
+             (encodeTime > 0.0) ? rawMB / encodeTime : 0.0, (decodeTime > 0.0) ? rawMB / decodeTime : 0.0,
+             ok ? "OK" : "FAILED");
+    }
+
+    return failed ? -1 : 0;
+  }
+
+
+ /* Code for iocsh registration */
+
+  /* ADSBIGCodecTest */
+  static const iocshArg ADSBIGCodecTestArg0 = {"File Name", iocshArgString};
+  static const iocshArg ADSBIGCodecTestArg1 = {"Width", iocshArgInt};
+  static const iocshArg ADSBIGCodecTestArg2 = {"Height", iocshArgInt};
+  static const iocshArg ADSBIGCodecTestArg3 = {"Repeats", iocshArgInt};
+  static const iocshArg ADSBIGCodecTestArg4 = {"Num Threads", iocshArgInt};
+  static const iocshArg * const ADSBIGCodecTestArgs[] =  {&ADSBIGCodecTestArg0,
+                                                            &ADSBIGCodecTestArg1,
+                                                            &ADSBIGCodecTestArg2,
+                                                            &ADSBIGCodecTestArg3,
+                                                            &ADSBIGCodecTestArg4};
+
+  static const iocshFuncDef testADSBIGCodec = {"ADSBIGCodecTest", 5, ADSBIGCodecTestArgs};
+  static void testADSBIGCodecCallFunc(const iocshArgBuf *args)
+  {
+    ADSBIGCodecTest(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival);
+  }
+
+  static void ADSBIGCodecRegister(void)
+  {
+    iocshRegister(&testADSBIGCodec, testADSBIGCodecCallFunc);
+  }
+
+  epicsExportRegistrar(ADSBIGCodecRegister);
+
+} // extern "C"
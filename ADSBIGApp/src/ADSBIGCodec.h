@@ -0,0 +1,73 @@
+/**
+ * SBIG compressed image codec for the ADSBIG areaDetector driver.
+ *
+ * This is the row delta format of SBIG compressed image files (the data
+ * after the 2048 byte header), as written by CSBIGImg::SaveCompressedImage.
+ * Each row starts with its length in bytes (2 bytes, LSB first). A row of
+ * 2*width bytes is the raw pixels, LSB first. Otherwise the first pixel is
+ * raw and each following pixel is either an 8 bit signed delta from the
+ * previous pixel, or 0x80 followed by the raw pixel.
+ *
+ * The rows are encoded and decoded in parallel by a pool of worker
+ * threads (see ADSBIGRowPool), into buffers given by the caller. An
+ * encode first sizes every row (counting the deltas that do not fit in a
+ * byte), so that each row can be written straight to its place in the
+ * output.
+ *
+ */
+
+#ifndef ADSBIG_CODEC_H
+#define ADSBIG_CODEC_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+#include "ADSBIGRowPool.h"
+
+//NDArray::codec.name for frames published in this format
+#define ADSBIG_CODEC_NAME "sbig"
+
+//Frames smaller than this (in pixels) are not worth splitting across threads
+#define ADSBIG_CODEC_MIN_PARALLEL 65536
+
+class ADSBIGCodec : private ADSBIGRowTask {
+
+ public:
+  ADSBIGCodec(ADSBIGRowPool *pPool);
+  ~ADSBIGCodec();
+
+  size_t encode(const epicsUInt16 *pImage, int width, int height, unsigned char *pOut, size_t outSize);
+  bool decode(const unsigned char *pIn, size_t inSize, int width, int height, epicsUInt16 *pImage);
+  int numThreads(void) const;
+
+  static size_t maxEncodedSize(int width, int height);
+  static size_t encodedRowSize(const epicsUInt16 *pRow, int width);
+  static void encodeRow(const epicsUInt16 *pRow, int width, unsigned char *pOut, size_t rowSize);
+  static bool decodeRow(const unsigned char *pIn, size_t rowSize, int width, epicsUInt16 *pRow);
+
+ private:
+  enum Pass { PASS_SIZE, PASS_ENCODE, PASS_DECODE };
+
+  void run(Pass pass, int height);
+  void processRows(int thread, int firstRow, int numRows);
+
+  ADSBIGRowPool *m_pPool;
+  epicsMutexId m_mutex;
+
+  //The current operation. Only set while m_mutex is held and the workers are idle.
+  Pass m_pass;
+  int m_width;
+  int m_error;
+  const epicsUInt16 *m_pSrcImage;
+  epicsUInt16 *m_pDestImage;
+  const unsigned char *m_pSrcData;
+  unsigned char *m_pDestData;
+  std::vector<size_t> m_rowSizes;
+  std::vector<size_t> m_rowOffsets;
+
+};
+
+#endif //ADSBIG_CODEC_H
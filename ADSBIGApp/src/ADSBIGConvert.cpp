@@ -0,0 +1,69 @@
+/**
+ * Output data type conversion for the ADSBIG areaDetector driver.
+ *
+ * The UInt8 scaling is done in 16.16 fixed point. The pixel minus the
+ * black level is clamped to the range first, so the product always
+ * fits in 32 bits.
+ *
+ */
+
+#include "ADSBIGConvert.h"
+
+/**
+ * Scale pixels linearly to UInt8, with the black level (and below) 
+ * at 0 and the white level (and above) at 255.
+ * @param pIn The pixels to convert
+ * @param pOut The output
+ * @param nPixels The number of pixels
+ * @param black The black level
+ * @param white The white level (if it is not above the black level, 
+ * every pixel above the black level is 255)
+ */
+void ADSBIGConvert::toUInt8(const epicsUInt16 *pIn, epicsUInt8 *pOut, size_t nPixels,
+                            epicsUInt16 black, epicsUInt16 white)
+{
+  const epicsUInt32 low = black;
+  const epicsUInt32 range = (white > black) ? static_cast<epicsUInt32>(white - black) : 1;
+  const epicsUInt32 scale = (255u << 16) / range;
+  epicsUInt32 value = 0;
+
+  for (size_t i=0; i<nPixels; ++i) {
+    value = pIn[i];
+    value = (value > low) ? value - low : 0;
+    value = (value < range) ? value : range;
+    pOut[i] = static_cast<epicsUInt8>((value * scale + 0x8000) >> 16);
+  }
+}
+
+/**
+ * Convert pixels to Float32, with the pedestal removed and scaled
+ * (to electrons, with the electronic gain in e-/ADU).
+ * @param pIn The pixels to convert
+ * @param pOut The output
+ * @param nPixels The number of pixels
+ * @param pedestal The pedestal in the input pixels
+ * @param scale Multiplies each pixel, once the pedestal is removed
+ */
+void ADSBIGConvert::toFloat32(const epicsUInt16 *pIn, epicsFloat32 *pOut, size_t nPixels,
+                              epicsUInt16 pedestal, epicsFloat32 scale)
+{
+  const epicsFloat32 ped = pedestal;
+
+  for (size_t i=0; i<nPixels; ++i) {
+    pOut[i] = (static_cast<epicsFloat32>(pIn[i]) - ped) * scale;
+  }
+}
+
+/**
+ * Convert pixels as in toFloat32, and add them to the output, for 
+ * co-adding exposures.
+ */
+void ADSBIGConvert::addFloat32(const epicsUInt16 *pIn, epicsFloat32 *pOut, size_t nPixels,
+                               epicsUInt16 pedestal, epicsFloat32 scale)
+{
+  const epicsFloat32 ped = pedestal;
+
+  for (size_t i=0; i<nPixels; ++i) {
+    pOut[i] += (static_cast<epicsFloat32>(pIn[i]) - ped) * scale;
+  }
+}
@@ -0,0 +1,35 @@
+/**
+ * Output data type conversion for the ADSBIG areaDetector driver.
+ *
+ * The camera reads out UInt16 pixels. These convert them into the
+ * output NDArray in the same pass as the copy, a band at a time, for
+ * the data types that are not a plain widening copy: UInt8 frames are
+ * scaled from a black to a white level, and Float32 frames can be
+ * scaled to electrons with the electronic gain of the readout mode.
+ *
+ */
+
+#ifndef ADSBIG_CONVERT_H
+#define ADSBIG_CONVERT_H
+
+#include <stddef.h>
+
+#include <epicsTypes.h>
+
+//Black and white levels for UInt8 frames (ADSBIGConvertLevelsParam)
+#define ADSBIG_CONVERT_LEVELS_AUTO 0
+#define ADSBIG_CONVERT_LEVELS_MANUAL 1
+
+class ADSBIGConvert {
+
+ public:
+  static void toUInt8(const epicsUInt16 *pIn, epicsUInt8 *pOut, size_t nPixels,
+                      epicsUInt16 black, epicsUInt16 white);
+  static void toFloat32(const epicsUInt16 *pIn, epicsFloat32 *pOut, size_t nPixels,
+                        epicsUInt16 pedestal, epicsFloat32 scale);
+  static void addFloat32(const epicsUInt16 *pIn, epicsFloat32 *pOut, size_t nPixels,
+                         epicsUInt16 pedestal, epicsFloat32 scale);
+
+};
+
+#endif //ADSBIG_CONVERT_H
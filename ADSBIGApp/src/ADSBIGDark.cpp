@@ -0,0 +1,239 @@
+/**
+ * Master dark library for the ADSBIG areaDetector driver.
+ *
+ * The library file is a simple binary file in the byte order of the
+ * host. It starts with the ADSBIG_DARK_MAGIC string, a version number
+ * and the number of master darks. Each master dark is then written as
+ * its key, the number of pixels and the pixel data.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "ADSBIGDark.h"
+
+#define ADSBIG_DARK_MAGIC "ADSBIGDK"
+#define ADSBIG_DARK_MAGIC_SIZE 8
+#define ADSBIG_DARK_VERSION 1
+#define ADSBIG_DARK_KEY_FIELDS 7
+
+static void keyToFields(const ADSBIGDarkKey &key, epicsInt32 *pFields)
+{
+  pFields[0] = key.exposure;
+  pFields[1] = key.readoutMode;
+  pFields[2] = key.minX;
+  pFields[3] = key.minY;
+  pFields[4] = key.sizeX;
+  pFields[5] = key.sizeY;
+  pFields[6] = key.tempBucket;
+}
+
+static void fieldsToKey(const epicsInt32 *pFields, ADSBIGDarkKey &key)
+{
+  key.exposure = pFields[0];
+  key.readoutMode = pFields[1];
+  key.minX = pFields[2];
+  key.minY = pFields[3];
+  key.sizeX = pFields[4];
+  key.sizeY = pFields[5];
+  key.tempBucket = pFields[6];
+}
+
+bool ADSBIGDarkKey::operator<(const ADSBIGDarkKey &other) const
+{
+  epicsInt32 fields[ADSBIG_DARK_KEY_FIELDS];
+  epicsInt32 otherFields[ADSBIG_DARK_KEY_FIELDS];
+  keyToFields(*this, fields);
+  keyToFields(other, otherFields);
+  for (int i=0; i<ADSBIG_DARK_KEY_FIELDS; ++i) {
+    if (fields[i] != otherFields[i]) {
+      return fields[i] < otherFields[i];
+    }
+  }
+  return false;
+}
+
+ADSBIGDarkLibrary::ADSBIGDarkLibrary()
+{
+}
+
+/**
+ * Make the key for a master dark.
+ * @param exposure The exposure time in seconds
+ * @param readoutMode The camera readout mode (which sets the binning)
+ * @param minX, minY, sizeX, sizeY The subframe, in binned pixels
+ * @param temperature The CCD temperature in degrees C
+ * @param tempBucketSize Temperatures within this many degrees share a
+ * master dark (<= 0 to ignore the temperature)
+ */
+ADSBIGDarkKey ADSBIGDarkLibrary::makeKey(double exposure, int readoutMode,
+                                         int minX, int minY, int sizeX, int sizeY,
+                                         double temperature, double tempBucketSize)
+{
+  ADSBIGDarkKey key;
+  key.exposure = static_cast<epicsInt32>(floor(exposure * 100.0 + 0.5));
+  key.readoutMode = readoutMode;
+  key.minX = minX;
+  key.minY = minY;
+  key.sizeX = sizeX;
+  key.sizeY = sizeY;
+  if (tempBucketSize > 0) {
+    key.tempBucket = static_cast<epicsInt32>(floor(temperature / tempBucketSize + 0.5));
+  } else {
+    key.tempBucket = 0;
+  }
+  return key;
+}
+
+/**
+ * Find the master dark for a key.
+ * @return A pointer to sizeX*sizeY pixels, or NULL if there is no match.
+ * The pointer is valid until the library is next modified.
+ */
+const epicsUInt16 *ADSBIGDarkLibrary::find(const ADSBIGDarkKey &key) const
+{
+  std::map<ADSBIGDarkKey, std::vector<epicsUInt16> >::const_iterator it = m_masters.find(key);
+  if ((it == m_masters.end()) || (it->second.empty())) {
+    return NULL;
+  }
+  return &(it->second[0]);
+}
+
+/**
+ * Add a master dark, replacing any existing one with the same key.
+ */
+void ADSBIGDarkLibrary::add(const ADSBIGDarkKey &key, const std::vector<epicsUInt16> &master)
+{
+  m_masters[key] = master;
+}
+
+void ADSBIGDarkLibrary::clear(void)
+{
+  m_masters.clear();
+}
+
+size_t ADSBIGDarkLibrary::size(void) const
+{
+  return m_masters.size();
+}
+
+/**
+ * The memory used by the master dark pixels.
+ */
+size_t ADSBIGDarkLibrary::bytes(void) const
+{
+  size_t total = 0;
+  std::map<ADSBIGDarkKey, std::vector<epicsUInt16> >::const_iterator it;
+  for (it = m_masters.begin(); it != m_masters.end(); ++it) {
+    total += it->second.size() * sizeof(epicsUInt16);
+  }
+  return total;
+}
+
+/**
+ * Write all the master darks to a file.
+ * @param fileName The file to write (it is overwritten)
+ * @param errorMessage Set to a description of the error on failure
+ * @return true on success
+ */
+bool ADSBIGDarkLibrary::save(const std::string &fileName, std::string &errorMessage) const
+{
+  FILE *fp = NULL;
+  bool ok = true;
+  epicsUInt32 version = ADSBIG_DARK_VERSION;
+  epicsUInt32 count = static_cast<epicsUInt32>(m_masters.size());
+  epicsInt32 fields[ADSBIG_DARK_KEY_FIELDS];
+  epicsUInt32 nPixels = 0;
+
+  if ((fp = fopen(fileName.c_str(), "wb")) == NULL) {
+    errorMessage = "Failed to open " + fileName + " for writing";
+    return false;
+  }
+
+  ok = (fwrite(ADSBIG_DARK_MAGIC, 1, ADSBIG_DARK_MAGIC_SIZE, fp) == ADSBIG_DARK_MAGIC_SIZE) && ok;
+  ok = (fwrite(&version, sizeof(version), 1, fp) == 1) && ok;
+  ok = (fwrite(&count, sizeof(count), 1, fp) == 1) && ok;
+
+  std::map<ADSBIGDarkKey, std::vector<epicsUInt16> >::const_iterator it;
+  for (it = m_masters.begin(); (it != m_masters.end()) && ok; ++it) {
+    keyToFields(it->first, fields);
+    nPixels = static_cast<epicsUInt32>(it->second.size());
+    ok = (fwrite(fields, sizeof(fields), 1, fp) == 1) && ok;
+    ok = (fwrite(&nPixels, sizeof(nPixels), 1, fp) == 1) && ok;
+    if (nPixels > 0) {
+      ok = (fwrite(&(it->second[0]), sizeof(epicsUInt16), nPixels, fp) == nPixels) && ok;
+    }
+  }
+
+  if (fclose(fp) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    errorMessage = "Failed to write " + fileName;
+  }
+  return ok;
+}
+
+/**
+ * Replace the master darks with those in a file. The library
+ * is not changed if the file can't be read.
+ * @param fileName The file to read
+ * @param errorMessage Set to a description of the error on failure
+ * @return true on success
+ */
+bool ADSBIGDarkLibrary::load(const std::string &fileName, std::string &errorMessage)
+{
+  FILE *fp = NULL;
+  bool ok = true;
+  char magic[ADSBIG_DARK_MAGIC_SIZE];
+  epicsUInt32 version = 0;
+  epicsUInt32 count = 0;
+  epicsInt32 fields[ADSBIG_DARK_KEY_FIELDS];
+  epicsUInt32 nPixels = 0;
+  ADSBIGDarkKey key;
+  std::map<ADSBIGDarkKey, std::vector<epicsUInt16> > masters;
+
+  if ((fp = fopen(fileName.c_str(), "rb")) == NULL) {
+    errorMessage = "Failed to open " + fileName;
+    return false;
+  }
+
+  ok = (fread(magic, 1, ADSBIG_DARK_MAGIC_SIZE, fp) == ADSBIG_DARK_MAGIC_SIZE);
+  ok = ok && (memcmp(magic, ADSBIG_DARK_MAGIC, ADSBIG_DARK_MAGIC_SIZE) == 0);
+  ok = ok && (fread(&version, sizeof(version), 1, fp) == 1) && (version == ADSBIG_DARK_VERSION);
+  ok = ok && (fread(&count, sizeof(count), 1, fp) == 1);
+  if (!ok) {
+    fclose(fp);
+    errorMessage = fileName + " is not a dark library file";
+    return false;
+  }
+
+  for (epicsUInt32 i=0; (i<count) && ok; ++i) {
+    ok = (fread(fields, sizeof(fields), 1, fp) == 1);
+    ok = ok && (fread(&nPixels, sizeof(nPixels), 1, fp) == 1);
+    if (ok) {
+      fieldsToKey(fields, key);
+      //Guard against a corrupt file asking for a huge allocation
+      if ((key.sizeX <= 0) || (key.sizeY <= 0) ||
+          (nPixels != static_cast<epicsUInt32>(key.sizeX) * static_cast<epicsUInt32>(key.sizeY))) {
+        ok = false;
+      }
+    }
+    if (ok) {
+      std::vector<epicsUInt16> &master = masters[key];
+      master.resize(nPixels);
+      ok = (fread(&master[0], sizeof(epicsUInt16), nPixels, fp) == nPixels);
+    }
+  }
+
+  fclose(fp);
+  if (!ok) {
+    errorMessage = "Failed to read " + fileName;
+    return false;
+  }
+
+  m_masters.swap(masters);
+  return true;
+}
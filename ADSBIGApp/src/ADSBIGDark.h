@@ -0,0 +1,58 @@
+/**
+ * Master dark library for the ADSBIG areaDetector driver.
+ *
+ * Master darks are averages of several dark frames. They are kept
+ * in memory, keyed by everything that changes the dark signal or
+ * the shape of the frame, so that the driver can subtract the
+ * matching master dark from each light frame as it is read out.
+ * The library can be saved to and loaded from a file.
+ *
+ */
+
+#ifndef ADSBIG_DARK_H
+#define ADSBIG_DARK_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+
+//Identifies a master dark. Exposure is in units of 0.01s (the camera
+//resolution) and temperature in buckets of the configured size.
+struct ADSBIGDarkKey {
+  epicsInt32 exposure;
+  epicsInt32 readoutMode;
+  epicsInt32 minX;
+  epicsInt32 minY;
+  epicsInt32 sizeX;
+  epicsInt32 sizeY;
+  epicsInt32 tempBucket;
+
+  bool operator<(const ADSBIGDarkKey &other) const;
+};
+
+class ADSBIGDarkLibrary {
+
+ public:
+  ADSBIGDarkLibrary();
+
+  static ADSBIGDarkKey makeKey(double exposure, int readoutMode,
+                               int minX, int minY, int sizeX, int sizeY,
+                               double temperature, double tempBucketSize);
+
+  const epicsUInt16 *find(const ADSBIGDarkKey &key) const;
+  void add(const ADSBIGDarkKey &key, const std::vector<epicsUInt16> &master);
+  void clear(void);
+  size_t size(void) const;
+  size_t bytes(void) const;
+
+  bool save(const std::string &fileName, std::string &errorMessage) const;
+  bool load(const std::string &fileName, std::string &errorMessage);
+
+ private:
+  std::map<ADSBIGDarkKey, std::vector<epicsUInt16> > m_masters;
+
+};
+
+#endif //ADSBIG_DARK_H
@@ -0,0 +1,431 @@
+/**
+ * Bayer demosaic for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <math.h>
+#include <limits>
+#include <vector>
+
+#include "ADSBIGDemosaic.h"
+
+//Pixels of padding at each end of a row, so the kernels can read two
+//pixels either side of a pair that starts one pixel before the row
+#define ADSBIG_DEMOSAIC_PAD 4
+
+//Input rows kept by each thread (the row being processed and two either side),
+//and the three output rows
+#define ADSBIG_DEMOSAIC_IN_ROWS 5
+#define ADSBIG_DEMOSAIC_ROWS (ADSBIG_DEMOSAIC_IN_ROWS + 3)
+
+//The row kernels read and write several rows. Telling the compiler they
+//do not overlap lets it vectorise the loops.
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define ADSBIG_RESTRICT __restrict
+#else
+#define ADSBIG_RESTRICT
+#endif
+
+/**
+ * Reflect a row or column index at the frame edges (-1 is 1, and so on),
+ * which keeps the Bayer colour of the pixel.
+ */
+static inline int reflectIndex(int index, int size)
+{
+  if (index < 0) {
+    return -index;
+  }
+  if (index >= size) {
+    return 2*size - 2 - index;
+  }
+  return index;
+}
+
+/**
+ * Convert a row to the compute type, and fill in the padding by reflection.
+ * @param pSrc The raw pixels
+ * @param pDest The first pixel of the padded row
+ */
+template <typename T, typename F>
+static void loadRow(const T *ADSBIG_RESTRICT pSrc, F *ADSBIG_RESTRICT pDest, int width)
+{
+  for (int x=0; x<width; ++x) {
+    pDest[x] = static_cast<F>(pSrc[x]);
+  }
+  for (int k=1; k<=ADSBIG_DEMOSAIC_PAD; ++k) {
+    pDest[-k] = pDest[k];
+    pDest[width - 1 + k] = pDest[width - 1 - k];
+  }
+}
+
+/**
+ * Bilinear interpolation of one row. The row has the primary colour (red
+ * or blue) at columns of parity p, and green in between. The rows above
+ * and below have the secondary colour in the columns between the primary
+ * ones. Each loop does a primary pixel and the green pixel after it.
+ * @param pA The row above
+ * @param pC The row
+ * @param pB The row below
+ * @param pP Output primary colour
+ * @param pG Output green
+ * @param pS Output secondary colour
+ */
+template <typename F>
+static void bilinearRow(const F *ADSBIG_RESTRICT pA, const F *ADSBIG_RESTRICT pC, const F *ADSBIG_RESTRICT pB,
+                        F *ADSBIG_RESTRICT pP, F *ADSBIG_RESTRICT pG, F *ADSBIG_RESTRICT pS, int width, int p)
+{
+  const int numPairs = (width + p + 1) / 2;
+  const F quarter = static_cast<F>(0.25);
+  const F half = static_cast<F>(0.5);
+
+  for (int i=0; i<numPairs; ++i) {
+    const int x = 2*i - p;
+    pP[x] = pC[x];
+    pG[x] = (pC[x-1] + pC[x+1] + pA[x] + pB[x]) * quarter;
+    pS[x] = (pA[x-1] + pA[x+1] + pB[x-1] + pB[x+1]) * quarter;
+    pP[x+1] = (pC[x] + pC[x+2]) * half;
+    pG[x+1] = pC[x+1];
+    pS[x+1] = (pA[x+1] + pB[x+1]) * half;
+  }
+}
+
+/**
+ * Edge aware green for one row. At each primary pixel the horizontal and
+ * vertical estimates of green (each corrected by the second derivative of
+ * the primary colour) are weighted by the gradient in the other direction,
+ * so green comes from along an edge rather than across it, and is the mean
+ * of both where there is no edge. The padding of the output row is filled in too.
+ * @param pA2 Two rows above
+ * @param pA The row above
+ * @param pC The row
+ * @param pB The row below
+ * @param pB2 Two rows below
+ * @param pGreen Output green
+ */
+template <typename F>
+static void greenRow(const F *ADSBIG_RESTRICT pA2, const F *ADSBIG_RESTRICT pA, const F *ADSBIG_RESTRICT pC,
+                     const F *ADSBIG_RESTRICT pB, const F *ADSBIG_RESTRICT pB2, F *ADSBIG_RESTRICT pGreen, int width, int p)
+{
+  const int numPairs = (width + p + 1) / 2;
+  const F quarter = static_cast<F>(0.25);
+  const F half = static_cast<F>(0.5);
+  //Keeps the weights from both being zero, without changing them otherwise
+  const F tiny = static_cast<F>(1.0e-20);
+
+  for (int i=0; i<numPairs; ++i) {
+    const int x = 2*i - p;
+    const F lapH = 2*pC[x] - pC[x-2] - pC[x+2];
+    const F lapV = 2*pC[x] - pA2[x] - pB2[x];
+    const F gradH = fabs(pC[x-1] - pC[x+1]) + fabs(lapH);
+    const F gradV = fabs(pA[x] - pB[x]) + fabs(lapV);
+    const F greenH = (pC[x-1] + pC[x+1]) * half + lapH * quarter;
+    const F greenV = (pA[x] + pB[x]) * half + lapV * quarter;
+    const F weightH = gradV + tiny;
+    const F weightV = gradH + tiny;
+    pGreen[x] = (greenH * weightH + greenV * weightV) / (weightH + weightV);
+    pGreen[x+1] = pC[x+1];
+  }
+  for (int k=1; k<=ADSBIG_DEMOSAIC_PAD; ++k) {
+    pGreen[-k] = pGreen[k];
+    pGreen[width - 1 + k] = pGreen[width - 1 - k];
+  }
+}
+
+/**
+ * Red and blue for one row of the edge aware method, by bilinear
+ * interpolation of their difference from the green found by greenRow.
+ * @param pA The row above
+ * @param pC The row
+ * @param pB The row below
+ * @param pGA Green for the row above
+ * @param pGC Green for the row
+ * @param pGB Green for the row below
+ * @param pP Output primary colour
+ * @param pG Output green
+ * @param pS Output secondary colour
+ */
+template <typename F>
+static void redBlueRow(const F *ADSBIG_RESTRICT pA, const F *ADSBIG_RESTRICT pC, const F *ADSBIG_RESTRICT pB,
+                       const F *ADSBIG_RESTRICT pGA, const F *ADSBIG_RESTRICT pGC, const F *ADSBIG_RESTRICT pGB,
+                       F *ADSBIG_RESTRICT pP, F *ADSBIG_RESTRICT pG, F *ADSBIG_RESTRICT pS, int width, int p)
+{
+  const int numPairs = (width + p + 1) / 2;
+  const F quarter = static_cast<F>(0.25);
+  const F half = static_cast<F>(0.5);
+
+  for (int i=0; i<numPairs; ++i) {
+    const int x = 2*i - p;
+    pP[x] = pC[x];
+    pG[x] = pGC[x];
+    pS[x] = pGC[x] + ((pA[x-1] - pGA[x-1]) + (pA[x+1] - pGA[x+1]) +
+                      (pB[x-1] - pGB[x-1]) + (pB[x+1] - pGB[x+1])) * quarter;
+    pP[x+1] = pGC[x+1] + ((pC[x] - pGC[x]) + (pC[x+2] - pGC[x+2])) * half;
+    pG[x+1] = pC[x+1];
+    pS[x+1] = pGC[x+1] + ((pA[x+1] - pGA[x+1]) + (pB[x+1] - pGB[x+1])) * half;
+  }
+}
+
+/**
+ * Round a computed row and clamp it to the range of an integer pixel type,
+ * in place. The comparisons are written so that they become min and max
+ * instructions; std::min and std::max are not vectorised.
+ */
+template <typename T, typename F>
+static void clampRow(F *ADSBIG_RESTRICT pRow, int width)
+{
+  const F maxValue = static_cast<F>(std::numeric_limits<T>::max());
+  const F zero = static_cast<F>(0);
+  const F half = static_cast<F>(0.5);
+
+  for (int x=0; x<width; ++x) {
+    F value = pRow[x] + half;
+    value = (value > zero) ? value : zero;
+    pRow[x] = (value < maxValue) ? value : maxValue;
+  }
+}
+
+//Float32 pixels are not rounded or clamped
+template <>
+void clampRow<epicsFloat32, epicsFloat32>(epicsFloat32 *ADSBIG_RESTRICT pRow, int width)
+{
+}
+
+/**
+ * Interleave the red, green and blue rows into an RGB1 output row.
+ * They have been clamped to the pixel range by clampRow.
+ */
+template <typename T, typename F>
+static void storeRow(T *ADSBIG_RESTRICT pOut, const F *ADSBIG_RESTRICT pRed, const F *ADSBIG_RESTRICT pGreen,
+                     const F *ADSBIG_RESTRICT pBlue, int width)
+{
+  for (int x=0; x<width; ++x) {
+    pOut[3*x] = static_cast<T>(pRed[x]);
+    pOut[3*x + 1] = static_cast<T>(pGreen[x]);
+    pOut[3*x + 2] = static_cast<T>(pBlue[x]);
+  }
+}
+
+/**
+ * Constructor.
+ * @param pPool The threads that process rows. This can be shared with
+ * other users, and must outlive the demosaic.
+ */
+ADSBIGDemosaic::ADSBIGDemosaic(ADSBIGRowPool *pPool) :
+  m_pPool(pPool), m_pass(PASS_BILINEAR), m_dataType(NDUInt16),
+  m_width(0), m_height(0), m_pattern(0), m_pIn(NULL), m_pOut(NULL)
+{
+  m_mutex = epicsMutexMustCreate();
+
+  //Each thread has its own rows. The calling thread is thread 0.
+  m_scratch.resize(m_pPool->numThreads());
+}
+
+/**
+ * Destructor.
+ */
+ADSBIGDemosaic::~ADSBIGDemosaic()
+{
+  epicsMutexDestroy(m_mutex);
+}
+
+/**
+ * @return The number of threads used, including the calling thread
+ */
+int ADSBIGDemosaic::numThreads(void) const
+{
+  return m_pPool->numThreads();
+}
+
+/**
+ * @return true if frames of this data type can be demosaiced
+ */
+bool ADSBIGDemosaic::supported(NDDataType_t dataType)
+{
+  return ((dataType == NDUInt8) || (dataType == NDUInt16) ||
+          (dataType == NDUInt32) || (dataType == NDInt32) || (dataType == NDFloat32));
+}
+
+/**
+ * The Bayer pattern of a frame, from the pattern of the CCD. The subframe
+ * origin (in binned pixels) shifts the pattern. With an odd binning each
+ * binned pixel still starts on a known colour, so the pattern follows the
+ * origin; with an even binning every binned pixel has all the colours, so
+ * there is nothing to demosaic.
+ * @param pattern The Bayer pattern of the CCD at its first unbinned pixel
+ * @param binX The horizontal binning
+ * @param binY The vertical binning
+ * @param originX The first column of the frame, in binned pixels
+ * @param originY The first row of the frame, in binned pixels
+ * @return The Bayer pattern of the frame, or ADSBIG_BAYER_NONE
+ */
+int ADSBIGDemosaic::framePattern(int pattern, int binX, int binY, int originX, int originY)
+{
+  if (((binX % 2) == 0) || ((binY % 2) == 0) || (pattern < ADSBIG_BAYER_RGGB) || (pattern > ADSBIG_BAYER_BGGR)) {
+    return ADSBIG_BAYER_NONE;
+  }
+
+  return pattern ^ (originY & 1) ^ ((originX & 1) << 1);
+}
+
+/**
+ * Demosaic a frame.
+ * @param pIn The raw frame, width*height pixels
+ * @param pOut The RGB1 output, 3*width*height pixels of the same data type
+ * @param dataType The data type of the input and output (see supported)
+ * @param width The frame width
+ * @param height The frame height
+ * @param method ADSBIG_DEMOSAIC_BILINEAR or ADSBIG_DEMOSAIC_EDGE
+ * @param pattern The Bayer pattern of the frame (see framePattern)
+ * @return false if the frame can't be demosaiced
+ */
+bool ADSBIGDemosaic::process(const void *pIn, void *pOut, NDDataType_t dataType, int width, int height,
+                             int method, int pattern)
+{
+  const size_t rowSize = static_cast<size_t>(width) + 2*ADSBIG_DEMOSAIC_PAD;
+
+  if (!supported(dataType) || (width < ADSBIG_DEMOSAIC_MIN_SIZE) || (height < ADSBIG_DEMOSAIC_MIN_SIZE) ||
+      ((method != ADSBIG_DEMOSAIC_BILINEAR) && (method != ADSBIG_DEMOSAIC_EDGE)) ||
+      (pattern < ADSBIG_BAYER_RGGB) || (pattern > ADSBIG_BAYER_BGGR)) {
+    return false;
+  }
+
+  epicsMutexMustLock(m_mutex);
+  m_pIn = pIn;
+  m_pOut = pOut;
+  m_dataType = dataType;
+  m_width = width;
+  m_height = height;
+  m_pattern = pattern;
+
+  //UInt32 and Int32 frames (co-added exposures) need double precision
+  const bool wide = ((dataType == NDUInt32) || (dataType == NDInt32));
+  for (size_t thread=0; thread<m_scratch.size(); ++thread) {
+    if (wide) {
+      m_scratch[thread].rows64.resize(ADSBIG_DEMOSAIC_ROWS * rowSize);
+    } else {
+      m_scratch[thread].rows32.resize(ADSBIG_DEMOSAIC_ROWS * rowSize);
+    }
+  }
+
+  if (method == ADSBIG_DEMOSAIC_BILINEAR) {
+    run(PASS_BILINEAR);
+  } else {
+    if (wide) {
+      m_green64.resize(height * rowSize);
+    } else {
+      m_green32.resize(height * rowSize);
+    }
+    run(PASS_GREEN);
+    run(PASS_RED_BLUE);
+  }
+  epicsMutexUnlock(m_mutex);
+
+  return true;
+}
+
+/**
+ * Run a pass over all the rows, on the worker threads and the calling
+ * thread, and wait for it to finish. Called with m_mutex held.
+ */
+void ADSBIGDemosaic::run(Pass pass)
+{
+  m_pass = pass;
+  m_pPool->run(this, m_height, (static_cast<size_t>(m_width) * m_height) >= ADSBIG_DEMOSAIC_MIN_PARALLEL);
+}
+
+void ADSBIGDemosaic::processRows(int thread, int firstRow, int numRows)
+{
+  Scratch &scratch = m_scratch[thread];
+
+  switch (m_dataType) {
+  case NDUInt8:
+    processRowsT<epicsUInt8, epicsFloat32>(scratch, scratch.rows32, m_green32, firstRow, numRows);
+    break;
+  case NDUInt16:
+    processRowsT<epicsUInt16, epicsFloat32>(scratch, scratch.rows32, m_green32, firstRow, numRows);
+    break;
+  case NDUInt32:
+    processRowsT<epicsUInt32, epicsFloat64>(scratch, scratch.rows64, m_green64, firstRow, numRows);
+    break;
+  case NDInt32:
+    processRowsT<epicsInt32, epicsFloat64>(scratch, scratch.rows64, m_green64, firstRow, numRows);
+    break;
+  case NDFloat32:
+    processRowsT<epicsFloat32, epicsFloat32>(scratch, scratch.rows32, m_green32, firstRow, numRows);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Get a padded input row, converting it if this thread does not already have it.
+ * Rows outside the frame are reflected. A row is kept in slot (row mod 5),
+ * so the five rows around the row being processed never share a slot.
+ * @return The first pixel of the row
+ */
+template <typename T, typename F>
+const F *ADSBIGDemosaic::inputRow(Scratch &scratch, std::vector<F> &rows, int row)
+{
+  const size_t rowSize = static_cast<size_t>(m_width) + 2*ADSBIG_DEMOSAIC_PAD;
+  const int frameRow = reflectIndex(row, m_height);
+  const int slot = frameRow % ADSBIG_DEMOSAIC_IN_ROWS;
+  F *pRow = &rows[slot * rowSize + ADSBIG_DEMOSAIC_PAD];
+
+  if (scratch.rowIds[slot] != frameRow) {
+    loadRow(static_cast<const T *>(m_pIn) + static_cast<size_t>(frameRow) * m_width, pRow, m_width);
+    scratch.rowIds[slot] = frameRow;
+  }
+
+  return pRow;
+}
+
+template <typename T, typename F>
+void ADSBIGDemosaic::processRowsT(Scratch &scratch, std::vector<F> &rows, std::vector<F> &green,
+                                  int firstRow, int numRows)
+{
+  const size_t rowSize = static_cast<size_t>(m_width) + 2*ADSBIG_DEMOSAIC_PAD;
+  const int redY = m_pattern & 1;
+  const int redX = (m_pattern >> 1) & 1;
+  F *pP = &rows[ADSBIG_DEMOSAIC_IN_ROWS * rowSize + ADSBIG_DEMOSAIC_PAD];
+  F *pG = pP + rowSize;
+  F *pS = pG + rowSize;
+
+  for (int slot=0; slot<ADSBIG_DEMOSAIC_IN_ROWS; ++slot) {
+    scratch.rowIds[slot] = -1;
+  }
+
+  for (int row=firstRow; row<(firstRow + numRows); ++row) {
+    //Red rows have red (the primary colour) at the red column, blue rows have blue at the other column
+    const bool redRow = ((row & 1) == redY);
+    const int p = redRow ? redX : (redX ^ 1);
+    T *pOut = static_cast<T *>(m_pOut) + static_cast<size_t>(row) * m_width * 3;
+
+    if (m_pass == PASS_BILINEAR) {
+      bilinearRow(inputRow<T, F>(scratch, rows, row - 1), inputRow<T, F>(scratch, rows, row),
+                  inputRow<T, F>(scratch, rows, row + 1), pP, pG, pS, m_width, p);
+    } else if (m_pass == PASS_GREEN) {
+      greenRow(inputRow<T, F>(scratch, rows, row - 2), inputRow<T, F>(scratch, rows, row - 1),
+               inputRow<T, F>(scratch, rows, row), inputRow<T, F>(scratch, rows, row + 1),
+               inputRow<T, F>(scratch, rows, row + 2),
+               &green[row * rowSize + ADSBIG_DEMOSAIC_PAD], m_width, p);
+      continue;
+    } else {
+      redBlueRow(inputRow<T, F>(scratch, rows, row - 1), inputRow<T, F>(scratch, rows, row),
+                 inputRow<T, F>(scratch, rows, row + 1),
+                 &green[reflectIndex(row - 1, m_height) * rowSize + ADSBIG_DEMOSAIC_PAD],
+                 &green[row * rowSize + ADSBIG_DEMOSAIC_PAD],
+                 &green[reflectIndex(row + 1, m_height) * rowSize + ADSBIG_DEMOSAIC_PAD],
+                 pP, pG, pS, m_width, p);
+    }
+
+    clampRow<T, F>(pP, m_width);
+    clampRow<T, F>(pG, m_width);
+    clampRow<T, F>(pS, m_width);
+    if (redRow) {
+      storeRow(pOut, pP, pG, pS, m_width);
+    } else {
+      storeRow(pOut, pS, pG, pP, m_width);
+    }
+  }
+}
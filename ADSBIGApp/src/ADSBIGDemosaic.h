@@ -0,0 +1,99 @@
+/**
+ * Bayer demosaic for the ADSBIG areaDetector driver.
+ *
+ * Turns the raw frame of a colour CCD into a pixel interleaved RGB frame
+ * (NDColorModeRGB1). Bilinear interpolation averages the nearest pixels
+ * of each colour. The edge aware method first fills in green from the
+ * horizontal and vertical Hamilton-Adams estimates (with a second
+ * derivative correction from the red or blue pixel), weighted towards the
+ * direction with the smaller gradient. It then fills in red and blue by
+ * interpolating their difference from green, so that colour edges line
+ * up with the luminance edges.
+ *
+ * The rows are processed in parallel by a pool of worker threads (see
+ * ADSBIGRowPool). Each thread converts the rows it needs into padded
+ * floating point rows (reflected at the frame edges), so the row loops
+ * have no edge cases or branches.
+ *
+ */
+
+#ifndef ADSBIG_DEMOSAIC_H
+#define ADSBIG_DEMOSAIC_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+#include "NDArray.h"
+#include "ADSBIGRowPool.h"
+
+//Demosaic methods (ADSBIGDemosaicParam)
+#define ADSBIG_DEMOSAIC_NONE 0
+#define ADSBIG_DEMOSAIC_BILINEAR 1
+#define ADSBIG_DEMOSAIC_EDGE 2
+
+//Bayer patterns, named from the top left 2x2 cell (the same values as
+//NDBayerPattern_t). Bit 0 is the row of the red pixel in the cell, and
+//bit 1 is its column.
+#define ADSBIG_BAYER_RGGB 0
+#define ADSBIG_BAYER_GBRG 1
+#define ADSBIG_BAYER_GRBG 2
+#define ADSBIG_BAYER_BGGR 3
+//The frame has no Bayer pattern (see framePattern)
+#define ADSBIG_BAYER_NONE 4
+
+//Smallest frame (in each direction) that can be demosaiced
+#define ADSBIG_DEMOSAIC_MIN_SIZE 5
+
+//Frames smaller than this (in pixels) are not worth splitting across threads
+#define ADSBIG_DEMOSAIC_MIN_PARALLEL 65536
+
+class ADSBIGDemosaic : private ADSBIGRowTask {
+
+ public:
+  ADSBIGDemosaic(ADSBIGRowPool *pPool);
+  ~ADSBIGDemosaic();
+
+  bool process(const void *pIn, void *pOut, NDDataType_t dataType, int width, int height,
+               int method, int pattern);
+  int numThreads(void) const;
+
+  static bool supported(NDDataType_t dataType);
+  static int framePattern(int pattern, int binX, int binY, int originX, int originY);
+
+ private:
+  enum Pass { PASS_BILINEAR, PASS_GREEN, PASS_RED_BLUE };
+
+  //Rows used by one thread
+  struct Scratch {
+    std::vector<epicsFloat32> rows32;
+    std::vector<epicsFloat64> rows64;
+    int rowIds[5];
+  };
+
+  void run(Pass pass);
+  void processRows(int thread, int firstRow, int numRows);
+  template <typename T, typename F> void processRowsT(Scratch &scratch, std::vector<F> &rows,
+                                                       std::vector<F> &green, int firstRow, int numRows);
+  template <typename T, typename F> const F *inputRow(Scratch &scratch, std::vector<F> &rows, int row);
+
+  ADSBIGRowPool *m_pPool;
+  epicsMutexId m_mutex;
+  std::vector<Scratch> m_scratch;
+  std::vector<epicsFloat32> m_green32;
+  std::vector<epicsFloat64> m_green64;
+
+  //The current operation. Only set while m_mutex is held and the workers are idle.
+  Pass m_pass;
+  NDDataType_t m_dataType;
+  int m_width;
+  int m_height;
+  int m_pattern;
+  const void *m_pIn;
+  void *m_pOut;
+
+};
+
+#endif //ADSBIG_DEMOSAIC_H
@@ -0,0 +1,334 @@
+/**
+ * FITS file writer for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include <epicsThread.h>
+#include <epicsStdio.h>
+
+#ifdef ADSBIG_CFITSIO
+#include "fitsio.h"
+#endif
+
+#include "ADSBIGFits.h"
+
+static void ADSBIGFitsWorkerC(void *drvPvt)
+{
+  ADSBIGFitsWriter *pPvt = (ADSBIGFitsWriter *)drvPvt;
+
+  pPvt->workerTask();
+}
+
+ADSBIGFitsHeader::ADSBIGFitsHeader() :
+  compression(ADSBIG_FITS_NONE), exposureTime(0.0), numExposures(1), ccdTemp(0.0),
+  pixelWidth(0.0), pixelHeight(0.0), binX(1), binY(1), originX(0), originY(0),
+  eGain(0.0), pedestal(0), dataMax(65535), readoutMode(0)
+{
+  startTime.secPastEpoch = 0;
+  startTime.nsec = 0;
+}
+
+/**
+ * Constructor. This starts the worker threads.
+ * @param numThreads The number of worker threads
+ * @param queueSize The most NDArrays that can be waiting (or being written) at once
+ * @param pCallback Called from a worker thread after each file has been written (or failed)
+ * @param pUserData Passed to pCallback
+ */
+ADSBIGFitsWriter::ADSBIGFitsWriter(int numThreads, int queueSize, ADSBIGFitsDoneCallback pCallback, void *pUserData) :
+  m_queueSize(queueSize), m_pending(0), m_pCallback(pCallback), m_pCallbackData(pUserData)
+{
+  char threadName[32];
+
+  m_mutex = epicsMutexMustCreate();
+  m_event = epicsEventMustCreate(epicsEventEmpty);
+
+  for (int thread=0; thread<numThreads; ++thread) {
+    epicsSnprintf(threadName, sizeof(threadName), "ADSBIGFitsWriter%d", thread);
+    if (epicsThreadCreate(threadName, epicsThreadPriorityLow,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)ADSBIGFitsWorkerC, this) == NULL) {
+      printf("ADSBIGFitsWriter::ADSBIGFitsWriter epicsThreadCreate failure for %s.\n", threadName);
+    }
+  }
+}
+
+/**
+ * Queue an NDArray to be written. The array is reserved until it has been written.
+ * @param pArray The NDArray
+ * @param header The FITS header values and file name
+ * @return false if the queue is full, in which case the array is not written
+ */
+bool ADSBIGFitsWriter::queue(NDArray *pArray, const ADSBIGFitsHeader &header)
+{
+  ADSBIGFitsJob job;
+
+  epicsMutexMustLock(m_mutex);
+  if (m_pending >= m_queueSize) {
+    epicsMutexUnlock(m_mutex);
+    return false;
+  }
+  pArray->reserve();
+  job.pArray = pArray;
+  job.header = header;
+  m_jobs.push_back(job);
+  m_pending++;
+  epicsMutexUnlock(m_mutex);
+
+  epicsEventSignal(m_event);
+  return true;
+}
+
+/**
+ * @return The number of NDArrays waiting to be written, or being written
+ */
+int ADSBIGFitsWriter::pending(void)
+{
+  int pending = 0;
+
+  epicsMutexMustLock(m_mutex);
+  pending = m_pending;
+  epicsMutexUnlock(m_mutex);
+
+  return pending;
+}
+
+/**
+ * @return true if the writer was built with CFITSIO
+ */
+bool ADSBIGFitsWriter::available(void)
+{
+#ifdef ADSBIG_CFITSIO
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Worker thread function. Each worker writes one file at a time.
+ */
+void ADSBIGFitsWriter::workerTask(void)
+{
+  ADSBIGFitsJob job;
+  ADSBIGFitsResult result;
+  bool haveJob = false;
+
+  while (1) {
+
+    epicsEventWait(m_event);
+
+    do {
+      epicsMutexMustLock(m_mutex);
+      haveJob = !m_jobs.empty();
+      if (haveJob) {
+        job = m_jobs.front();
+        m_jobs.pop_front();
+        //Wake another worker for the next one
+        if (!m_jobs.empty()) {
+          epicsEventSignal(m_event);
+        }
+      }
+      epicsMutexUnlock(m_mutex);
+
+      if (haveJob) {
+        write(job.pArray, job.header, result);
+        job.pArray->release();
+
+        epicsMutexMustLock(m_mutex);
+        m_pending--;
+        epicsMutexUnlock(m_mutex);
+
+        if (m_pCallback != NULL) {
+          m_pCallback(m_pCallbackData, result);
+        }
+      }
+    } while (haveJob);
+
+  }
+}
+
+/**
+ * Write one FITS file.
+ * @param pArray The NDArray (UInt8, UInt16, UInt32 or Float32)
+ * @param header The FITS header values and file name
+ * @param result The outcome, size and time taken
+ * @return true if the file was written
+ */
+bool ADSBIGFitsWriter::write(NDArray *pArray, const ADSBIGFitsHeader &header, ADSBIGFitsResult &result)
+{
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+  NDArrayInfo_t arrayInfo;
+  struct stat fileStat;
+
+  epicsTimeGetCurrent(&startTime);
+  pArray->getInfo(&arrayInfo);
+  result.fileName = header.fileName;
+  result.ok = false;
+  result.message = "";
+  result.rawBytes = arrayInfo.totalBytes;
+  result.fileBytes = 0;
+  result.seconds = 0.0;
+
+#ifdef ADSBIG_CFITSIO
+  fitsfile *fptr = NULL;
+  int status = 0;
+  int bitpix = 0;
+  int datatype = 0;
+  long naxes[3] = {0, 0, 1};
+  //RGB1 frames (demosaiced colour frames) are written as a cube of red, green and blue planes
+  bool rgb = ((pArray->ndims == 3) && (pArray->dims[0].size == 3));
+  std::vector<char> plane;
+  char errorText[FLEN_STATUS];
+  char dateObs[64];
+  struct tm tmStart;
+  unsigned long nsec = 0;
+
+  switch (pArray->dataType) {
+  case NDUInt8:
+    bitpix = BYTE_IMG;
+    datatype = TBYTE;
+    break;
+  case NDUInt16:
+    bitpix = USHORT_IMG;
+    datatype = TUSHORT;
+    break;
+  case NDUInt32:
+    bitpix = ULONG_IMG;
+    datatype = TUINT;
+    break;
+  case NDInt32:
+    bitpix = LONG_IMG;
+    datatype = TINT;
+    break;
+  case NDFloat32:
+    bitpix = FLOAT_IMG;
+    datatype = TFLOAT;
+    break;
+  default:
+    result.message = "Unsupported data type for FITS";
+    return false;
+  }
+  if (rgb) {
+    naxes[0] = static_cast<long>(pArray->dims[1].size);
+    naxes[1] = static_cast<long>(pArray->dims[2].size);
+    naxes[2] = 3;
+  } else if (pArray->ndims == 2) {
+    naxes[0] = static_cast<long>(pArray->dims[0].size);
+    naxes[1] = static_cast<long>(pArray->dims[1].size);
+  } else {
+    result.message = "FITS files need a 2D or RGB1 NDArray";
+    return false;
+  }
+
+  epicsTimeToGMTM(&tmStart, &nsec, &header.startTime);
+  epicsSnprintf(dateObs, sizeof(dateObs), "%04d-%02d-%02dT%02d:%02d:%02d.%03lu",
+                tmStart.tm_year + 1900, tmStart.tm_mon + 1, tmStart.tm_mday,
+                tmStart.tm_hour, tmStart.tm_min, tmStart.tm_sec, nsec / 1000000);
+
+  //Same keywords (and comments) as CSBIGImg::SaveFITS
+  std::string version = "SBFITSEXT Version 1.0";
+  std::string software = "ADSBIG";
+  double exposureTime = header.exposureTime;
+  double ccdTemp = header.ccdTemp;
+  double pixelWidth = header.pixelWidth;
+  double pixelHeight = header.pixelHeight;
+  int binX = header.binX;
+  int binY = header.binY;
+  int originX = header.originX;
+  int originY = header.originY;
+  double eGain = header.eGain;
+  long pedestal = -header.pedestal;
+  long dataMax = header.dataMax;
+  int numExposures = header.numExposures;
+  int readoutMode = header.readoutMode;
+
+  //Replace any existing file, as CSBIGImg::SaveFITS does
+  remove(header.fileName.c_str());
+  fits_create_file(&fptr, header.fileName.c_str(), &status);
+  if (status == 0) {
+    //Floating point data is compressed losslessly, without quantizing it.
+    //CFITSIO can only do that with GZIP, so Rice uses GZIP_2 (shuffled bytes) for it.
+    if ((header.compression == ADSBIG_FITS_RICE) && (pArray->dataType != NDFloat32)) {
+      fits_set_compression_type(fptr, RICE_1, &status);
+    } else if (header.compression == ADSBIG_FITS_RICE) {
+      fits_set_compression_type(fptr, GZIP_2, &status);
+    } else if (header.compression == ADSBIG_FITS_GZIP) {
+      fits_set_compression_type(fptr, GZIP_1, &status);
+    }
+    if ((header.compression != ADSBIG_FITS_NONE) && (pArray->dataType == NDFloat32)) {
+      fits_set_quantize_level(fptr, 0.0, &status);
+    }
+    fits_create_img(fptr, bitpix, rgb ? 3 : 2, naxes, &status);
+    if (!rgb) {
+      fits_write_img(fptr, datatype, 1, naxes[0] * naxes[1], pArray->pData, &status);
+    } else {
+      const size_t numPixels = static_cast<size_t>(naxes[0]) * naxes[1];
+      const size_t pixelBytes = arrayInfo.bytesPerElement;
+      plane.resize(numPixels * pixelBytes);
+      for (int color=0; color<3; ++color) {
+        const char *pSrc = static_cast<const char *>(pArray->pData) + color * pixelBytes;
+        for (size_t pixel=0; pixel<numPixels; ++pixel) {
+          memcpy(&plane[pixel * pixelBytes], pSrc + 3 * pixel * pixelBytes, pixelBytes);
+        }
+        fits_write_img(fptr, datatype, 1 + color * numPixels, numPixels, &plane[0], &status);
+      }
+    }
+
+    fits_write_comment(fptr, "SBIG FITS header format per:", &status);
+    fits_write_comment(fptr, " http://www.sbig.com/pdffiles/SBFITSEXT_1r0.pdf", &status);
+    fits_write_key(fptr, TSTRING, "OBJECT",   (void *)header.object.c_str(), "", &status);
+    fits_write_key(fptr, TSTRING, "TELESCOP", (void *)header.telescope.c_str(), "", &status);
+    fits_write_key(fptr, TSTRING, "INSTRUME", (void *)header.instrument.c_str(), "Camera Model", &status);
+    fits_write_key(fptr, TSTRING, "OBSERVER", (void *)header.observer.c_str(), "", &status);
+    fits_write_key(fptr, TSTRING, "DATE-OBS", dateObs, "GMT START OF EXPOSURE", &status);
+    fits_write_key(fptr, TDOUBLE, "EXPTIME",  &exposureTime, "EXPOSURE IN SECONDS", &status);
+    fits_write_key(fptr, TDOUBLE, "CCD-TEMP", &ccdTemp, "CCD TEMP IN DEGREES C", &status);
+    fits_write_key(fptr, TDOUBLE, "XPIXSZ",   &pixelWidth, "PIXEL WIDTH IN MICRONS", &status);
+    fits_write_key(fptr, TDOUBLE, "YPIXSZ",   &pixelHeight, "PIXEL HEIGHT IN MICRONS", &status);
+    fits_write_key(fptr, TINT,    "XBINNING", &binX, "HORIZONTAL BINNING FACTOR", &status);
+    fits_write_key(fptr, TINT,    "YBINNING", &binY, "VERTICAL BINNING FACTOR", &status);
+    fits_write_key(fptr, TINT,    "XORGSUBF", &originX, "SUB_FRAME ORIGIN X_POS", &status);
+    fits_write_key(fptr, TINT,    "YORGSUBF", &originY, "SUB_FRAME ORIGIN Y_POS", &status);
+    fits_write_key(fptr, TDOUBLE, "EGAIN",    &eGain, "ELECTRONS PER ADU", &status);
+    fits_write_key(fptr, TLONG,   "PEDESTAL", &pedestal, "ADD TO ADU FOR 0-BASE", &status);
+    fits_write_key(fptr, TLONG,   "DATAMAX",  &dataMax, "SATURATION LEVEL", &status);
+    fits_write_key(fptr, TSTRING, "SBSTDVER", (void *)version.c_str(), "SBIG FITS EXTENSIONS VER", &status);
+    fits_write_key(fptr, TSTRING, "SWACQUIR", (void *)software.c_str(), "DATA ACQ SOFTWARE", &status);
+    fits_write_key(fptr, TINT,    "SNAPSHOT", &numExposures, "NUMBER IMAGES COADDED", &status);
+    fits_write_key(fptr, TINT,    "RESMODE",  &readoutMode, "RESOLUTION MODE", &status);
+    fits_write_key(fptr, TSTRING, "IMAGETYP", (void *)header.imageType.c_str(), "", &status);
+    fits_write_date(fptr, &status);
+
+    //Close the file even if something failed, keeping the first error
+    int closeStatus = 0;
+    fits_close_file(fptr, &closeStatus);
+    if (status == 0) {
+      status = closeStatus;
+    }
+  }
+  if (status != 0) {
+    fits_get_errstatus(status, errorText);
+    result.message = std::string("CFITSIO error: ") + errorText;
+    return false;
+  }
+#else
+  result.message = "Driver built without CFITSIO (WITH_CFITSIO=NO)";
+  return false;
+#endif
+
+  epicsTimeGetCurrent(&endTime);
+  result.seconds = epicsTimeDiffInSeconds(&endTime, &startTime);
+  if (stat(header.fileName.c_str(), &fileStat) == 0) {
+    result.fileBytes = static_cast<size_t>(fileStat.st_size);
+  }
+  result.ok = true;
+  return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * FITS file writer for the ADSBIG areaDetector driver.
+ *
+ * NDArrays are queued with a header filled in by the driver, and written
+ * by a pool of worker threads with the SBIG FITS keywords (the same set
+ * as CSBIGImg::SaveFITS). The files can be tile compressed (a row per
+ * tile) with Rice or GZIP. The writer needs CFITSIO; without it
+ * (WITH_CFITSIO=NO) every write fails with an error message.
+ *
+ */
+
+#ifndef ADSBIG_FITS_H
+#define ADSBIG_FITS_H
+
+#include <string>
+#include <deque>
+
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+#include "NDArray.h"
+
+//Compression of the FITS files (ADSBIGFitsCompressParam)
+#define ADSBIG_FITS_NONE 0
+#define ADSBIG_FITS_RICE 1
+#define ADSBIG_FITS_GZIP 2
+
+struct ADSBIGFitsHeader {
+  ADSBIGFitsHeader();
+
+  std::string fileName;
+  int compression;
+  std::string object;
+  std::string telescope;
+  std::string observer;
+  std::string instrument;
+  std::string imageType;
+  epicsTimeStamp startTime;
+  double exposureTime;
+  int numExposures;
+  double ccdTemp;
+  double pixelWidth;
+  double pixelHeight;
+  int binX;
+  int binY;
+  int originX;
+  int originY;
+  double eGain;
+  long pedestal;
+  long dataMax;
+  int readoutMode;
+};
+
+struct ADSBIGFitsResult {
+  std::string fileName;
+  bool ok;
+  std::string message;
+  size_t rawBytes;
+  size_t fileBytes;
+  double seconds;
+};
+
+typedef void (*ADSBIGFitsDoneCallback)(void *pUserData, const ADSBIGFitsResult &result);
+
+class ADSBIGFitsWriter {
+
+ public:
+  ADSBIGFitsWriter(int numThreads, int queueSize, ADSBIGFitsDoneCallback pCallback, void *pUserData);
+
+  bool queue(NDArray *pArray, const ADSBIGFitsHeader &header);
+  int pending(void);
+  static bool available(void);
+
+  void workerTask(void);
+
+ private:
+  bool write(NDArray *pArray, const ADSBIGFitsHeader &header, ADSBIGFitsResult &result);
+
+  struct ADSBIGFitsJob {
+    NDArray *pArray;
+    ADSBIGFitsHeader header;
+  };
+  std::deque<ADSBIGFitsJob> m_jobs;
+  epicsMutexId m_mutex;
+  epicsEventId m_event;
+  int m_queueSize;
+  int m_pending;
+  ADSBIGFitsDoneCallback m_pCallback;
+  void *m_pCallbackData;
+
+};
+
+#endif //ADSBIG_FITS_H
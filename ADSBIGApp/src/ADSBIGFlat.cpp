@@ -0,0 +1,290 @@
+/**
+ * Flat field correction for the ADSBIG areaDetector driver.
+ *
+ * The flat field file is a simple binary file in the byte order of
+ * the host. It starts with the ADSBIG_FLAT_MAGIC string and a version
+ * number, followed by the readout mode and subframe of the master flat,
+ * its pedestal, the number of pixels and the pixel data. The gain map
+ * is recomputed when the file is loaded.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ADSBIGFlat.h"
+
+#define ADSBIG_FLAT_MAGIC "ADSBIGFF"
+#define ADSBIG_FLAT_MAGIC_SIZE 8
+#define ADSBIG_FLAT_VERSION 1
+#define ADSBIG_FLAT_HEADER_FIELDS 6
+
+ADSBIGFlatField::ADSBIGFlatField()
+{
+  clear();
+}
+
+/**
+ * Set the master flat and compute the gain map.
+ * @param readoutMode The camera readout mode the flat was taken in
+ * @param minX, minY, sizeX, sizeY The subframe, in binned pixels
+ * @param pedestal The pedestal in the master flat pixels (the zero signal level)
+ * @param master The master flat (sizeX*sizeY pixels)
+ */
+void ADSBIGFlatField::set(int readoutMode, int minX, int minY, int sizeX, int sizeY,
+                          epicsUInt16 pedestal, const std::vector<epicsUInt16> &master)
+{
+  m_readoutMode = readoutMode;
+  m_minX = minX;
+  m_minY = minY;
+  m_sizeX = sizeX;
+  m_sizeY = sizeY;
+  m_pedestal = pedestal;
+  m_master = master;
+  computeGain();
+}
+
+void ADSBIGFlatField::clear(void)
+{
+  m_readoutMode = 0;
+  m_minX = 0;
+  m_minY = 0;
+  m_sizeX = 0;
+  m_sizeY = 0;
+  m_pedestal = 0;
+  m_mean = 0.0;
+  m_master.clear();
+  m_gain.clear();
+}
+
+bool ADSBIGFlatField::valid(void) const
+{
+  return !m_gain.empty();
+}
+
+/**
+ * Check if the master flat was taken with the passed readout mode and subframe.
+ */
+bool ADSBIGFlatField::matches(int readoutMode, int minX, int minY, int sizeX, int sizeY) const
+{
+  return (valid() && (readoutMode == m_readoutMode) &&
+          (minX == m_minX) && (minY == m_minY) &&
+          (sizeX == m_sizeX) && (sizeY == m_sizeY));
+}
+
+/**
+ * The gain map (sizeX*sizeY values), or NULL if there is no master flat.
+ * The pointer is valid until the master flat is next changed.
+ */
+const epicsFloat32 *ADSBIGFlatField::gain(void) const
+{
+  if (m_gain.empty()) {
+    return NULL;
+  }
+  return &m_gain[0];
+}
+
+/**
+ * The mean signal (above the pedestal) of the master flat.
+ */
+double ADSBIGFlatField::mean(void) const
+{
+  return m_mean;
+}
+
+/**
+ * Compute the normalised reciprocal gain of each pixel. Pixels with
+ * no signal in the flat (dead pixels) are left uncorrected.
+ */
+void ADSBIGFlatField::computeGain(void)
+{
+  size_t nPixels = m_master.size();
+  size_t nLive = 0;
+  double sum = 0.0;
+
+  m_gain.clear();
+  m_mean = 0.0;
+  if (nPixels == 0) {
+    return;
+  }
+
+  for (size_t i=0; i<nPixels; ++i) {
+    if (m_master[i] > m_pedestal) {
+      sum += m_master[i] - m_pedestal;
+      nLive++;
+    }
+  }
+  //The dead pixels are left out of the mean, so they do not scale down the gain
+  if (nLive > 0) {
+    m_mean = sum / nLive;
+  }
+
+  m_gain.resize(nPixels);
+  for (size_t i=0; i<nPixels; ++i) {
+    if (m_master[i] > m_pedestal) {
+      m_gain[i] = static_cast<epicsFloat32>(m_mean / (m_master[i] - m_pedestal));
+    } else {
+      m_gain[i] = 1.0f;
+    }
+  }
+}
+
+/**
+ * Flat field pixels in place, clamping the result to 0..65535.
+ * The pedestal is removed before applying the gain and added back after.
+ * The clamps are written as selects rather than if statements, so the loop has no branches.
+ * @param pData The pixels to correct
+ * @param pGain The gain map for the same pixels
+ * @param nPixels The number of pixels
+ * @param pedestal The pedestal in the pixels
+ */
+void ADSBIGFlatField::applyUInt16(epicsUInt16 *pData, const epicsFloat32 *pGain,
+                                  size_t nPixels, epicsUInt16 pedestal)
+{
+  const epicsFloat32 ped = pedestal;
+  epicsFloat32 value = 0.0f;
+
+  for (size_t i=0; i<nPixels; ++i) {
+    value = (static_cast<epicsFloat32>(pData[i]) - ped) * pGain[i] + ped + 0.5f;
+    value = (value < 0.0f) ? 0.0f : value;
+    value = (value > 65535.0f) ? 65535.0f : value;
+    pData[i] = static_cast<epicsUInt16>(static_cast<epicsInt32>(value));
+  }
+}
+
+/**
+ * Flat field pixels into a Float32 output, with the pedestal removed
+ * (so the output is the corrected signal and can be negative).
+ * @param pIn The pixels to correct
+ * @param pGain The gain map for the same pixels
+ * @param pOut The output
+ * @param nPixels The number of pixels
+ * @param pedestal The pedestal in the input pixels
+ * @param scale Multiplies each corrected pixel (the electronic gain, or 1)
+ */
+void ADSBIGFlatField::applyFloat32(const epicsUInt16 *pIn, const epicsFloat32 *pGain,
+                                   epicsFloat32 *pOut, size_t nPixels, epicsUInt16 pedestal,
+                                   epicsFloat32 scale)
+{
+  const epicsFloat32 ped = pedestal;
+
+  for (size_t i=0; i<nPixels; ++i) {
+    pOut[i] = (static_cast<epicsFloat32>(pIn[i]) - ped) * pGain[i] * scale;
+  }
+}
+
+/**
+ * Flat field pixels and add them to a Float32 output, for co-adding
+ * exposures. The pedestal is removed as in applyFloat32.
+ * @param pIn The pixels to correct
+ * @param pGain The gain map for the same pixels
+ * @param pOut The output to add to
+ * @param nPixels The number of pixels
+ * @param pedestal The pedestal in the input pixels
+ * @param scale Multiplies each corrected pixel (the electronic gain, or 1)
+ */
+void ADSBIGFlatField::accumulateFloat32(const epicsUInt16 *pIn, const epicsFloat32 *pGain,
+                                        epicsFloat32 *pOut, size_t nPixels, epicsUInt16 pedestal,
+                                        epicsFloat32 scale)
+{
+  const epicsFloat32 ped = pedestal;
+
+  for (size_t i=0; i<nPixels; ++i) {
+    pOut[i] += (static_cast<epicsFloat32>(pIn[i]) - ped) * pGain[i] * scale;
+  }
+}
+
+/**
+ * Write the master flat to a file.
+ * @param fileName The file to write (it is overwritten)
+ * @param errorMessage Set to a description of the error on failure
+ * @return true on success
+ */
+bool ADSBIGFlatField::save(const std::string &fileName, std::string &errorMessage) const
+{
+  FILE *fp = NULL;
+  bool ok = true;
+  epicsUInt32 version = ADSBIG_FLAT_VERSION;
+  epicsInt32 fields[ADSBIG_FLAT_HEADER_FIELDS];
+  epicsUInt32 nPixels = static_cast<epicsUInt32>(m_master.size());
+
+  if (!valid()) {
+    errorMessage = "No master flat to save";
+    return false;
+  }
+
+  if ((fp = fopen(fileName.c_str(), "wb")) == NULL) {
+    errorMessage = "Failed to open " + fileName + " for writing";
+    return false;
+  }
+
+  fields[0] = m_readoutMode;
+  fields[1] = m_minX;
+  fields[2] = m_minY;
+  fields[3] = m_sizeX;
+  fields[4] = m_sizeY;
+  fields[5] = m_pedestal;
+
+  ok = (fwrite(ADSBIG_FLAT_MAGIC, 1, ADSBIG_FLAT_MAGIC_SIZE, fp) == ADSBIG_FLAT_MAGIC_SIZE) && ok;
+  ok = (fwrite(&version, sizeof(version), 1, fp) == 1) && ok;
+  ok = (fwrite(fields, sizeof(fields), 1, fp) == 1) && ok;
+  ok = (fwrite(&nPixels, sizeof(nPixels), 1, fp) == 1) && ok;
+  ok = (fwrite(&m_master[0], sizeof(epicsUInt16), nPixels, fp) == nPixels) && ok;
+
+  if (fclose(fp) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    errorMessage = "Failed to write " + fileName;
+  }
+  return ok;
+}
+
+/**
+ * Replace the master flat with the one in a file. The master
+ * flat is not changed if the file can't be read.
+ * @param fileName The file to read
+ * @param errorMessage Set to a description of the error on failure
+ * @return true on success
+ */
+bool ADSBIGFlatField::load(const std::string &fileName, std::string &errorMessage)
+{
+  FILE *fp = NULL;
+  bool ok = true;
+  char magic[ADSBIG_FLAT_MAGIC_SIZE];
+  epicsUInt32 version = 0;
+  epicsInt32 fields[ADSBIG_FLAT_HEADER_FIELDS];
+  epicsUInt32 nPixels = 0;
+  std::vector<epicsUInt16> master;
+
+  if ((fp = fopen(fileName.c_str(), "rb")) == NULL) {
+    errorMessage = "Failed to open " + fileName;
+    return false;
+  }
+
+  ok = (fread(magic, 1, ADSBIG_FLAT_MAGIC_SIZE, fp) == ADSBIG_FLAT_MAGIC_SIZE);
+  ok = ok && (memcmp(magic, ADSBIG_FLAT_MAGIC, ADSBIG_FLAT_MAGIC_SIZE) == 0);
+  ok = ok && (fread(&version, sizeof(version), 1, fp) == 1) && (version == ADSBIG_FLAT_VERSION);
+  ok = ok && (fread(fields, sizeof(fields), 1, fp) == 1);
+  ok = ok && (fread(&nPixels, sizeof(nPixels), 1, fp) == 1);
+  //Guard against a corrupt file asking for a huge allocation
+  ok = ok && (fields[3] > 0) && (fields[4] > 0) && (fields[5] >= 0) && (fields[5] <= 65535) &&
+    (nPixels == static_cast<epicsUInt32>(fields[3]) * static_cast<epicsUInt32>(fields[4]));
+  if (!ok) {
+    fclose(fp);
+    errorMessage = fileName + " is not a flat field file";
+    return false;
+  }
+
+  master.resize(nPixels);
+  ok = (fread(&master[0], sizeof(epicsUInt16), nPixels, fp) == nPixels);
+  fclose(fp);
+  if (!ok) {
+    errorMessage = "Failed to read " + fileName;
+    return false;
+  }
+
+  set(fields[0], fields[1], fields[2], fields[3], fields[4],
+      static_cast<epicsUInt16>(fields[5]), master);
+  return true;
+}
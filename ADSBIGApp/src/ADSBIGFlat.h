@@ -0,0 +1,61 @@
+/**
+ * Flat field correction for the ADSBIG areaDetector driver.
+ *
+ * A master flat is the average of several exposures of an evenly
+ * illuminated target. When the master flat is set, the normalised
+ * reciprocal gain of each pixel (the mean of the flat divided by the
+ * pixel value) is computed once, so that correcting a frame is a
+ * single multiply per pixel. The master flat can be saved to and
+ * loaded from a file.
+ *
+ */
+
+#ifndef ADSBIG_FLAT_H
+#define ADSBIG_FLAT_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+
+class ADSBIGFlatField {
+
+ public:
+  ADSBIGFlatField();
+
+  void set(int readoutMode, int minX, int minY, int sizeX, int sizeY,
+           epicsUInt16 pedestal, const std::vector<epicsUInt16> &master);
+  void clear(void);
+  bool valid(void) const;
+  bool matches(int readoutMode, int minX, int minY, int sizeX, int sizeY) const;
+  const epicsFloat32 *gain(void) const;
+  double mean(void) const;
+
+  bool save(const std::string &fileName, std::string &errorMessage) const;
+  bool load(const std::string &fileName, std::string &errorMessage);
+
+  static void applyUInt16(epicsUInt16 *pData, const epicsFloat32 *pGain,
+                          size_t nPixels, epicsUInt16 pedestal);
+  static void applyFloat32(const epicsUInt16 *pIn, const epicsFloat32 *pGain,
+                           epicsFloat32 *pOut, size_t nPixels, epicsUInt16 pedestal,
+                           epicsFloat32 scale);
+  static void accumulateFloat32(const epicsUInt16 *pIn, const epicsFloat32 *pGain,
+                                epicsFloat32 *pOut, size_t nPixels, epicsUInt16 pedestal,
+                                epicsFloat32 scale);
+
+ private:
+  void computeGain(void);
+
+  epicsInt32 m_readoutMode;
+  epicsInt32 m_minX;
+  epicsInt32 m_minY;
+  epicsInt32 m_sizeX;
+  epicsInt32 m_sizeY;
+  epicsUInt16 m_pedestal;
+  double m_mean;
+  std::vector<epicsUInt16> m_master;
+  std::vector<epicsFloat32> m_gain;
+
+};
+
+#endif //ADSBIG_FLAT_H
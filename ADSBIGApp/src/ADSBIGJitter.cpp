@@ -0,0 +1,89 @@
+/**
+ * Timing jitter statistics for the ADSBIG areaDetector driver.
+ *
+ * The window is small (one value per frame), so the statistics are
+ * recomputed from it each time they are asked for.
+ *
+ */
+
+#include <math.h>
+
+#include "ADSBIGJitter.h"
+
+ADSBIGJitter::ADSBIGJitter(size_t windowSize)
+  : m_windowSize((windowSize > 0) ? windowSize : 1), m_next(0), m_last(0.0)
+{
+  m_window.reserve(m_windowSize);
+}
+
+void ADSBIGJitter::add(double value)
+{
+  if (m_window.size() < m_windowSize) {
+    m_window.push_back(value);
+  } else {
+    m_window[m_next] = value;
+  }
+  m_next = (m_next + 1) % m_windowSize;
+  m_last = value;
+}
+
+void ADSBIGJitter::reset(void)
+{
+  m_window.clear();
+  m_next = 0;
+  m_last = 0.0;
+}
+
+size_t ADSBIGJitter::count(void) const
+{
+  return m_window.size();
+}
+
+double ADSBIGJitter::last(void) const
+{
+  return m_last;
+}
+
+double ADSBIGJitter::mean(void) const
+{
+  double sum = 0.0;
+
+  if (m_window.empty()) {
+    return 0.0;
+  }
+  for (size_t i=0; i<m_window.size(); ++i) {
+    sum += m_window[i];
+  }
+  return sum / m_window.size();
+}
+
+/**
+ * The standard deviation of the values in the window (0 for less than two values).
+ */
+double ADSBIGJitter::sigma(void) const
+{
+  double m = mean();
+  double sum = 0.0;
+
+  if (m_window.size() < 2) {
+    return 0.0;
+  }
+  for (size_t i=0; i<m_window.size(); ++i) {
+    sum += (m_window[i] - m) * (m_window[i] - m);
+  }
+  return sqrt(sum / (m_window.size() - 1));
+}
+
+/**
+ * The largest magnitude of the values in the window.
+ */
+double ADSBIGJitter::maxAbs(void) const
+{
+  double largest = 0.0;
+
+  for (size_t i=0; i<m_window.size(); ++i) {
+    double value = fabs(m_window[i]);
+    largest = (value > largest) ? value : largest;
+  }
+  return largest;
+}
@@ -0,0 +1,38 @@
+/**
+ * Timing jitter statistics for the ADSBIG areaDetector driver.
+ *
+ * Keeps the last values of a signed timing error (for example the
+ * actual minus the requested exposure time) over a window of frames,
+ * and gives their mean, standard deviation and largest magnitude, so
+ * that time critical sequences can be checked.
+ *
+ */
+
+#ifndef ADSBIG_JITTER_H
+#define ADSBIG_JITTER_H
+
+#include <stddef.h>
+#include <vector>
+
+class ADSBIGJitter {
+
+ public:
+  explicit ADSBIGJitter(size_t windowSize);
+
+  void add(double value);
+  void reset(void);
+  size_t count(void) const;
+  double last(void) const;
+  double mean(void) const;
+  double sigma(void) const;
+  double maxAbs(void) const;
+
+ private:
+  size_t m_windowSize;
+  size_t m_next;
+  double m_last;
+  std::vector<double> m_window;
+
+};
+
+#endif //ADSBIG_JITTER_H
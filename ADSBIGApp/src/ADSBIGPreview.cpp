@@ -0,0 +1,168 @@
+/**
+ * Preview frames for the ADSBIG areaDetector driver.
+ *
+ * The pixels in the partial blocks at the right and bottom edges of the
+ * frame (if the frame size is not a multiple of the factor) are left out.
+ *
+ */
+
+#include <algorithm>
+
+#include "ADSBIGPreview.h"
+
+ADSBIGPreview::ADSBIGPreview()
+  : m_frameWidth(0), m_factor(1), m_mode(ADSBIG_PREVIEW_BIN),
+    m_width(0), m_height(0), m_exposures(0)
+{
+}
+
+/**
+ * Start the preview of a frame.
+ * @param width, height The size of the frame
+ * @param factor The preview is this many times smaller in each direction
+ * @param mode ADSBIG_PREVIEW_BIN or ADSBIG_PREVIEW_STRIDE
+ * @return false if the frame is smaller than the factor
+ */
+bool ADSBIGPreview::start(int width, int height, int factor, int mode)
+{
+  m_factor = std::max(1, std::min(factor, ADSBIG_PREVIEW_MAX_FACTOR));
+  m_mode = mode;
+  m_frameWidth = width;
+  m_width = width / m_factor;
+  m_height = height / m_factor;
+  m_exposures = 0;
+  m_sums.assign(static_cast<size_t>(m_width) * m_height, 0);
+  m_rowSums.assign(static_cast<size_t>(m_width) * m_factor, 0);
+  return ((m_width > 0) && (m_height > 0));
+}
+
+int ADSBIGPreview::width(void) const
+{
+  return m_width;
+}
+
+int ADSBIGPreview::height(void) const
+{
+  return m_height;
+}
+
+int ADSBIGPreview::factor(void) const
+{
+  return m_factor;
+}
+
+/**
+ * Add a band of rows of the frame. The bands of each exposure must be
+ * added in order. An exposure starts again at row 0.
+ * @param pFrame The frame
+ * @param firstRow The first row in the band
+ * @param numRows The number of rows in the band
+ */
+void ADSBIGPreview::addRows(const epicsUInt16 *pFrame, int firstRow, int numRows)
+{
+  if (firstRow == 0) {
+    m_exposures++;
+    std::fill(m_rowSums.begin(), m_rowSums.end(), 0);
+  }
+  int lastRow = std::min(firstRow + numRows, m_height * m_factor);
+  for (int row=firstRow; row<lastRow; ++row) {
+    const epicsUInt16 *pRow = pFrame + static_cast<size_t>(row) * m_frameWidth;
+    if (m_mode == ADSBIG_PREVIEW_STRIDE) {
+      addStrideRow(pRow, row);
+    } else {
+      addBinnedRow(pRow, row);
+    }
+  }
+}
+
+/**
+ * Add a row to the row sums. Once the last row of a block row has been
+ * added, each block of the row sums is added to its preview pixel.
+ */
+void ADSBIGPreview::addBinnedRow(const epicsUInt16 *pRow, int row)
+{
+  const int factor = m_factor;
+  const int n = m_width * factor;
+  epicsUInt32 *pRowSums = &m_rowSums[0];
+
+  //The widening add that does most of the work
+  for (int x=0; x<n; ++x) {
+    pRowSums[x] += pRow[x];
+  }
+
+  if ((row % factor) == (factor - 1)) {
+    epicsUInt64 *pSums = &m_sums[static_cast<size_t>(row / factor) * m_width];
+    for (int px=0; px<m_width; ++px) {
+      epicsUInt32 sum = 0;
+      for (int k=0; k<factor; ++k) {
+        sum += pRowSums[px*factor + k];
+      }
+      pSums[px] += sum;
+    }
+    std::fill(m_rowSums.begin(), m_rowSums.end(), 0);
+  }
+}
+
+/**
+ * Add the first pixel of each block, from the first row of each block row.
+ */
+void ADSBIGPreview::addStrideRow(const epicsUInt16 *pRow, int row)
+{
+  const int factor = m_factor;
+
+  if ((row % factor) == 0) {
+    epicsUInt64 *pSums = &m_sums[static_cast<size_t>(row / factor) * m_width];
+    for (int px=0; px<m_width; ++px) {
+      pSums[px] += pRow[px*factor];
+    }
+  }
+}
+
+/**
+ * Write the preview.
+ * @param pOut The preview (width()*height() pixels of dataType)
+ * @param dataType NDUInt16 for the mean pixel values, or NDUInt8 to scale
+ * them from the lowest (0) to the highest (255)
+ * @param low, high Set to the lowest and highest mean pixel values
+ * @return false if no rows have been added or the data type is not supported
+ */
+bool ADSBIGPreview::finish(void *pOut, NDDataType_t dataType, double &low, double &high) const
+{
+  const size_t nPixels = m_sums.size();
+  const epicsUInt64 *pSums = m_sums.empty() ? NULL : &m_sums[0];
+
+  if ((m_exposures == 0) || (nPixels == 0)) {
+    return false;
+  }
+  double samples = static_cast<double>(m_exposures);
+  if (m_mode != ADSBIG_PREVIEW_STRIDE) {
+    samples *= static_cast<double>(m_factor) * m_factor;
+  }
+  const double scale = 1.0 / samples;
+
+  epicsUInt64 minSum = pSums[0];
+  epicsUInt64 maxSum = pSums[0];
+  for (size_t i=1; i<nPixels; ++i) {
+    minSum = (pSums[i] < minSum) ? pSums[i] : minSum;
+    maxSum = (pSums[i] > maxSum) ? pSums[i] : maxSum;
+  }
+  low = minSum * scale;
+  high = maxSum * scale;
+
+  if (dataType == NDUInt16) {
+    epicsUInt16 *pPixels = static_cast<epicsUInt16 *>(pOut);
+    for (size_t i=0; i<nPixels; ++i) {
+      pPixels[i] = static_cast<epicsUInt16>(pSums[i] * scale + 0.5);
+    }
+  } else if (dataType == NDUInt8) {
+    //Scale the sums straight to 0-255
+    const double gain = (maxSum > minSum) ? 255.0 / static_cast<double>(maxSum - minSum) : 0.0;
+    epicsUInt8 *pPixels = static_cast<epicsUInt8 *>(pOut);
+    for (size_t i=0; i<nPixels; ++i) {
+      pPixels[i] = static_cast<epicsUInt8>((pSums[i] - minSum) * gain + 0.5);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,61 @@
+/**
+ * Preview frames for the ADSBIG areaDetector driver.
+ *
+ * A preview is a decimated copy of a frame for displays. It is built
+ * from each band of lines while the band is still in the cache, either
+ * by averaging each NxN block of pixels or by taking the first pixel of
+ * each block. The rows of a block are summed into a row accumulator, and
+ * each block row is only summed horizontally once all its rows have been
+ * added. Co-added exposures are averaged. The preview is either the mean
+ * pixel values (UInt16) or scaled from the lowest to the highest pixel to
+ * 8 bits.
+ *
+ */
+
+#ifndef ADSBIG_PREVIEW_H
+#define ADSBIG_PREVIEW_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include "NDArray.h"
+
+//Preview modes (ADSBIGPreviewModeParam)
+#define ADSBIG_PREVIEW_BIN 0
+#define ADSBIG_PREVIEW_STRIDE 1
+
+//Largest preview factor. This keeps the sums of a co-added frame well inside 32 bits per exposure.
+#define ADSBIG_PREVIEW_MAX_FACTOR 16
+
+class ADSBIGPreview {
+
+ public:
+  ADSBIGPreview();
+
+  bool start(int width, int height, int factor, int mode);
+  void addRows(const epicsUInt16 *pFrame, int firstRow, int numRows);
+  bool finish(void *pOut, NDDataType_t dataType, double &low, double &high) const;
+  int width(void) const;
+  int height(void) const;
+  int factor(void) const;
+
+ private:
+  void addBinnedRow(const epicsUInt16 *pRow, int row);
+  void addStrideRow(const epicsUInt16 *pRow, int row);
+
+  int m_frameWidth;
+  int m_factor;
+  int m_mode;
+  int m_width;
+  int m_height;
+  int m_exposures;
+  //Sum of the rows of the current block row (m_width*m_factor pixels)
+  std::vector<epicsUInt32> m_rowSums;
+  //Sum of each block, over all the exposures
+  std::vector<epicsUInt64> m_sums;
+
+};
+
+#endif //ADSBIG_PREVIEW_H
@@ -0,0 +1,258 @@
+/**
+ * Readout modes for the ADSBIG areaDetector driver.
+ *
+ * The readout modes are numbered as in CSBIGCam::GrabSetup. The ST-i
+ * has no 3x3 mode, so its 1xN and 2xN modes come straight after 2x2.
+ *
+ */
+
+#include <stdio.h>
+
+#include <epicsStdio.h>
+
+#include "ADSBIGReadout.h"
+
+//Number of frames the readout time is averaged over
+#define ADSBIG_READOUT_AVERAGE 16
+
+ADSBIGReadoutModes::ADSBIGReadoutModes()
+{
+  clear();
+}
+
+/**
+ * Set the readout modes of the CCD.
+ * @param numModes The number of readout modes (GetCCDInfoResults0::readoutModes)
+ * @param sti True for an ST-i camera
+ */
+void ADSBIGReadoutModes::set(int numModes, bool sti)
+{
+  clear();
+  for (int rm = 0; rm < numModes; ++rm) {
+    Mode mode = {1, 1, false};
+    if (sti) {
+      if (rm < 2) {
+        mode.binX = mode.binY = rm + 1;
+      } else if (rm < 4) {
+        mode.binX = rm - 1;
+        mode.binY = 0;
+      } else {
+        break;
+      }
+    } else if (rm < 3) {
+      mode.binX = mode.binY = rm + 1;
+    } else if (rm < 6) {
+      mode.binX = rm - 2;
+      mode.binY = 0;
+    } else if (rm < 9) {
+      mode.binX = mode.binY = rm - 5;
+      mode.offChip = true;
+    } else if (rm == 9) {
+      mode.binX = mode.binY = 9;
+    } else if (rm == 10) {
+      mode.binX = mode.binY = 0;
+    } else {
+      //Modes we do not know the binning of are not used
+      break;
+    }
+    m_modes.push_back(mode);
+  }
+}
+
+void ADSBIGReadoutModes::clear(void)
+{
+  m_modes.clear();
+  m_timing.clear();
+}
+
+int ADSBIGReadoutModes::numModes(void) const
+{
+  return static_cast<int>(m_modes.size());
+}
+
+/**
+ * The binning of a readout mode.
+ * @param mode The readout mode (without the vertical binning)
+ * @param binX, binY The binning. They are only changed for the axes the mode fixes
+ * (for NxN binY is set to binX), and are limited to ADSBIG_MAX_VERT_BINNING otherwise.
+ * @return false if the CCD does not have the mode
+ */
+bool ADSBIGReadoutModes::binning(int mode, int &binX, int &binY) const
+{
+  if ((mode < 0) || (mode >= numModes())) {
+    return false;
+  }
+  const Mode &m = m_modes[mode];
+  if (binX < 1) {
+    binX = 1;
+  } else if (binX > ADSBIG_MAX_VERT_BINNING) {
+    binX = ADSBIG_MAX_VERT_BINNING;
+  }
+  if (binY < 1) {
+    binY = 1;
+  } else if (binY > ADSBIG_MAX_VERT_BINNING) {
+    binY = ADSBIG_MAX_VERT_BINNING;
+  }
+  if (m.binX != 0) {
+    binX = m.binX;
+  }
+  if (m.binY != 0) {
+    binY = m.binY;
+  } else if (m.binX == 0) {
+    binY = binX;
+  }
+  return true;
+}
+
+/**
+ * Find the readout mode for a binning. The current mode is kept if it fixes
+ * the same binning (so an off-chip mode is only left if it has to be).
+ * Otherwise a square mode is preferred to NxN, and NxN to 1xN, 2xN or 3xN.
+ * @return The readout mode, or -1 if the CCD cannot do the binning
+ */
+int ADSBIGReadoutModes::find(int binX, int binY, int currentMode) const
+{
+  int found = -1;
+  int foundRank = 0;
+
+  if ((binX < 1) || (binY < 1) || (binX > ADSBIG_MAX_VERT_BINNING) || (binY > ADSBIG_MAX_VERT_BINNING)) {
+    return -1;
+  }
+  for (int rm = 0; rm < numModes(); ++rm) {
+    const Mode &m = m_modes[rm];
+    int rank = 0;
+    if ((m.binX == binX) && (m.binY == binY)) {
+      rank = m.offChip ? 1 : 4;
+    } else if ((m.binX == 0) && (binX == binY)) {
+      rank = 3;
+    } else if ((m.binX == binX) && (m.binY == 0)) {
+      rank = 2;
+    }
+    if (rank == 0) {
+      continue;
+    }
+    if ((rm == currentMode) && (m.binX == binX) && (m.binY == binY)) {
+      return rm;
+    }
+    if (rank > foundRank) {
+      found = rm;
+      foundRank = rank;
+    }
+  }
+  return found;
+}
+
+/**
+ * The SBIG readout mode (as given to CSBIGCam::SetReadoutMode) for a readout mode and binning.
+ */
+int ADSBIGReadoutModes::sbigMode(int mode, int binX, int binY) const
+{
+  if ((mode < 0) || (mode >= numModes())) {
+    return mode;
+  }
+  if (m_modes[mode].binX == 0) {
+    return mode | (binX << 8);
+  } else if (m_modes[mode].binY == 0) {
+    return mode | (binY << 8);
+  }
+  return mode;
+}
+
+std::string ADSBIGReadoutModes::name(int mode) const
+{
+  char text[32] = {0};
+  const Mode &m = m_modes[mode];
+
+  if (m.binX == 0) {
+    epicsSnprintf(text, sizeof(text), "NxN");
+  } else if (m.binY == 0) {
+    epicsSnprintf(text, sizeof(text), "%dxN", m.binX);
+  } else {
+    epicsSnprintf(text, sizeof(text), "%dx%d%s", m.binX, m.binY, m.offChip ? " off-chip" : "");
+  }
+  return text;
+}
+
+/**
+ * The readout modes of the CCD, for ADSBIGReadoutModesParam.
+ */
+std::string ADSBIGReadoutModes::names(void) const
+{
+  std::string text;
+
+  for (int rm = 0; rm < numModes(); ++rm) {
+    if (rm > 0) {
+      text += ", ";
+    }
+    text += name(rm);
+  }
+  return text;
+}
+
+/**
+ * Add the readout time of a frame to the mean for its SBIG readout mode.
+ * @param seconds The time taken to read out the frame
+ * @param pixels The number of pixels read out
+ * @param fullPixels The number of pixels in a full frame in this mode
+ */
+void ADSBIGReadoutModes::addReadout(int sbigMode, double seconds, double pixels, double fullPixels)
+{
+  if ((seconds <= 0.0) || (pixels <= 0.0)) {
+    return;
+  }
+  double full = seconds * fullPixels / pixels;
+  Timing &timing = m_timing[sbigMode];
+  if (timing.frames < ADSBIG_READOUT_AVERAGE) {
+    timing.frames++;
+  }
+  if (timing.frames == 1) {
+    timing.seconds = full;
+  } else {
+    timing.seconds += (full - timing.seconds) / timing.frames;
+  }
+}
+
+/**
+ * The mean readout time of a full frame in an SBIG readout mode, or 0 if no frames have been read out in it.
+ */
+double ADSBIGReadoutModes::fullFrameTime(int sbigMode) const
+{
+  std::map<int, Timing>::const_iterator it = m_timing.find(sbigMode);
+  return (it != m_timing.end()) ? it->second.seconds : 0.0;
+}
+
+/**
+ * How many times faster a full frame is read out in a readout mode than in 1x1.
+ * This is measured once frames have been read out in both modes. Until then
+ * it is estimated from the number of pixels that are digitised.
+ */
+double ADSBIGReadoutModes::reduction(int mode, int binX, int binY) const
+{
+  if (!binning(mode, binX, binY)) {
+    return 0.0;
+  }
+  double fullTime = fullFrameTime(0);
+  double modeTime = fullFrameTime(sbigMode(mode, binX, binY));
+  if ((fullTime > 0.0) && (modeTime > 0.0)) {
+    return fullTime / modeTime;
+  }
+  return m_modes[mode].offChip ? 1.0 : static_cast<double>(binX * binY);
+}
+
+void ADSBIGReadoutModes::report(FILE *fp) const
+{
+  double fullTime = fullFrameTime(0);
+
+  fprintf(fp, "    Readout modes: %s\n", names().c_str());
+  for (std::map<int, Timing>::const_iterator it = m_timing.begin(); it != m_timing.end(); ++it) {
+    int mode = it->first & 0xFF;
+    int binX = it->first >> 8;
+    int binY = binX;
+    if (!binning(mode, binX, binY)) {
+      continue;
+    }
+    fprintf(fp, "    %-12s %3dx%-3d full frame readout %10.3f ms, %5.2f times faster than 1x1%s\n",
+            name(mode).c_str(), binX, binY, it->second.seconds * 1000.0,
+            reduction(mode, binX, binY), (fullTime > 0.0) ? "" : " (estimated)");
+  }
+}
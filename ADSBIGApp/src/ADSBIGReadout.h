@@ -0,0 +1,67 @@
+/**
+ * Readout modes for the ADSBIG areaDetector driver.
+ *
+ * Each CCD reports the readout modes it supports in GetCCDInfoResults0.
+ * The square modes (1x1, 2x2, 3x3, 9x9, and the off-chip modes) have a
+ * fixed binning. The 1xN, 2xN and 3xN modes have a fixed horizontal
+ * binning and take the vertical binning from the high byte of the SBIG
+ * readout mode, and the NxN mode takes both from the high byte. This
+ * maps the driver's binning (ADBinX and ADBinY) to the readout mode
+ * that does it on the chip, and back.
+ *
+ * The readout time of each mode is also kept, scaled to a full frame,
+ * so that the reduction in readout time from binning can be reported.
+ *
+ */
+
+#ifndef ADSBIG_READOUT_H
+#define ADSBIG_READOUT_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+//Largest binning in the high byte of the SBIG readout mode
+#define ADSBIG_MAX_VERT_BINNING 255
+
+class ADSBIGReadoutModes {
+
+ public:
+  ADSBIGReadoutModes();
+
+  void set(int numModes, bool sti);
+  void clear(void);
+  int numModes(void) const;
+  bool binning(int mode, int &binX, int &binY) const;
+  int find(int binX, int binY, int currentMode) const;
+  int sbigMode(int mode, int binX, int binY) const;
+  std::string names(void) const;
+
+  void addReadout(int sbigMode, double seconds, double pixels, double fullPixels);
+  double fullFrameTime(int sbigMode) const;
+  double reduction(int mode, int binX, int binY) const;
+  void report(FILE *fp) const;
+
+ private:
+  //binX or binY is 0 if it is taken from the high byte of the SBIG readout mode
+  struct Mode {
+    int binX;
+    int binY;
+    bool offChip;
+  };
+
+  //Mean readout time of a full frame in an SBIG readout mode
+  struct Timing {
+    double seconds;
+    int frames;
+  };
+
+  std::string name(int mode) const;
+
+  std::vector<Mode> m_modes;
+  std::map<int, Timing> m_timing;
+
+};
+
+#endif //ADSBIG_READOUT_H
@@ -0,0 +1,161 @@
+/**
+ * Row parallel worker threads for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <stdio.h>
+
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsStdio.h>
+
+#include "ADSBIGRowPool.h"
+
+static void ADSBIGRowPoolWorkerC(void *drvPvt)
+{
+  ADSBIGRowPool *pPvt = (ADSBIGRowPool *)drvPvt;
+
+  pPvt->workerTask();
+}
+
+/**
+ * Constructor. This starts the worker threads.
+ * @param name The start of the thread names
+ * @param numThreads The number of threads that process rows, including
+ * the calling thread (so 1 does everything in the caller)
+ */
+ADSBIGRowPool::ADSBIGRowPool(const char *name, int numThreads) :
+  m_numWorkers(0), m_pTask(NULL), m_height(0), m_numChunks(0), m_chunkRows(0),
+  m_nextChunk(0), m_running(0), m_numStarted(0), m_exiting(false)
+{
+  char threadName[32];
+
+  m_doneEvent = epicsEventMustCreate(epicsEventEmpty);
+  m_runMutex = epicsMutexMustCreate();
+
+  //The events are all made first, since each worker takes the next one when it starts
+  for (int thread=1; thread<numThreads; ++thread) {
+    m_workerEvents.push_back(epicsEventMustCreate(epicsEventEmpty));
+  }
+  for (int thread=1; thread<numThreads; ++thread) {
+    epicsSnprintf(threadName, sizeof(threadName), "%s%d", name, thread);
+    if (epicsThreadCreate(threadName, epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)ADSBIGRowPoolWorkerC, this) == NULL) {
+      printf("ADSBIGRowPool::ADSBIGRowPool epicsThreadCreate failure for %s.\n", threadName);
+      break;
+    }
+    m_numWorkers++;
+  }
+}
+
+/**
+ * Destructor. This stops the worker threads and waits for them to exit.
+ * There must not be a pass running.
+ */
+ADSBIGRowPool::~ADSBIGRowPool()
+{
+  if (m_numWorkers > 0) {
+    m_exiting = true;
+    epicsAtomicSetIntT(&m_running, m_numWorkers);
+    for (int worker=0; worker<m_numWorkers; ++worker) {
+      epicsEventSignal(m_workerEvents[worker]);
+    }
+    epicsEventWait(m_doneEvent);
+  }
+
+  for (size_t worker=0; worker<m_workerEvents.size(); ++worker) {
+    epicsEventDestroy(m_workerEvents[worker]);
+  }
+  epicsEventDestroy(m_doneEvent);
+  epicsMutexDestroy(m_runMutex);
+}
+
+/**
+ * @return The number of threads used, including the calling thread
+ */
+int ADSBIGRowPool::numThreads(void) const
+{
+  return m_numWorkers + 1;
+}
+
+/**
+ * Run a pass over all the rows, on the worker threads and the calling
+ * thread, and wait for it to finish. A pass started by another thread
+ * is finished first.
+ * @param pTask The pass
+ * @param height The number of rows
+ * @param parallel false to do all the rows in the calling thread
+ */
+void ADSBIGRowPool::run(ADSBIGRowTask *pTask, int height, bool parallel)
+{
+  int numThreads = parallel ? (m_numWorkers + 1) : 1;
+
+  epicsMutexMustLock(m_runMutex);
+  m_pTask = pTask;
+  m_height = height;
+  m_numChunks = numThreads * ADSBIG_ROW_POOL_CHUNKS_PER_THREAD;
+  if (m_numChunks > height) {
+    m_numChunks = height;
+  }
+  m_chunkRows = (m_numChunks > 0) ? ((height + m_numChunks - 1) / m_numChunks) : 0;
+  epicsAtomicSetIntT(&m_nextChunk, 0);
+
+  if (numThreads == 1) {
+    runChunks(0);
+  } else {
+    epicsAtomicSetIntT(&m_running, m_numWorkers);
+    for (int worker=0; worker<m_numWorkers; ++worker) {
+      epicsEventSignal(m_workerEvents[worker]);
+    }
+    runChunks(0);
+    epicsEventWait(m_doneEvent);
+  }
+  epicsMutexUnlock(m_runMutex);
+}
+
+/**
+ * Process chunks of rows until there are none left.
+ * @param thread The thread (0 for the calling thread)
+ */
+void ADSBIGRowPool::runChunks(int thread)
+{
+  int chunk = 0;
+
+  while ((chunk = epicsAtomicIncrIntT(&m_nextChunk) - 1) < m_numChunks) {
+    int firstRow = chunk * m_chunkRows;
+    int numRows = m_chunkRows;
+    if ((firstRow + numRows) > m_height) {
+      numRows = m_height - firstRow;
+    }
+    if (numRows > 0) {
+      m_pTask->processRows(thread, firstRow, numRows);
+    }
+  }
+}
+
+/**
+ * Worker thread function. Each pass wakes every worker, and the last one
+ * to finish wakes the caller, so no worker is still running when run returns.
+ * The destructor wakes them the same way to make them exit.
+ */
+void ADSBIGRowPool::workerTask(void)
+{
+  const int thread = epicsAtomicIncrIntT(&m_numStarted);
+  epicsEventId event = m_workerEvents[thread - 1];
+
+  while (1) {
+    epicsEventWait(event);
+    if (m_exiting) {
+      break;
+    }
+    runChunks(thread);
+    if (epicsAtomicDecrIntT(&m_running) == 0) {
+      epicsEventSignal(m_doneEvent);
+    }
+  }
+
+  if (epicsAtomicDecrIntT(&m_running) == 0) {
+    epicsEventSignal(m_doneEvent);
+  }
+}
@@ -0,0 +1,75 @@
+/**
+ * Row parallel worker threads for the ADSBIG areaDetector driver.
+ *
+ * Runs a pass over the rows of a frame on a pool of worker threads and
+ * the calling thread. The rows are split into chunks, several per
+ * thread, which the threads take in turn so that a slow thread does not
+ * hold up the others. The pass is done by an ADSBIGRowTask, which is told
+ * which thread it is running on so that it can keep rows of its own.
+ *
+ * One pool is shared by the driver's codec and demosaic, which are used
+ * by different threads. Only one pass runs at a time, so run waits for
+ * any pass started by another thread to finish.
+ *
+ */
+
+#ifndef ADSBIG_ROW_POOL_H
+#define ADSBIG_ROW_POOL_H
+
+#include <vector>
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+//Chunks of rows per thread, so that a slow thread does not hold up the others
+#define ADSBIG_ROW_POOL_CHUNKS_PER_THREAD 4
+
+/**
+ * A pass over the rows of a frame.
+ */
+class ADSBIGRowTask {
+
+ public:
+  virtual ~ADSBIGRowTask() {}
+  /**
+   * Process some rows.
+   * @param thread The thread (0 for the calling thread)
+   * @param firstRow The first row
+   * @param numRows The number of rows
+   */
+  virtual void processRows(int thread, int firstRow, int numRows) = 0;
+
+};
+
+class ADSBIGRowPool {
+
+ public:
+  ADSBIGRowPool(const char *name, int numThreads);
+  ~ADSBIGRowPool();
+
+  void run(ADSBIGRowTask *pTask, int height, bool parallel);
+  int numThreads(void) const;
+
+  void workerTask(void);
+
+ private:
+  void runChunks(int thread);
+
+  int m_numWorkers;
+  std::vector<epicsEventId> m_workerEvents;
+  epicsEventId m_doneEvent;
+  epicsMutexId m_runMutex;
+
+  //The current pass. Only set while m_runMutex is held and the workers are idle.
+  ADSBIGRowTask *m_pTask;
+  int m_height;
+  int m_numChunks;
+  int m_chunkRows;
+  int m_nextChunk;
+  int m_running;
+  int m_numStarted;
+  bool m_exiting;
+
+};
+
+#endif //ADSBIG_ROW_POOL_H
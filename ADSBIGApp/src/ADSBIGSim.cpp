@@ -0,0 +1,922 @@
+/**
+ * Simulated SBIG camera for the ADSBIG areaDetector driver.
+ *
+ * This implements the subset of the SBIG Universal Driver protocol
+ * used by CSBIGCam, in-process and without libsbigudrv or libusb.
+ * It models exposure timing, line readout at a configurable pixel
+ * rate, the readout modes reported by CC_GET_CCD_INFO and the TE
+ * cooler, so that the throughput and latency of the whole driver
+ * can be measured on machines without a camera.
+ *
+ * The readout and cooler can be sped up with the time scale factor.
+ * Exposures always take the requested time, since CSBIGCam schedules
+ * its exposure complete queries from it.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "lpardrv.h"
+
+#include "ADSBIGSim.h"
+
+//Thermistor model from the SBIG Universal Driver documentation (as used by CSBIGCam).
+#define SIM_T0      25.0
+#define SIM_R0       3.0
+#define SIM_DT_CCD  25.0
+#define SIM_RR_CCD   2.57
+#define SIM_RB_CCD  10.0
+#define SIM_MAX_AD  4096
+
+//Sensor model. Gain is in e-/ADU, noise and signal rates in e-.
+#define SIM_TRACK_WIDTH    657
+#define SIM_TRACK_HEIGHT   495
+#define SIM_PIXEL_SIZE     5.4     //microns
+#define SIM_TRACK_PIXEL    7.4     //microns
+#define SIM_GAIN           0.37
+#define SIM_BIAS           1000.0  //ADU
+#define SIM_PEDESTAL       100.0   //ADU added to dark subtracted lines
+#define SIM_READ_NOISE     9.3
+#define SIM_SKY_RATE       5.0     //e-/s/pixel
+#define SIM_DARK_RATE      0.02    //e-/s/pixel at 0C, doubling every 6C
+#define SIM_STAR_CELL      64      //One possible star per cell of this many pixels
+#define SIM_FULL_WELL      65535.0
+#define SIM_DUMP_FACTOR    10.0    //Dumping lines is this much faster than digitizing them
+
+//Cooler model.
+#define SIM_TE_MAX_DELTA   40.0    //Max degrees below ambient at full power
+#define SIM_TE_TAU         60.0    //Thermal time constant in seconds
+#define SIM_TE_GAIN        0.2     //Proportional gain (power per degree)
+#define SIM_TE_STEP        1.0     //Integration step in seconds
+
+#define SIM_NUM_READOUT_MODES 10
+
+struct SimCCD {
+  int status;                //PAR_COMMAND_STATUS of the exposure
+  epicsTimeStamp expStart;
+  double expTime;            //Requested exposure (seconds)
+  double exposed;            //Integrated exposure of the last frame (seconds)
+  bool shutterOpen;
+  bool reading;
+  int readoutMode;
+  int top;
+  int left;
+  int height;
+  int width;
+  int line;                  //Next line of the readout region
+  epicsTimeStamp lineDue;    //When the next line is available
+};
+
+struct SimCamera {
+  bool deviceOpen;
+  int slot;                  //USB slot of the open device (0 for DEV_USB1)
+  bool linked;
+  SimCCD ccd[2];
+  bool shutterOpen;          //The CCDs share the shutter
+  bool teEnabled;
+  double teSetpoint;
+  double ccdTemp;
+  double tePower;
+  epicsTimeStamp teTime;
+  unsigned int seed;
+};
+
+struct SimConfig {
+  int width;
+  int height;
+  double pixelRate;
+  double timeScale;
+  double ambient;
+  int numCameras;            //Cameras reported by CC_QUERY_USB and CC_QUERY_USB2
+};
+
+static SimConfig simConfig = {ADSBIG_SIM_WIDTH, ADSBIG_SIM_HEIGHT,
+                              ADSBIG_SIM_PIXEL_RATE, ADSBIG_SIM_TIME_SCALE,
+                              ADSBIG_SIM_AMBIENT, ADSBIG_SIM_NUM_CAMERAS};
+
+//One camera per driver handle. simCurrent is the handle selected by CC_SET_DRIVER_HANDLE.
+static std::vector<SimCamera *> simCameras;
+static short simCurrent = -1;
+static epicsTimeStamp simStartTime;
+static epicsMutexId simMutex = NULL;
+static epicsThreadOnceId simOnce = EPICS_THREAD_ONCE_INIT;
+
+static const char *simErrorStrings[] = {
+  "No Error", "Camera Not Found", "Exposure In Progress", "No Exposure In Progress",
+  "Unknown Command", "Bad Camera Command", "Bad Parameter", "TX Timeout",
+  "RX Timeout", "NAK Received", "CAN Received", "Unknown Response",
+  "Bad Length", "AD Timeout", "Keyboard Escape", "Checksum Error",
+  "EEPROM Error", "Shutter Error", "Unknown Camera", "Driver Not Found",
+  "Driver Not Open", "Driver Not Closed", "Share Error", "TCE Not Found",
+  "AO Error", "ECP Error", "Memory Error", "Device Not Found",
+  "Device Not Open", "Device Not Closed", "Device Not Implemented", "Device Disabled",
+  "OS Error", "Socket Error", "Server Not Found", "CFW Error",
+  "MF Error", "Firmware Error", "Diff Guider Error", "Ripple Correction Error",
+  "EZUSB Reset"};
+
+/**
+ * xorshift generator for the noise, so that lines are cheap to generate.
+ */
+static inline double simUniform(unsigned int &seed)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return (seed & 0xFFFFFF) / 16777216.0;
+}
+
+//Unit variance noise samples, so a pixel only costs one random number.
+#define SIM_NOISE_TABLE_SIZE 65536
+static float simNoiseTable[SIM_NOISE_TABLE_SIZE];
+
+static inline double simGauss(unsigned int &seed)
+{
+  simUniform(seed);
+  return simNoiseTable[seed & (SIM_NOISE_TABLE_SIZE - 1)];
+}
+
+static void simInit(void *arg)
+{
+  unsigned int seed = 88172645u;
+
+  simMutex = epicsMutexMustCreate();
+  epicsTimeGetCurrent(&simStartTime);
+  //Sum of 4 uniforms, scaled to unit variance.
+  for (int i = 0; i < SIM_NOISE_TABLE_SIZE; ++i) {
+    simNoiseTable[i] = (simUniform(seed) + simUniform(seed) + simUniform(seed) + simUniform(seed) - 2.0) * 1.7320508;
+  }
+}
+
+/**
+ * Convert a CCD temperature to a thermistor AD value, as the camera firmware does.
+ */
+static unsigned short simDegreesCToAD(double degC)
+{
+  double r;
+
+  if (degC < -50.0) {
+    degC = -50.0;
+  } else if (degC > 35.0) {
+    degC = 35.0;
+  }
+  r = SIM_R0 * exp(log(SIM_RR_CCD)*(SIM_T0 - degC)/SIM_DT_CCD);
+  return (unsigned short)(SIM_MAX_AD/((SIM_RB_CCD/r) + 1.0) + 0.5);
+}
+
+static double simADToDegreesC(unsigned short ad)
+{
+  double r;
+
+  if (ad < 1) {
+    ad = 1;
+  } else if (ad >= SIM_MAX_AD - 1) {
+    ad = SIM_MAX_AD - 1;
+  }
+  r = SIM_RB_CCD/(((double)SIM_MAX_AD/ad) - 1.0);
+  return SIM_T0 - SIM_DT_CCD*(log(r/SIM_R0)/log(SIM_RR_CCD));
+}
+
+/**
+ * Encode a value in the XXXXXX.XX hex-as-decimal format used for gain and pixel size.
+ */
+static unsigned long simToHex(double value)
+{
+  unsigned long dec = (unsigned long)(value * 100.0 + 0.5);
+  unsigned long res = 0;
+  int shift = 0;
+
+  while (dec > 0 && shift < 32) {
+    res |= (dec % 10) << shift;
+    dec /= 10;
+    shift += 4;
+  }
+  return res;
+}
+
+/**
+ * Horizontal and vertical binning for a readout mode. The high byte
+ * holds the vertical binning for the 1xN, 2xN and 3xN modes.
+ */
+static void simBinning(int readoutMode, int &hBin, int &vBin)
+{
+  int rm = readoutMode & 0xFF;
+  int vertN = readoutMode >> 8;
+
+  if (vertN == 0) {
+    vertN = 1;
+  }
+  hBin = vBin = 1;
+  if (rm <= RM_3X3) {
+    hBin = vBin = rm + 1;
+  } else if (rm <= RM_NX3) {
+    hBin = rm - RM_NX1 + 1;
+    vBin = vertN;
+  } else if (rm <= RM_3X3_VOFFCHIP) {
+    hBin = vBin = rm - RM_1X1_VOFFCHIP + 1;
+  } else if (rm == RM_9X9) {
+    hBin = vBin = 9;
+  }
+}
+
+static void simSensorSize(int ccd, int &width, int &height)
+{
+  if (ccd == CCD_IMAGING) {
+    width = simConfig.width;
+    height = simConfig.height;
+  } else {
+    width = SIM_TRACK_WIDTH;
+    height = SIM_TRACK_HEIGHT;
+  }
+}
+
+/**
+ * Fill in GetCCDInfoResults0 for the imaging or tracking CCD.
+ */
+static void simCCDInfo(int ccd, GetCCDInfoResults0 *pResults)
+{
+  int width = 0;
+  int height = 0;
+  int hBin = 1;
+  int vBin = 1;
+  double pixel = (ccd == CCD_IMAGING ? SIM_PIXEL_SIZE : SIM_TRACK_PIXEL);
+
+  simSensorSize(ccd, width, height);
+  memset(pResults, 0, sizeof(GetCCDInfoResults0));
+  pResults->firmwareVersion = 0x0100;
+  pResults->cameraType = STF_CAMERA;
+  if (ccd == CCD_IMAGING) {
+    strncpy(pResults->name, "SBIG STF-8300 Simulated Camera", sizeof(pResults->name) - 1);
+  } else {
+    strncpy(pResults->name, "SBIG Simulated Tracking CCD", sizeof(pResults->name) - 1);
+  }
+  pResults->readoutModes = SIM_NUM_READOUT_MODES;
+  for (int rm = 0; rm < SIM_NUM_READOUT_MODES; ++rm) {
+    simBinning(rm, hBin, vBin);
+    pResults->readoutInfo[rm].mode = rm;
+    pResults->readoutInfo[rm].width = width / hBin;
+    pResults->readoutInfo[rm].height = height / vBin;
+    pResults->readoutInfo[rm].gain = (unsigned short)simToHex(SIM_GAIN);
+    pResults->readoutInfo[rm].pixelWidth = simToHex(pixel * hBin);
+    pResults->readoutInfo[rm].pixelHeight = simToHex(pixel * vBin);
+  }
+}
+
+/**
+ * Advance the TE cooler model to now. The controller is proportional
+ * with feed forward, so it settles on the setpoint if it can reach it.
+ */
+static void simUpdateTE(SimCamera *pCam)
+{
+  epicsTimeStamp now;
+  double elapsed = 0.0;
+  double floorTemp = simConfig.ambient - SIM_TE_MAX_DELTA;
+
+  epicsTimeGetCurrent(&now);
+  elapsed = epicsTimeDiffInSeconds(&now, &pCam->teTime) * simConfig.timeScale;
+  pCam->teTime = now;
+
+  while (elapsed > 0.0) {
+    double step = (elapsed < SIM_TE_STEP ? elapsed : SIM_TE_STEP);
+    double power = 0.0;
+    if (pCam->teEnabled) {
+      power = (simConfig.ambient - pCam->ccdTemp) / SIM_TE_MAX_DELTA
+        + SIM_TE_GAIN * (pCam->ccdTemp - pCam->teSetpoint);
+      if (power < 0.0) {
+        power = 0.0;
+      } else if (power > 1.0) {
+        power = 1.0;
+      }
+    }
+    pCam->tePower = power;
+    pCam->ccdTemp += step * ((simConfig.ambient - SIM_TE_MAX_DELTA * power) - pCam->ccdTemp) / SIM_TE_TAU;
+    if (pCam->ccdTemp < floorTemp) {
+      pCam->ccdTemp = floorTemp;
+    }
+    elapsed -= step;
+  }
+}
+
+/**
+ * Update the exposure status of a CCD, completing the exposure once its time is up.
+ */
+static void simUpdateExposure(SimCCD *pCCD)
+{
+  epicsTimeStamp now;
+  double elapsed = 0.0;
+
+  if (pCCD->status != CS_INTEGRATING) {
+    return;
+  }
+  epicsTimeGetCurrent(&now);
+  elapsed = epicsTimeDiffInSeconds(&now, &pCCD->expStart);
+  if (elapsed >= pCCD->expTime) {
+    pCCD->status = CS_INTEGRATION_COMPLETE;
+    pCCD->exposed = pCCD->expTime;
+  }
+}
+
+static inline unsigned int simHash(unsigned int x, unsigned int y)
+{
+  unsigned int h = x * 374761393u + y * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  return h ^ (h >> 16);
+}
+
+/**
+ * Photon rate (e-/s) at an unbinned pixel with the shutter open:
+ * sky with a slight gradient plus a sparse field of stars.
+ */
+static double simSkyRate(int x, int y)
+{
+  int cx = x / SIM_STAR_CELL;
+  int cy = y / SIM_STAR_CELL;
+  unsigned int h = simHash(cx, cy);
+  double rate = SIM_SKY_RATE * (1.0 + 0.2 * y / (double)simConfig.height);
+
+  if ((h & 0x3) == 0) {
+    int sx = cx * SIM_STAR_CELL + 8 + (h >> 2) % (SIM_STAR_CELL - 16);
+    int sy = cy * SIM_STAR_CELL + 8 + (h >> 8) % (SIM_STAR_CELL - 16);
+    int d2 = (x - sx) * (x - sx) + (y - sy) * (y - sy);
+    if (d2 < 36) {
+      rate += (50.0 + (h >> 16) % 5000) * exp(-d2 / 4.5);
+    }
+  }
+  return rate;
+}
+
+/**
+ * Generate one line of the current readout. With subtract the dark line
+ * already in the destination buffer is subtracted and a pedestal added,
+ * as CC_READ_SUBTRACT_LINE does.
+ */
+static void simReadLine(SimCamera *pCam, SimCCD *pCCD, int ccd, const ReadoutLineParams *pRlp,
+                        bool subtract, unsigned short *pDest)
+{
+  int hBin = 1;
+  int vBin = 1;
+  int row = pCCD->top + pCCD->line;
+  double exposure = pCCD->exposed;
+  double darkRate = SIM_DARK_RATE * pow(2.0, pCam->ccdTemp / 6.0);
+
+  simBinning(pRlp->readoutMode, hBin, vBin);
+  int y = row * vBin + vBin / 2;
+  int nPix = hBin * vBin;
+  if (ccd != CCD_IMAGING) {
+    y += simConfig.height;
+  }
+
+  for (int i = 0; i < pRlp->pixelLength; ++i) {
+    int x = (pRlp->pixelStart + i) * hBin + hBin / 2;
+    double signal = 0.0;
+    double dark = darkRate * exposure * nPix;
+    if (pCCD->shutterOpen) {
+      signal = simSkyRate(x, y) * exposure * nPix;
+    }
+    double noise = sqrt(SIM_READ_NOISE * SIM_READ_NOISE + signal + dark) * simGauss(pCam->seed);
+    double value = SIM_BIAS + (signal + dark + noise) / SIM_GAIN;
+    if (value > SIM_FULL_WELL) {
+      value = SIM_FULL_WELL;
+    }
+    if (subtract) {
+      value = value - pDest[i] + SIM_PEDESTAL;
+    }
+    if (value < 0.0) {
+      value = 0.0;
+    } else if (value > SIM_FULL_WELL) {
+      value = SIM_FULL_WELL;
+    }
+    pDest[i] = (unsigned short)value;
+  }
+}
+
+/**
+ * Work out when the next lines of the readout are available. This is
+ * called before the lines are generated so that the time taken to
+ * generate them counts towards the readout time.
+ */
+static epicsTimeStamp simPaceLines(SimCCD *pCCD, double pixels)
+{
+  epicsTimeStamp now;
+
+  epicsTimeGetCurrent(&now);
+  if (epicsTimeDiffInSeconds(&now, &pCCD->lineDue) > 0.0) {
+    pCCD->lineDue = now;
+  }
+  if (simConfig.pixelRate > 0.0) {
+    epicsTimeAddSeconds(&pCCD->lineDue, pixels / (simConfig.pixelRate * simConfig.timeScale));
+  }
+  return pCCD->lineDue;
+}
+
+static short simCCDIndex(unsigned short ccd)
+{
+  ccd &= ~(START_SKIP_VDD | START_MOTOR_ALWAYS_ON | ABORT_DONT_END);
+  if (ccd > CCD_TRACKING) {
+    return -1;
+  }
+  return ccd;
+}
+
+static short simStartExposure(SimCamera *pCam, unsigned short ccdParam, unsigned long exposureTime,
+                              unsigned short openShutter)
+{
+  short ccd = simCCDIndex(ccdParam);
+  SimCCD *pCCD = NULL;
+  unsigned long ticks = exposureTime & EXP_TIME_MASK;
+
+  if (ccd < 0) {
+    return CE_BAD_PARAMETER;
+  }
+  pCCD = &pCam->ccd[ccd];
+  simUpdateExposure(pCCD);
+  if (pCCD->status == CS_INTEGRATING) {
+    return CE_EXPOSURE_IN_PROGRESS;
+  }
+  pCCD->expTime = ticks * ((exposureTime & EXP_MS_EXPOSURE) ? 0.001 : 0.01);
+  pCCD->exposed = 0.0;
+  if (openShutter == SC_OPEN_SHUTTER || openShutter == SC_OPEN_EXT_SHUTTER) {
+    pCam->shutterOpen = true;
+  } else if (openShutter == SC_CLOSE_SHUTTER || openShutter == SC_CLOSE_EXT_SHUTTER) {
+    pCam->shutterOpen = false;
+  }
+  pCCD->shutterOpen = pCam->shutterOpen;
+  epicsTimeGetCurrent(&pCCD->expStart);
+  pCCD->status = CS_INTEGRATING;
+  return CE_NO_ERROR;
+}
+
+static short simEndExposure(SimCamera *pCam, const EndExposureParams *pParams)
+{
+  short ccd = simCCDIndex(pParams->ccd);
+  SimCCD *pCCD = NULL;
+  epicsTimeStamp now;
+
+  if (ccd < 0) {
+    return CE_BAD_PARAMETER;
+  }
+  pCCD = &pCam->ccd[ccd];
+  simUpdateExposure(pCCD);
+  if (pCCD->status == CS_INTEGRATING) {
+    if (pParams->ccd & ABORT_DONT_END) {
+      pCCD->exposed = 0.0;
+    } else {
+      epicsTimeGetCurrent(&now);
+      pCCD->exposed = epicsTimeDiffInSeconds(&now, &pCCD->expStart);
+    }
+  }
+  pCCD->status = CS_IDLE;
+  return CE_NO_ERROR;
+}
+
+/**
+ * Check if a USB slot is open by any simulated camera.
+ * This must be called with simMutex held.
+ */
+static bool simSlotOpen(int slot)
+{
+  for (size_t i=0; i<simCameras.size(); ++i) {
+    if (simCameras[i] && simCameras[i]->deviceOpen && (simCameras[i]->slot == slot)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Replacement for SBIGUnivDrvCommand. The mutex is held for the state
+ * changes only, so line pacing does not block other threads (eg. the
+ * temperature polling) while a readout is in progress.
+ */
+short ADSBIGSimDrvCommand(short command, void *Params, void *pResults)
+{
+  short status = CE_NO_ERROR;
+  bool paced = false;
+  epicsTimeStamp due;
+  SimCamera *pCam = NULL;
+
+  epicsThreadOnce(&simOnce, simInit, NULL);
+  epicsMutexLock(simMutex);
+
+  //Driver and handle management doesn't need an open camera.
+  switch (command) {
+  case CC_OPEN_DRIVER:
+    if ((simCurrent >= 0) && (simCurrent < (short)simCameras.size()) && simCameras[simCurrent]) {
+      status = CE_DRIVER_NOT_CLOSED;
+    } else {
+      pCam = new SimCamera();
+      memset(pCam, 0, sizeof(SimCamera));
+      pCam->teSetpoint = simConfig.ambient;
+      pCam->ccdTemp = simConfig.ambient;
+      epicsTimeGetCurrent(&pCam->teTime);
+      pCam->seed = 2463534242u + simCameras.size();
+      simCameras.push_back(pCam);
+      simCurrent = simCameras.size() - 1;
+    }
+    epicsMutexUnlock(simMutex);
+    return status;
+  case CC_GET_DRIVER_HANDLE:
+    ((GetDriverHandleResults *)pResults)->handle = simCurrent;
+    epicsMutexUnlock(simMutex);
+    return CE_NO_ERROR;
+  case CC_SET_DRIVER_HANDLE: {
+    short handle = ((SetDriverHandleParams *)Params)->handle;
+    if ((handle == -1) ||
+        ((handle >= 0) && (handle < (short)simCameras.size()) && simCameras[handle])) {
+      simCurrent = handle;
+    } else {
+      status = CE_BAD_PARAMETER;
+    }
+    epicsMutexUnlock(simMutex);
+    return status;
+  }
+  case CC_GET_ERROR_STRING: {
+    unsigned short err = ((GetErrorStringParams *)Params)->errorNo;
+    GetErrorStringResults *pGesr = (GetErrorStringResults *)pResults;
+    if (err < sizeof(simErrorStrings)/sizeof(const char *)) {
+      snprintf(pGesr->errorString, sizeof(pGesr->errorString), "%s", simErrorStrings[err]);
+    } else {
+      snprintf(pGesr->errorString, sizeof(pGesr->errorString), "Unknown Error %d", err);
+    }
+    epicsMutexUnlock(simMutex);
+    return CE_NO_ERROR;
+  }
+  default:
+    break;
+  }
+
+  if ((simCurrent < 0) || (simCurrent >= (short)simCameras.size()) || !simCameras[simCurrent]) {
+    epicsMutexUnlock(simMutex);
+    return CE_DRIVER_NOT_OPEN;
+  }
+  pCam = simCameras[simCurrent];
+
+  if ((!pCam->deviceOpen) && (command != CC_OPEN_DEVICE) && (command != CC_CLOSE_DRIVER) &&
+      (command != CC_GET_DRIVER_INFO) && (command != CC_QUERY_USB) && (command != CC_QUERY_USB2)) {
+    epicsMutexUnlock(simMutex);
+    return CE_DEVICE_NOT_OPEN;
+  }
+
+  switch (command) {
+  case CC_CLOSE_DRIVER:
+    delete pCam;
+    simCameras[simCurrent] = NULL;
+    simCurrent = -1;
+    break;
+  case CC_OPEN_DEVICE: {
+    unsigned short type = ((OpenDeviceParams *)Params)->deviceType;
+    int slot = -1;
+    if (type == DEV_USB) {
+      //The first camera that isn't open
+      for (int i=0; (i<simConfig.numCameras) && (slot < 0); ++i) {
+        if (!simSlotOpen(i)) {
+          slot = i;
+        }
+      }
+    } else if ((type >= DEV_USB1) && (type <= DEV_USB8) && ((type - DEV_USB1) < simConfig.numCameras)) {
+      slot = type - DEV_USB1;
+    }
+    if (pCam->deviceOpen) {
+      status = CE_DEVICE_NOT_CLOSED;
+    } else if (slot < 0) {
+      status = CE_DEVICE_NOT_FOUND;
+    } else if (simSlotOpen(slot)) {
+      status = CE_DEVICE_NOT_CLOSED;
+    } else {
+      pCam->deviceOpen = true;
+      pCam->slot = slot;
+    }
+    break;
+  }
+  case CC_CLOSE_DEVICE:
+    pCam->deviceOpen = false;
+    pCam->linked = false;
+    break;
+  case CC_ESTABLISH_LINK:
+    pCam->linked = true;
+    ((EstablishLinkResults *)pResults)->cameraType = STF_CAMERA;
+    break;
+  case CC_GET_LINK_STATUS: {
+    GetLinkStatusResults *pGlsr = (GetLinkStatusResults *)pResults;
+    memset(pGlsr, 0, sizeof(GetLinkStatusResults));
+    pGlsr->linkEstablished = pCam->linked;
+    pGlsr->cameraType = (pCam->linked ? STF_CAMERA : NO_CAMERA);
+    break;
+  }
+  case CC_GET_DRIVER_INFO: {
+    GetDriverInfoResults0 *pGdir = (GetDriverInfoResults0 *)pResults;
+    memset(pGdir, 0, sizeof(GetDriverInfoResults0));
+    pGdir->version = 0x0100;
+    strncpy(pGdir->name, "ADSBIG Simulated Driver", sizeof(pGdir->name) - 1);
+    pGdir->maxRequest = DRIVER_EXTENDED;
+    break;
+  }
+  case CC_GET_CCD_INFO: {
+    unsigned short request = ((GetCCDInfoParams *)Params)->request;
+    if ((request == CCD_INFO_IMAGING) || (request == CCD_INFO_TRACKING)) {
+      simCCDInfo(request, (GetCCDInfoResults0 *)pResults);
+    } else if (request == CCD_INFO_EXTENDED) {
+      GetCCDInfoResults2 *pGcir2 = (GetCCDInfoResults2 *)pResults;
+      memset(pGcir2, 0, sizeof(GetCCDInfoResults2));
+      pGcir2->imagingABG = ABG_PRESENT;
+      snprintf(pGcir2->serialNumber, sizeof(pGcir2->serialNumber), "SIM%05d", pCam->slot);
+    } else if (request == CCD_INFO_EXTENDED_5C) {
+      GetCCDInfoResults3 *pGcir3 = (GetCCDInfoResults3 *)pResults;
+      pGcir3->adSize = AD_16_BITS;
+      pGcir3->filterType = FW_UNKNOWN;
+    } else if ((request == CCD_INFO_EXTENDED2_IMAGING) || (request == CCD_INFO_EXTENDED2_TRACKING)) {
+      memset(pResults, 0, sizeof(GetCCDInfoResults4));
+    } else if (request == CCD_INFO_EXTENDED3) {
+      memset(pResults, 0, sizeof(GetCCDInfoResults6));
+    } else {
+      status = CE_BAD_PARAMETER;
+    }
+    break;
+  }
+  case CC_QUERY_USB:
+  case CC_QUERY_USB2: {
+    QUERY_USB_INFO *pInfo = NULL;
+    int numCameras = simConfig.numCameras;
+    if (command == CC_QUERY_USB) {
+      numCameras = (numCameras > 4) ? 4 : numCameras;
+      memset(pResults, 0, sizeof(QueryUSBResults));
+      ((QueryUSBResults *)pResults)->camerasFound = numCameras;
+      pInfo = &((QueryUSBResults *)pResults)->usbInfo[0];
+    } else {
+      memset(pResults, 0, sizeof(QueryUSBResults2));
+      ((QueryUSBResults2 *)pResults)->camerasFound = numCameras;
+      pInfo = &((QueryUSBResults2 *)pResults)->usbInfo[0];
+    }
+    for (int i=0; i<numCameras; ++i) {
+      pInfo[i].cameraFound = TRUE;
+      pInfo[i].cameraType = STF_CAMERA;
+      strncpy(pInfo[i].name, "SBIG STF-8300 Simulated Camera", sizeof(pInfo[i].name) - 1);
+      snprintf(pInfo[i].serialNumber, sizeof(pInfo[i].serialNumber), "SIM%05d", i);
+    }
+    break;
+  }
+  case CC_START_EXPOSURE: {
+    StartExposureParams *pSep = (StartExposureParams *)Params;
+    status = simStartExposure(pCam, pSep->ccd, pSep->exposureTime, pSep->openShutter);
+    break;
+  }
+  case CC_START_EXPOSURE2: {
+    StartExposureParams2 *pSep2 = (StartExposureParams2 *)Params;
+    status = simStartExposure(pCam, pSep2->ccd, pSep2->exposureTime, pSep2->openShutter);
+    break;
+  }
+  case CC_END_EXPOSURE:
+    status = simEndExposure(pCam, (EndExposureParams *)Params);
+    break;
+  case CC_QUERY_COMMAND_STATUS: {
+    unsigned short query = ((QueryCommandStatusParams *)Params)->command;
+    unsigned short result = 0;
+    if ((query == CC_START_EXPOSURE) || (query == CC_START_EXPOSURE2)) {
+      simUpdateExposure(&pCam->ccd[CCD_IMAGING]);
+      simUpdateExposure(&pCam->ccd[CCD_TRACKING]);
+      result = (pCam->ccd[CCD_IMAGING].status & 0x03) | ((pCam->ccd[CCD_TRACKING].status & 0x03) << 2);
+    }
+    ((QueryCommandStatusResults *)pResults)->status = result;
+    break;
+  }
+  case CC_START_READOUT: {
+    StartReadoutParams *pSrp = (StartReadoutParams *)Params;
+    short ccd = simCCDIndex(pSrp->ccd);
+    if (ccd < 0) {
+      status = CE_BAD_PARAMETER;
+      break;
+    }
+    SimCCD *pCCD = &pCam->ccd[ccd];
+    pCCD->readoutMode = pSrp->readoutMode;
+    pCCD->top = pSrp->top;
+    pCCD->left = pSrp->left;
+    pCCD->height = pSrp->height;
+    pCCD->width = pSrp->width;
+    pCCD->line = 0;
+    pCCD->reading = true;
+    epicsTimeGetCurrent(&pCCD->lineDue);
+    simUpdateTE(pCam);
+    break;
+  }
+  case CC_READOUT_LINE:
+  case CC_READ_SUBTRACT_LINE: {
+    ReadoutLineParams *pRlp = (ReadoutLineParams *)Params;
+    short ccd = simCCDIndex(pRlp->ccd);
+    int width = 0;
+    int height = 0;
+    int hBin = 1;
+    int vBin = 1;
+    if (ccd < 0) {
+      status = CE_BAD_PARAMETER;
+      break;
+    }
+    SimCCD *pCCD = &pCam->ccd[ccd];
+    simSensorSize(ccd, width, height);
+    simBinning(pRlp->readoutMode, hBin, vBin);
+    if ((pRlp->pixelStart + pRlp->pixelLength > width / hBin) ||
+        ((pCCD->top + pCCD->line + 1) * vBin > height)) {
+      status = CE_BAD_PARAMETER;
+      break;
+    }
+    if (!pCCD->reading) {
+      //The real driver allows reading without StartReadout, from the top of the CCD.
+      pCCD->reading = true;
+      pCCD->top = 0;
+      pCCD->line = 0;
+      epicsTimeGetCurrent(&pCCD->lineDue);
+    }
+    due = simPaceLines(pCCD, pRlp->pixelLength);
+    paced = true;
+    simReadLine(pCam, pCCD, ccd, pRlp, (command == CC_READ_SUBTRACT_LINE), (unsigned short *)pResults);
+    pCCD->line++;
+    break;
+  }
+  case CC_DUMP_LINES: {
+    DumpLinesParams *pDlp = (DumpLinesParams *)Params;
+    short ccd = simCCDIndex(pDlp->ccd);
+    int width = 0;
+    int height = 0;
+    int hBin = 1;
+    int vBin = 1;
+    if (ccd < 0) {
+      status = CE_BAD_PARAMETER;
+      break;
+    }
+    SimCCD *pCCD = &pCam->ccd[ccd];
+    simSensorSize(ccd, width, height);
+    simBinning(pDlp->readoutMode, hBin, vBin);
+    pCCD->line += pDlp->lineLength;
+    due = simPaceLines(pCCD, (double)pDlp->lineLength * (width / hBin) / SIM_DUMP_FACTOR);
+    paced = true;
+    break;
+  }
+  case CC_END_READOUT: {
+    short ccd = simCCDIndex(((EndReadoutParams *)Params)->ccd);
+    if (ccd < 0) {
+      status = CE_BAD_PARAMETER;
+    } else {
+      pCam->ccd[ccd].reading = false;
+    }
+    break;
+  }
+  case CC_SET_TEMPERATURE_REGULATION: {
+    SetTemperatureRegulationParams *pStrp = (SetTemperatureRegulationParams *)Params;
+    simUpdateTE(pCam);
+    if (pStrp->regulation == REGULATION_ON) {
+      pCam->teEnabled = true;
+      pCam->teSetpoint = simADToDegreesC(pStrp->ccdSetpoint);
+    } else if (pStrp->regulation == REGULATION_OFF) {
+      pCam->teEnabled = false;
+    }
+    break;
+  }
+  case CC_SET_TEMPERATURE_REGULATION2: {
+    SetTemperatureRegulationParams2 *pStrp2 = (SetTemperatureRegulationParams2 *)Params;
+    simUpdateTE(pCam);
+    if (pStrp2->regulation == REGULATION_ON) {
+      pCam->teEnabled = true;
+      pCam->teSetpoint = pStrp2->ccdSetpoint;
+    } else if (pStrp2->regulation == REGULATION_OFF) {
+      pCam->teEnabled = false;
+    }
+    break;
+  }
+  case CC_QUERY_TEMPERATURE_STATUS: {
+    simUpdateTE(pCam);
+    if ((Params != NULL) && (((QueryTemperatureStatusParams *)Params)->request == TEMP_STATUS_ADVANCED2)) {
+      QueryTemperatureStatusResults2 *pQtsr2 = (QueryTemperatureStatusResults2 *)pResults;
+      memset(pQtsr2, 0, sizeof(QueryTemperatureStatusResults2));
+      pQtsr2->coolingEnabled = pCam->teEnabled;
+      pQtsr2->ccdSetpoint = pCam->teSetpoint;
+      pQtsr2->imagingCCDTemperature = pCam->ccdTemp;
+      pQtsr2->trackingCCDTemperature = pCam->ccdTemp;
+      pQtsr2->ambientTemperature = simConfig.ambient;
+      pQtsr2->imagingCCDPower = pCam->tePower * 100.0;
+    } else {
+      QueryTemperatureStatusResults *pQtsr = (QueryTemperatureStatusResults *)pResults;
+      pQtsr->enabled = pCam->teEnabled;
+      pQtsr->ccdSetpoint = simDegreesCToAD(pCam->teSetpoint);
+      pQtsr->power = (unsigned short)(pCam->tePower * 255.0 + 0.5);
+      pQtsr->ccdThermistor = simDegreesCToAD(pCam->ccdTemp);
+      pQtsr->ambientThermistor = 0;
+    }
+    break;
+  }
+  case CC_GET_US_TIMER: {
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    ((GetUSTimerResults *)pResults)->count =
+      (unsigned long)(epicsTimeDiffInSeconds(&now, &simStartTime) * 1.0e6);
+    break;
+  }
+  case CC_MISCELLANEOUS_CONTROL:
+  case CC_ACTIVATE_RELAY:
+  case CC_SET_DRIVER_CONTROL:
+    break;
+  default:
+    status = CE_UNKNOWN_COMMAND;
+    break;
+  }
+
+  epicsMutexUnlock(simMutex);
+
+  //Wait for the camera to digitize the line(s) without holding the mutex.
+  if (paced) {
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    double delay = epicsTimeDiffInSeconds(&due, &now);
+    if (delay > 0.0) {
+      epicsThreadSleep(delay);
+    }
+  }
+
+  return status;
+}
+
+/**
+ * Set the simulated sensor size, pixel rate, time scale and number
+ * of cameras. This applies to all simulated cameras and should be 
+ * called before the driver is created.
+ */
+void ADSBIGSimSetup(int width, int height, double pixelRate, double timeScale, int numCameras)
+{
+  epicsThreadOnce(&simOnce, simInit, NULL);
+  epicsMutexLock(simMutex);
+  if (width > 0) {
+    simConfig.width = width;
+  }
+  if (height > 0) {
+    simConfig.height = height;
+  }
+  if (pixelRate >= 0.0) {
+    simConfig.pixelRate = pixelRate;
+  }
+  if (timeScale > 0.0) {
+    simConfig.timeScale = timeScale;
+  }
+  if ((numCameras > 0) && (numCameras <= 8)) {
+    simConfig.numCameras = numCameras;
+  }
+  epicsMutexUnlock(simMutex);
+}
+
+
+/*************************************************************************************/
+/** The following functions have C linkage, and can be called directly or from iocsh */
+
+extern "C" {
+
+/**
+ * Configure the simulated camera used by ADSBIGConfig when simulation is enabled.
+ * @param width Sensor width in pixels (0 for the default)
+ * @param height Sensor height in pixels (0 for the default)
+ * @param pixelRate Digitized pixels per second (0 for no readout delay)
+ * @param timeScale Speed up factor for readout and cooling (0 for the default of 1)
+ * @param numCameras Number of cameras found on USB, 1 to 8 (0 for the default of 1)
+ */
+  int ADSBIGSimConfig(int width, int height, double pixelRate, double timeScale, int numCameras)
+  {
+    ADSBIGSimSetup(width, height, pixelRate, timeScale, numCameras);
+    printf("ADSBIGSimConfig: %dx%d, %g pixels/s, time scale %g, %d camera(s)\n",
+           simConfig.width, simConfig.height, simConfig.pixelRate, simConfig.timeScale,
+           simConfig.numCameras);
+    return 0;
+  }
+
+
+ /* Code for iocsh registration */
+
+  /* ADSBIGSimConfig */
+  static const iocshArg ADSBIGSimConfigArg0 = {"Width", iocshArgInt};
+  static const iocshArg ADSBIGSimConfigArg1 = {"Height", iocshArgInt};
+  static const iocshArg ADSBIGSimConfigArg2 = {"Pixel Rate", iocshArgDouble};
+  static const iocshArg ADSBIGSimConfigArg3 = {"Time Scale", iocshArgDouble};
+  static const iocshArg ADSBIGSimConfigArg4 = {"Num Cameras", iocshArgInt};
+  static const iocshArg * const ADSBIGSimConfigArgs[] =  {&ADSBIGSimConfigArg0,
+                                                            &ADSBIGSimConfigArg1,
+                                                            &ADSBIGSimConfigArg2,
+                                                            &ADSBIGSimConfigArg3,
+                                                            &ADSBIGSimConfigArg4};
+
+  static const iocshFuncDef configADSBIGSim = {"ADSBIGSimConfig", 5, ADSBIGSimConfigArgs};
+  static void configADSBIGSimCallFunc(const iocshArgBuf *args)
+  {
+    ADSBIGSimConfig(args[0].ival, args[1].ival, args[2].dval, args[3].dval, args[4].ival);
+  }
+
+  static void ADSBIGSimRegister(void)
+  {
+    iocshRegister(&configADSBIGSim, configADSBIGSimCallFunc);
+  }
+
+  epicsExportRegistrar(ADSBIGSimRegister);
+
+} // extern "C"
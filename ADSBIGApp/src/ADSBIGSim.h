@@ -0,0 +1,27 @@
+/**
+ * Simulated SBIG camera for the ADSBIG areaDetector driver.
+ *
+ * ADSBIGSimDrvCommand has the same signature as SBIGUnivDrvCommand
+ * in the SBIG Universal Driver and can be passed to the CSBIGCam
+ * constructor in its place. It implements the commands used by
+ * CSBIGCam in-process, so the whole driver can be run and
+ * benchmarked without a camera on USB.
+ *
+ */
+
+#ifndef ADSBIG_SIM_H
+#define ADSBIG_SIM_H
+
+//Defaults for the simulated camera (an STF-8300 sized sensor).
+#define ADSBIG_SIM_WIDTH       3326
+#define ADSBIG_SIM_HEIGHT      2504
+#define ADSBIG_SIM_PIXEL_RATE  1.0e6   //Digitized pixels per second
+#define ADSBIG_SIM_TIME_SCALE  1.0     //>1 runs readout and cooling faster than real time
+#define ADSBIG_SIM_AMBIENT     20.0    //Degrees C
+#define ADSBIG_SIM_NUM_CAMERAS 1       //Cameras found on USB
+
+short ADSBIGSimDrvCommand(short command, void *Params, void *pResults);
+
+void ADSBIGSimSetup(int width, int height, double pixelRate, double timeScale, int numCameras);
+
+#endif //ADSBIG_SIM_H
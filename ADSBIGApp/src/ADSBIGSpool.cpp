@@ -0,0 +1,641 @@
+/**
+ * Raw frame spool for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <epicsAtomic.h>
+#include <epicsStdio.h>
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "csbigimg.h"
+
+#include "ADSBIGSpool.h"
+
+static size_t ADSBIGSpoolAlign(size_t size)
+{
+  return (size + ADSBIG_SPOOL_ALIGN - 1) & ~static_cast<size_t>(ADSBIG_SPOOL_ALIGN - 1);
+}
+
+/**
+ * The size of a pixel of a spooled frame, or 0 if the data type is not valid.
+ */
+static size_t ADSBIGSpoolElementSize(epicsInt32 dataType)
+{
+  switch (dataType) {
+  case NDInt8:
+  case NDUInt8:
+    return 1;
+  case NDInt16:
+  case NDUInt16:
+    return 2;
+  case NDInt32:
+  case NDUInt32:
+  case NDFloat32:
+    return 4;
+  case NDFloat64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Check that the dimensions and data type of a spooled frame match its data size.
+ */
+static bool ADSBIGSpoolFrameValid(const ADSBIGSpoolRecordHeader *pRecord)
+{
+  epicsUInt64 dataBytes = ADSBIGSpoolElementSize(pRecord->dataType);
+
+  if ((dataBytes == 0) || (pRecord->ndims < 1) || (pRecord->ndims > ADSBIG_SPOOL_MAX_DIMS)) {
+    return false;
+  }
+  for (int dim=0; dim<pRecord->ndims; ++dim) {
+    if ((pRecord->dims[dim] == 0) || (dataBytes > (pRecord->dataBytes / pRecord->dims[dim]))) {
+      return false;
+    }
+    dataBytes *= pRecord->dims[dim];
+  }
+  return (dataBytes == pRecord->dataBytes);
+}
+
+ADSBIGSpool::ADSBIGSpool() :
+  m_fd(-1), m_pMap(NULL), m_mapSize(0), m_pHeader(NULL), m_pRing(NULL), m_rate(0.0)
+{
+  m_mutex = epicsMutexMustCreate();
+}
+
+ADSBIGSpool::~ADSBIGSpool()
+{
+  close();
+  epicsMutexDestroy(m_mutex);
+}
+
+/**
+ * Open the spool file, creating it if it does not exist or is not the right
+ * size. An existing spool of the same size is appended to, so that the frames
+ * in it are kept until they are overwritten. The file is set up before it is
+ * made the current spool, so append does not wait for the disk.
+ * @param fileName The spool file
+ * @param ringSize The size of the ring in bytes (the file is one header page bigger)
+ * @param message Set to what was done, or why it failed
+ * @return false if the spool could not be opened
+ */
+bool ADSBIGSpool::open(const std::string &fileName, size_t ringSize, std::string &message)
+{
+  struct stat fileStat;
+  char text[256];
+  bool resume = false;
+  int status = 0;
+  int fd = -1;
+  unsigned char *pMap = NULL;
+
+  close();
+
+  ringSize = ADSBIGSpoolAlign(ringSize);
+  size_t fileSize = ADSBIG_SPOOL_HEADER_SIZE + ringSize;
+
+  if ((fd = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0644)) < 0) {
+    message = std::string("Failed to open spool file: ") + strerror(errno);
+    return false;
+  }
+
+  if ((fstat(fd, &fileStat) == 0) && (static_cast<size_t>(fileStat.st_size) == fileSize)) {
+    resume = true;
+  } else {
+    //Allocate the blocks now, so that running out of disk space is an error here and not a SIGBUS later
+    if ((ftruncate(fd, 0) != 0) || ((status = posix_fallocate(fd, 0, fileSize)) != 0)) {
+      message = std::string("Failed to allocate spool file: ") + strerror(status ? status : errno);
+      ::close(fd);
+      return false;
+    }
+  }
+
+  pMap = static_cast<unsigned char *>(mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  if (pMap == MAP_FAILED) {
+    message = std::string("Failed to map spool file: ") + strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  ADSBIGSpoolFileHeader *pHeader = reinterpret_cast<ADSBIGSpoolFileHeader *>(pMap);
+
+  if (resume && (pHeader->magic == ADSBIG_SPOOL_MAGIC) && (pHeader->version == ADSBIG_SPOOL_VERSION) &&
+      (pHeader->ringSize == ringSize) && (pHeader->writeOffset < ringSize) && (pHeader->oldestOffset < ringSize)) {
+    epicsSnprintf(text, sizeof(text), "Appending to spool with %llu frames",
+                  static_cast<unsigned long long>(pHeader->numFrames));
+  } else {
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    memset(pHeader, 0, sizeof(ADSBIGSpoolFileHeader));
+    pHeader->version = ADSBIG_SPOOL_VERSION;
+    pHeader->headerSize = ADSBIG_SPOOL_HEADER_SIZE;
+    pHeader->ringSize = ringSize;
+    //Start the sequence numbers somewhere new, so that records left in the file
+    //from an older spool can never look like records of this one
+    pHeader->nextSequence = static_cast<epicsUInt64>(now.secPastEpoch) << 32;
+    epicsAtomicWriteMemoryBarrier();
+    pHeader->magic = ADSBIG_SPOOL_MAGIC;
+    msync(pMap, ADSBIG_SPOOL_HEADER_SIZE, MS_SYNC);
+    epicsSnprintf(text, sizeof(text), "Created %lu MB spool",
+                  static_cast<unsigned long>(ringSize / (1024 * 1024)));
+  }
+  message = text;
+
+  epicsMutexMustLock(m_mutex);
+  m_fd = fd;
+  m_pMap = pMap;
+  m_mapSize = fileSize;
+  m_pHeader = pHeader;
+  m_pRing = pMap + ADSBIG_SPOOL_HEADER_SIZE;
+  m_fileName = fileName;
+  m_rate = 0.0;
+  epicsMutexUnlock(m_mutex);
+
+  return true;
+}
+
+/**
+ * Flush and close the spool file.
+ */
+void ADSBIGSpool::close(void)
+{
+  epicsMutexMustLock(m_mutex);
+  if (m_pMap != NULL) {
+    msync(m_pMap, m_mapSize, MS_SYNC);
+    munmap(m_pMap, m_mapSize);
+    m_pMap = NULL;
+    m_pHeader = NULL;
+    m_pRing = NULL;
+    m_mapSize = 0;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+  epicsMutexUnlock(m_mutex);
+}
+
+bool ADSBIGSpool::isOpen(void) const
+{
+  bool open = false;
+
+  epicsMutexMustLock(m_mutex);
+  open = (m_pMap != NULL);
+  epicsMutexUnlock(m_mutex);
+
+  return open;
+}
+
+/**
+ * Drop the oldest record from the header, so that it can be overwritten.
+ * Called with m_mutex held.
+ */
+void ADSBIGSpool::evictOldest(void)
+{
+  const ADSBIGSpoolRecordHeader *pRecord =
+    reinterpret_cast<const ADSBIGSpoolRecordHeader *>(m_pRing + m_pHeader->oldestOffset);
+  epicsUInt64 offset = m_pHeader->oldestOffset + pRecord->recordSize;
+
+  m_pHeader->numFrames--;
+  m_pHeader->overwrites++;
+  if (m_pHeader->numFrames == 0) {
+    offset = m_pHeader->writeOffset;
+  } else if ((offset >= m_pHeader->ringSize) ||
+             (reinterpret_cast<const ADSBIGSpoolRecordHeader *>(m_pRing + offset)->type == ADSBIG_SPOOL_WRAP)) {
+    offset = 0;
+  }
+  m_pHeader->oldestOffset = offset;
+}
+
+/**
+ * Append a frame to the spool, overwriting the oldest frames if there is no room.
+ * @param pArray The frame
+ * @param info The params it was taken with
+ * @return false if the spool is not open or the frame is bigger than the spool
+ */
+bool ADSBIGSpool::append(NDArray *pArray, const ADSBIGSpoolFrameInfo &info)
+{
+  epicsTimeStamp startTime;
+  epicsTimeStamp endTime;
+  NDArrayInfo_t arrayInfo;
+
+  epicsTimeGetCurrent(&startTime);
+  pArray->getInfo(&arrayInfo);
+  size_t headerBytes = ADSBIGSpoolAlign(sizeof(ADSBIGSpoolRecordHeader));
+  size_t dataBytes = arrayInfo.totalBytes;
+  size_t recordSize = headerBytes + ADSBIGSpoolAlign(dataBytes);
+
+  epicsMutexMustLock(m_mutex);
+  if ((m_pMap == NULL) || (recordSize > m_pHeader->ringSize) || (pArray->ndims > ADSBIG_SPOOL_MAX_DIMS)) {
+    epicsMutexUnlock(m_mutex);
+    return false;
+  }
+
+  epicsUInt64 offset = m_pHeader->writeOffset;
+
+  //Records are never split, so wrap to the start if this one does not fit at the end
+  if ((offset + recordSize) > m_pHeader->ringSize) {
+    while ((m_pHeader->numFrames > 0) && (m_pHeader->oldestOffset >= offset)) {
+      evictOldest();
+    }
+    epicsAtomicWriteMemoryBarrier();
+    reinterpret_cast<ADSBIGSpoolRecordHeader *>(m_pRing + offset)->type = ADSBIG_SPOOL_WRAP;
+    offset = 0;
+    m_pHeader->writeOffset = 0;
+    if (m_pHeader->numFrames == 0) {
+      m_pHeader->oldestOffset = 0;
+    }
+  }
+  while ((m_pHeader->numFrames > 0) && (m_pHeader->oldestOffset >= offset) &&
+         (m_pHeader->oldestOffset < (offset + recordSize))) {
+    evictOldest();
+  }
+  if (m_pHeader->numFrames == 0) {
+    m_pHeader->oldestOffset = offset;
+  }
+  //The header must not point at the records before they are overwritten
+  epicsAtomicWriteMemoryBarrier();
+
+  ADSBIGSpoolRecordHeader *pRecord = reinterpret_cast<ADSBIGSpoolRecordHeader *>(m_pRing + offset);
+  pRecord->commit = 0;
+  epicsAtomicWriteMemoryBarrier();
+  pRecord->type = ADSBIG_SPOOL_FRAME;
+  pRecord->headerSize = static_cast<epicsUInt32>(headerBytes);
+  pRecord->recordSize = recordSize;
+  pRecord->sequence = m_pHeader->nextSequence;
+  pRecord->uniqueId = pArray->uniqueId;
+  pRecord->dataType = pArray->dataType;
+  pRecord->timeStamp = pArray->timeStamp;
+  pRecord->epicsSec = pArray->epicsTS.secPastEpoch;
+  pRecord->epicsNsec = pArray->epicsTS.nsec;
+  pRecord->ndims = pArray->ndims;
+  pRecord->pad = 0;
+  for (int dim=0; dim<ADSBIG_SPOOL_MAX_DIMS; ++dim) {
+    pRecord->dims[dim] = (dim < pArray->ndims) ? pArray->dims[dim].size : 0;
+  }
+  pRecord->dataBytes = dataBytes;
+  pRecord->info = info;
+  memcpy(m_pRing + offset + headerBytes, pArray->pData, dataBytes);
+  epicsAtomicWriteMemoryBarrier();
+  pRecord->commit = pRecord->sequence;
+  epicsAtomicWriteMemoryBarrier();
+
+  offset += recordSize;
+  m_pHeader->writeOffset = (offset >= m_pHeader->ringSize) ? 0 : offset;
+  m_pHeader->nextSequence++;
+  m_pHeader->numFrames++;
+
+  //Start writing the record and the header back to disk, without waiting for it
+  size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t start = (ADSBIG_SPOOL_HEADER_SIZE + (offset - recordSize)) & ~(pageSize - 1);
+  msync(m_pMap + start, (ADSBIG_SPOOL_HEADER_SIZE + offset) - start, MS_ASYNC);
+  msync(m_pMap, ADSBIG_SPOOL_HEADER_SIZE, MS_ASYNC);
+
+  epicsTimeGetCurrent(&endTime);
+  double seconds = epicsTimeDiffInSeconds(&endTime, &startTime);
+  if (seconds > 0.0) {
+    m_rate = (recordSize / seconds) / 1.0e6;
+  }
+  epicsMutexUnlock(m_mutex);
+
+  return true;
+}
+
+/**
+ * @param fillPercent Set to how full the ring is
+ * @param numFrames Set to the number of frames in the spool
+ * @param overwrites Set to the number of frames overwritten since the spool was created
+ * @param rate Set to the write rate of the last frame (MB/s)
+ */
+void ADSBIGSpool::status(double &fillPercent, int &numFrames, int &overwrites, double &rate)
+{
+  epicsMutexMustLock(m_mutex);
+  if (m_pMap == NULL) {
+    fillPercent = 0.0;
+    numFrames = 0;
+    overwrites = 0;
+    rate = 0.0;
+  } else {
+    epicsUInt64 used = 0;
+    if (m_pHeader->numFrames > 0) {
+      if (m_pHeader->writeOffset > m_pHeader->oldestOffset) {
+        used = m_pHeader->writeOffset - m_pHeader->oldestOffset;
+      } else {
+        used = m_pHeader->ringSize - m_pHeader->oldestOffset + m_pHeader->writeOffset;
+      }
+    }
+    fillPercent = (100.0 * used) / m_pHeader->ringSize;
+    numFrames = static_cast<int>(m_pHeader->numFrames);
+    overwrites = static_cast<int>(m_pHeader->overwrites);
+    rate = m_rate;
+  }
+  epicsMutexUnlock(m_mutex);
+}
+
+
+ADSBIGSpoolReader::ADSBIGSpoolReader() :
+  m_fd(-1), m_pMap(NULL), m_mapSize(0), m_pHeader(NULL), m_pRing(NULL),
+  m_offset(0), m_expected(0), m_numRead(0), m_numSkipped(0)
+{
+}
+
+ADSBIGSpoolReader::~ADSBIGSpoolReader()
+{
+  close();
+}
+
+/**
+ * Open a spool file read only.
+ * @param fileName The spool file
+ * @param message Set to why it failed
+ * @return false if the file is not a valid spool
+ */
+bool ADSBIGSpoolReader::open(const std::string &fileName, std::string &message)
+{
+  struct stat fileStat;
+
+  close();
+
+  if ((m_fd = ::open(fileName.c_str(), O_RDONLY)) < 0) {
+    message = std::string("Failed to open spool file: ") + strerror(errno);
+    return false;
+  }
+  if ((fstat(m_fd, &fileStat) != 0) || (static_cast<size_t>(fileStat.st_size) < ADSBIG_SPOOL_HEADER_SIZE)) {
+    message = "Not a spool file";
+    close();
+    return false;
+  }
+  m_mapSize = static_cast<size_t>(fileStat.st_size);
+  m_pMap = static_cast<unsigned char *>(mmap(NULL, m_mapSize, PROT_READ, MAP_SHARED, m_fd, 0));
+  if (m_pMap == MAP_FAILED) {
+    message = std::string("Failed to map spool file: ") + strerror(errno);
+    m_pMap = NULL;
+    close();
+    return false;
+  }
+  m_pHeader = reinterpret_cast<const ADSBIGSpoolFileHeader *>(m_pMap);
+  m_pRing = m_pMap + ADSBIG_SPOOL_HEADER_SIZE;
+
+  if ((m_pHeader->magic != ADSBIG_SPOOL_MAGIC) || (m_pHeader->version != ADSBIG_SPOOL_VERSION) ||
+      ((ADSBIG_SPOOL_HEADER_SIZE + m_pHeader->ringSize) > m_mapSize) ||
+      (m_pHeader->oldestOffset >= m_pHeader->ringSize)) {
+    message = "Not a spool file, or the header is damaged";
+    close();
+    return false;
+  }
+
+  //The record at the write offset is also read if it was committed before the
+  //header was updated (a crash between the two).
+  m_offset = m_pHeader->oldestOffset;
+  m_expected = m_pHeader->nextSequence - m_pHeader->numFrames;
+  m_numRead = 0;
+  m_numSkipped = 0;
+  return true;
+}
+
+void ADSBIGSpoolReader::close(void)
+{
+  if (m_pMap != NULL) {
+    munmap(m_pMap, m_mapSize);
+    m_pMap = NULL;
+    m_pHeader = NULL;
+    m_pRing = NULL;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+const ADSBIGSpoolFileHeader* ADSBIGSpoolReader::header(void) const
+{
+  return m_pHeader;
+}
+
+/**
+ * Get the next committed frame. Frames whose dimensions and data type
+ * do not match their data size are skipped.
+ * @param ppRecord Set to the record header
+ * @param ppData Set to the frame data
+ * @return false if there are no more frames
+ */
+bool ADSBIGSpoolReader::next(const ADSBIGSpoolRecordHeader **ppRecord, const void **ppData)
+{
+  epicsUInt64 ringSize = 0;
+  const ADSBIGSpoolRecordHeader *pRecord = NULL;
+  bool valid = false;
+
+  if (m_pMap == NULL) {
+    return false;
+  }
+  ringSize = m_pHeader->ringSize;
+
+  while (!valid) {
+    for (int attempt=0; attempt<2; ++attempt) {
+      if ((m_offset + sizeof(ADSBIGSpoolRecordHeader)) > ringSize) {
+        m_offset = 0;
+      }
+      pRecord = reinterpret_cast<const ADSBIGSpoolRecordHeader *>(m_pRing + m_offset);
+      if (pRecord->type != ADSBIG_SPOOL_WRAP) {
+        break;
+      }
+      m_offset = 0;
+    }
+
+    if ((pRecord->type != ADSBIG_SPOOL_FRAME) || (pRecord->sequence != m_expected) ||
+        (pRecord->commit != pRecord->sequence) || (pRecord->headerSize < sizeof(ADSBIGSpoolRecordHeader)) ||
+        (pRecord->recordSize < (pRecord->headerSize + pRecord->dataBytes)) ||
+        ((m_offset + pRecord->recordSize) > ringSize)) {
+      return false;
+    }
+
+    valid = ADSBIGSpoolFrameValid(pRecord);
+    if (valid) {
+      *ppRecord = pRecord;
+      *ppData = m_pRing + m_offset + pRecord->headerSize;
+      m_numRead++;
+    } else {
+      m_numSkipped++;
+    }
+    m_offset += pRecord->recordSize;
+    m_expected++;
+  }
+  return true;
+}
+
+/**
+ * The number of frames skipped by next because they were not valid.
+ */
+epicsUInt64 ADSBIGSpoolReader::numSkipped(void) const
+{
+  return m_numSkipped;
+}
+
+
+/*************************************************************************************/
+/** The following functions have C linkage, and can be called directly or from iocsh */
+
+extern "C" {
+
+/**
+ * List the frames in a spool file.
+ * @param fileName The spool file
+ */
+  int ADSBIGSpoolList(const char *fileName)
+  {
+    ADSBIGSpoolReader reader;
+    const ADSBIGSpoolRecordHeader *pRecord = NULL;
+    const void *pData = NULL;
+    std::string message;
+    char timeText[40];
+    epicsTimeStamp frameTime;
+    int numFrames = 0;
+
+    if ((fileName == NULL) || !reader.open(fileName, message)) {
+      printf("ADSBIGSpoolList: %s\n", message.c_str());
+      return -1;
+    }
+    printf("ADSBIGSpoolList: %s, ring %llu MB, %llu frames, %llu overwritten\n", fileName,
+           static_cast<unsigned long long>(reader.header()->ringSize / (1024 * 1024)),
+           static_cast<unsigned long long>(reader.header()->numFrames),
+           static_cast<unsigned long long>(reader.header()->overwrites));
+    while (reader.next(&pRecord, &pData)) {
+      frameTime.secPastEpoch = pRecord->epicsSec;
+      frameTime.nsec = pRecord->epicsNsec;
+      epicsTimeToStrftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S.%03f", &frameTime);
+      printf("  %llu: uniqueId %d, %s, %llux%llu type %d, exposure %g s, bin %dx%d, temp %.2f C\n",
+             static_cast<unsigned long long>(pRecord->sequence), pRecord->uniqueId, timeText,
+             static_cast<unsigned long long>(pRecord->dims[0]), static_cast<unsigned long long>(pRecord->dims[1]),
+             pRecord->dataType, pRecord->info.acquireTime, pRecord->info.binX, pRecord->info.binY,
+             pRecord->info.ccdTemp);
+      numFrames++;
+    }
+    printf("ADSBIGSpoolList: %d committed frames (%llu not valid)\n", numFrames,
+           static_cast<unsigned long long>(reader.numSkipped()));
+    return 0;
+  }
+
+/**
+ * Export the frames in a spool file. UInt16 frames are written as SBIG
+ * compressed image files, and other frames as raw data. An index.csv file
+ * lists the frames and the params they were taken with.
+ * @param fileName The spool file
+ * @param directory The directory to write to (it must exist)
+ */
+  int ADSBIGSpoolExport(const char *fileName, const char *directory)
+  {
+    ADSBIGSpoolReader reader;
+    const ADSBIGSpoolRecordHeader *pRecord = NULL;
+    const void *pData = NULL;
+    std::string message;
+    char path[512];
+    epicsTimeStamp startTime;
+    time_t startSeconds;
+    FILE *pIndex = NULL;
+    FILE *pRaw = NULL;
+    int numFrames = 0;
+    int numFailed = 0;
+
+    if ((fileName == NULL) || (directory == NULL) || !reader.open(fileName, message)) {
+      printf("ADSBIGSpoolExport: %s\n", message.empty() ? "Need a spool file and a directory" : message.c_str());
+      return -1;
+    }
+    epicsSnprintf(path, sizeof(path), "%s/index.csv", directory);
+    if ((pIndex = fopen(path, "w")) == NULL) {
+      printf("ADSBIGSpoolExport: Failed to create %s\n", path);
+      return -1;
+    }
+    fprintf(pIndex, "sequence,file,uniqueId,timeStamp,epicsSec,epicsNsec,dataType,width,height,"
+            "acquireTime,ccdTemp,binX,binY,minX,minY,readoutMode,darkField,numExposures\n");
+
+    while (reader.next(&pRecord, &pData)) {
+      bool ok = false;
+      unsigned long long sequence = static_cast<unsigned long long>(pRecord->sequence);
+      if ((pRecord->dataType == NDUInt16) && (pRecord->ndims == 2)) {
+        CSBIGImg sbigImg;
+        int width = static_cast<int>(pRecord->dims[0]);
+        int height = static_cast<int>(pRecord->dims[1]);
+        epicsSnprintf(path, sizeof(path), "%s/spool_%llu.sbig", directory, sequence);
+        if (sbigImg.AllocateImageBuffer(height, width)) {
+          memcpy(sbigImg.GetImagePointer(), pData, pRecord->dataBytes);
+          sbigImg.SetExposureTime(pRecord->info.acquireTime);
+          sbigImg.SetCCDTemperature(pRecord->info.ccdTemp);
+          sbigImg.SetBinning(static_cast<unsigned short>(pRecord->info.binX), static_cast<unsigned short>(pRecord->info.binY));
+          sbigImg.SetSubFrame(pRecord->info.minX, pRecord->info.minY);
+          sbigImg.SetReadoutMode(static_cast<unsigned short>(pRecord->info.readoutMode));
+          sbigImg.SetNumberExposures(static_cast<unsigned short>(pRecord->info.numExposures));
+          startTime = pRecord->info.startTime;
+          epicsTimeToTime_t(&startSeconds, &startTime);
+          sbigImg.SetImageStartTime(startSeconds);
+          ok = (sbigImg.SaveImage(path, SBIF_COMPRESSED) == SBFE_NO_ERROR);
+        }
+      } else {
+        epicsSnprintf(path, sizeof(path), "%s/spool_%llu.raw", directory, sequence);
+        if ((pRaw = fopen(path, "wb")) != NULL) {
+          ok = (fwrite(pData, 1, pRecord->dataBytes, pRaw) == pRecord->dataBytes);
+          ok = (fclose(pRaw) == 0) && ok;
+        }
+      }
+      if (!ok) {
+        printf("ADSBIGSpoolExport: Failed to write %s\n", path);
+        numFailed++;
+        continue;
+      }
+      fprintf(pIndex, "%llu,%s,%d,%.6f,%u,%u,%d,%llu,%llu,%g,%.2f,%d,%d,%d,%d,%d,%d,%d\n",
+              sequence, path, pRecord->uniqueId, pRecord->timeStamp, pRecord->epicsSec, pRecord->epicsNsec,
+              pRecord->dataType, static_cast<unsigned long long>(pRecord->dims[0]),
+              static_cast<unsigned long long>(pRecord->dims[1]), pRecord->info.acquireTime,
+              pRecord->info.ccdTemp, pRecord->info.binX, pRecord->info.binY, pRecord->info.minX,
+              pRecord->info.minY, pRecord->info.readoutMode, pRecord->info.darkField, pRecord->info.numExposures);
+      numFrames++;
+    }
+    fclose(pIndex);
+
+    printf("ADSBIGSpoolExport: Exported %d frames to %s (%d failed, %llu not valid)\n", numFrames, directory, 
+           numFailed, static_cast<unsigned long long>(reader.numSkipped()));
+    return ((numFailed == 0) && (reader.numSkipped() == 0)) ? 0 : -1;
+  }
+
+
+ /* Code for iocsh registration */
+
+  /* ADSBIGSpoolList */
+  static const iocshArg ADSBIGSpoolListArg0 = {"Spool File", iocshArgString};
+  static const iocshArg * const ADSBIGSpoolListArgs[] =  {&ADSBIGSpoolListArg0};
+
+  static const iocshFuncDef listADSBIGSpool = {"ADSBIGSpoolList", 1, ADSBIGSpoolListArgs};
+  static void listADSBIGSpoolCallFunc(const iocshArgBuf *args)
+  {
+    ADSBIGSpoolList(args[0].sval);
+  }
+
+  /* ADSBIGSpoolExport */
+  static const iocshArg ADSBIGSpoolExportArg0 = {"Spool File", iocshArgString};
+  static const iocshArg ADSBIGSpoolExportArg1 = {"Directory", iocshArgString};
+  static const iocshArg * const ADSBIGSpoolExportArgs[] =  {&ADSBIGSpoolExportArg0,
+                                                              &ADSBIGSpoolExportArg1};
+
+  static const iocshFuncDef exportADSBIGSpool = {"ADSBIGSpoolExport", 2, ADSBIGSpoolExportArgs};
+  static void exportADSBIGSpoolCallFunc(const iocshArgBuf *args)
+  {
+    ADSBIGSpoolExport(args[0].sval, args[1].sval);
+  }
+
+  static void ADSBIGSpoolRegister(void)
+  {
+    iocshRegister(&listADSBIGSpool, listADSBIGSpoolCallFunc);
+    iocshRegister(&exportADSBIGSpool, exportADSBIGSpoolCallFunc);
+  }
+
+  epicsExportRegistrar(ADSBIGSpoolRegister);
+
+} // extern "C"
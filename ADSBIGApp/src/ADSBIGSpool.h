@@ -0,0 +1,152 @@
+/**
+ * Raw frame spool for the ADSBIG areaDetector driver.
+ *
+ * The spool is a preallocated file used as a ring of frame records. The
+ * file is memory mapped, so a frame is written with plain stores and is
+ * in the page cache as soon as it has been copied; it survives the IOC
+ * crashing even if it has not yet been flushed to disk. The kernel is
+ * asked to start writing each frame back once it has been copied.
+ *
+ * The file starts with a header page that has the ring pointers. Each
+ * record is a record header (the frame IDs, time stamps, dimensions
+ * and the driver params it was taken with) followed by the frame data,
+ * padded to ADSBIG_SPOOL_ALIGN bytes. A record is committed by writing
+ * its sequence number a second time, after the data. Old records are
+ * dropped from the header before they are overwritten, so after a crash
+ * the file has every committed frame from the oldest in the header on.
+ *
+ */
+
+#ifndef ADSBIG_SPOOL_H
+#define ADSBIG_SPOOL_H
+
+#include <stddef.h>
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+
+#include "NDArray.h"
+
+#define ADSBIG_SPOOL_MAGIC   0x4C4F4F5053474942ULL /* "BIGSPOOL" */
+#define ADSBIG_SPOOL_VERSION 1
+#define ADSBIG_SPOOL_HEADER_SIZE 4096
+#define ADSBIG_SPOOL_ALIGN 64
+#define ADSBIG_SPOOL_MAX_DIMS 3
+
+//Record types
+#define ADSBIG_SPOOL_FRAME 0x454D4152 /* "RAME" */
+#define ADSBIG_SPOOL_WRAP  0x50415257 /* "WRAP" */
+
+/**
+ * The file header. All the offsets are from the start of the ring (the end of the header page).
+ */
+struct ADSBIGSpoolFileHeader {
+  epicsUInt64 magic;
+  epicsUInt32 version;
+  epicsUInt32 headerSize;
+  epicsUInt64 ringSize;
+  epicsUInt64 writeOffset;
+  epicsUInt64 oldestOffset;
+  epicsUInt64 nextSequence;
+  epicsUInt64 numFrames;
+  epicsUInt64 overwrites;
+};
+
+/**
+ * The params a frame was taken with, filled in by the driver when the frame is published.
+ */
+struct ADSBIGSpoolFrameInfo {
+  epicsTimeStamp startTime;
+  epicsFloat64 acquireTime;
+  epicsFloat64 ccdTemp;
+  epicsInt32 binX;
+  epicsInt32 binY;
+  epicsInt32 minX;
+  epicsInt32 minY;
+  epicsInt32 readoutMode;
+  epicsInt32 darkField;
+  epicsInt32 numExposures;
+  epicsInt32 address;
+};
+
+struct ADSBIGSpoolRecordHeader {
+  epicsUInt32 type;
+  epicsUInt32 headerSize;
+  epicsUInt64 recordSize;
+  epicsUInt64 sequence;
+  epicsInt32 uniqueId;
+  epicsInt32 dataType;
+  epicsFloat64 timeStamp;
+  epicsUInt32 epicsSec;
+  epicsUInt32 epicsNsec;
+  epicsInt32 ndims;
+  epicsInt32 pad;
+  epicsUInt64 dims[ADSBIG_SPOOL_MAX_DIMS];
+  epicsUInt64 dataBytes;
+  ADSBIGSpoolFrameInfo info;
+  //Written last, after the data. The record is valid if this equals sequence.
+  epicsUInt64 commit;
+};
+
+/**
+ * Appends frames to a spool file. Only one thread appends.
+ */
+class ADSBIGSpool {
+
+ public:
+  ADSBIGSpool();
+  ~ADSBIGSpool();
+
+  bool open(const std::string &fileName, size_t ringSize, std::string &message);
+  void close(void);
+  bool isOpen(void) const;
+  bool append(NDArray *pArray, const ADSBIGSpoolFrameInfo &info);
+
+  void status(double &fillPercent, int &numFrames, int &overwrites, double &rate);
+
+ private:
+  void evictOldest(void);
+
+  std::string m_fileName;
+  int m_fd;
+  unsigned char *m_pMap;
+  size_t m_mapSize;
+  ADSBIGSpoolFileHeader *m_pHeader;
+  unsigned char *m_pRing;
+  epicsMutexId m_mutex;
+  double m_rate;
+
+};
+
+/**
+ * Reads the committed frames from a spool file, oldest first.
+ * This does not need the driver, so it can be used after a crash.
+ */
+class ADSBIGSpoolReader {
+
+ public:
+  ADSBIGSpoolReader();
+  ~ADSBIGSpoolReader();
+
+  bool open(const std::string &fileName, std::string &message);
+  void close(void);
+  bool next(const ADSBIGSpoolRecordHeader **ppRecord, const void **ppData);
+  const ADSBIGSpoolFileHeader *header(void) const;
+  epicsUInt64 numSkipped(void) const;
+
+ private:
+  int m_fd;
+  unsigned char *m_pMap;
+  size_t m_mapSize;
+  const ADSBIGSpoolFileHeader *m_pHeader;
+  const unsigned char *m_pRing;
+  epicsUInt64 m_offset;
+  epicsUInt64 m_expected;
+  epicsUInt64 m_numRead;
+  epicsUInt64 m_numSkipped;
+
+};
+
+#endif //ADSBIG_SPOOL_H
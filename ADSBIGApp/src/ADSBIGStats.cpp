@@ -0,0 +1,148 @@
+/**
+ * Frame statistics for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <math.h>
+
+#include "csbigimg.h"
+
+#include "ADSBIGStats.h"
+
+ADSBIGStats::ADSBIGStats()
+{
+  m_hist.resize(HISTOGRAM_BINS);
+  reset(65535);
+  finish();
+}
+
+/**
+ * Clear the statistics, ready for a new frame.
+ * @param saturationLevel Pixels at or above this level are counted as saturated
+ */
+void ADSBIGStats::reset(epicsUInt16 saturationLevel)
+{
+  m_saturationLevel = saturationLevel;
+  m_numPixels = 0;
+  m_min = 65535;
+  m_max = 0;
+  m_sum = 0.0;
+  m_sumSq = 0.0;
+  m_numSaturated = 0;
+  m_hist.assign(HISTOGRAM_BINS, 0);
+}
+
+/**
+ * Add a band of pixels to the statistics for the frame.
+ * @param pData The pixels
+ * @param nPixels The number of pixels
+ */
+void ADSBIGStats::accumulate(const epicsUInt16 *pData, size_t nPixels)
+{
+  epicsUInt16 minValue = m_min;
+  epicsUInt16 maxValue = m_max;
+  double sum = 0.0;
+  double sumSq = 0.0;
+  size_t numSaturated = 0;
+  const epicsUInt16 saturationLevel = m_saturationLevel;
+  unsigned long *pHist = &m_hist[0];
+
+  for (size_t i=0; i<nPixels; ++i) {
+    epicsUInt16 value = pData[i];
+    double dValue = value;
+    minValue = (value < minValue) ? value : minValue;
+    maxValue = (value > maxValue) ? value : maxValue;
+    sum += dValue;
+    sumSq += dValue * dValue;
+    numSaturated += (value >= saturationLevel) ? 1 : 0;
+    pHist[value >> HISTOGRAM_SHIFT]++;
+  }
+
+  m_min = minValue;
+  m_max = maxValue;
+  m_sum += sum;
+  m_sumSq += sumSq;
+  m_numSaturated += numSaturated;
+  m_numPixels += nPixels;
+}
+
+/**
+ * Work out the mean, sigma and the auto contrast background and range
+ * once all the pixels in the frame have been accumulated.
+ */
+void ADSBIGStats::finish(void)
+{
+  double variance = 0.0;
+
+  m_mean = 0.0;
+  m_sigma = 0.0;
+  if (m_numPixels > 0) {
+    m_mean = m_sum / m_numPixels;
+    variance = (m_sumSq / m_numPixels) - (m_mean * m_mean);
+    m_sigma = (variance > 0.0) ? sqrt(variance) : 0.0;
+  }
+  CSBIGImg::HistogramBackgroundAndRange(&m_hist[0], static_cast<unsigned long>(m_numPixels),
+                                        m_background, m_range);
+}
+
+size_t ADSBIGStats::numPixels(void) const
+{
+  return m_numPixels;
+}
+
+epicsUInt16 ADSBIGStats::minValue(void) const
+{
+  return (m_numPixels > 0) ? m_min : 0;
+}
+
+epicsUInt16 ADSBIGStats::maxValue(void) const
+{
+  return m_max;
+}
+
+/**
+ * The sum of all the pixels.
+ */
+double ADSBIGStats::total(void) const
+{
+  return m_sum;
+}
+
+double ADSBIGStats::mean(void) const
+{
+  return m_mean;
+}
+
+double ADSBIGStats::sigma(void) const
+{
+  return m_sigma;
+}
+
+size_t ADSBIGStats::numSaturated(void) const
+{
+  return m_numSaturated;
+}
+
+/**
+ * The auto contrast background, as set by CSBIGImg::AutoBackgroundAndRange.
+ */
+long ADSBIGStats::background(void) const
+{
+  return m_background;
+}
+
+/**
+ * The auto contrast range, as set by CSBIGImg::AutoBackgroundAndRange.
+ */
+long ADSBIGStats::range(void) const
+{
+  return m_range;
+}
+
+/**
+ * The histogram (HISTOGRAM_BINS bins of pixel >> HISTOGRAM_SHIFT).
+ */
+const std::vector<unsigned long> &ADSBIGStats::histogram(void) const
+{
+  return m_hist;
+}
@@ -0,0 +1,55 @@
+/**
+ * Frame statistics for the ADSBIG areaDetector driver.
+ *
+ * The statistics are accumulated a band of lines at a time while
+ * the frame is read out, so they are ready as soon as the last line
+ * arrives, without another pass over the frame. The histogram uses
+ * the same bins as CSBIGImg::AutoBackgroundAndRange, so the auto
+ * contrast background and range come from it directly.
+ *
+ */
+
+#ifndef ADSBIG_STATS_H
+#define ADSBIG_STATS_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+
+class ADSBIGStats {
+
+ public:
+  ADSBIGStats();
+
+  void reset(epicsUInt16 saturationLevel);
+  void accumulate(const epicsUInt16 *pData, size_t nPixels);
+  void finish(void);
+
+  size_t numPixels(void) const;
+  epicsUInt16 minValue(void) const;
+  epicsUInt16 maxValue(void) const;
+  double total(void) const;
+  double mean(void) const;
+  double sigma(void) const;
+  size_t numSaturated(void) const;
+  long background(void) const;
+  long range(void) const;
+  const std::vector<unsigned long> &histogram(void) const;
+
+ private:
+  epicsUInt16 m_saturationLevel;
+  size_t m_numPixels;
+  epicsUInt16 m_min;
+  epicsUInt16 m_max;
+  double m_sum;
+  double m_sumSq;
+  size_t m_numSaturated;
+  double m_mean;
+  double m_sigma;
+  long m_background;
+  long m_range;
+  std::vector<unsigned long> m_hist;
+
+};
+
+#endif //ADSBIG_STATS_H
@@ -0,0 +1,132 @@
+/**
+ * Camera telemetry for the ADSBIG areaDetector driver.
+ *
+ */
+
+#include <epicsAtomic.h>
+
+#include "ADSBIGTelemetry.h"
+
+ADSBIGTelemetryValues::ADSBIGTelemetryValues() :
+  tempValid(false), ccdTemp(0.0), ccdTempSetpoint(0.0),
+  teValid(false), teEnabled(0), tePower(0.0),
+  linkValid(false), linkEstablished(0), comFailed(0), deferred(0)
+{
+}
+
+ADSBIGTelemetrySnapshot::ADSBIGTelemetrySnapshot() :
+  m_sequence(0)
+{
+}
+
+/**
+ * Publish a new set of values. Only the telemetry thread calls this.
+ * The sequence number is odd while the values are being written.
+ * @param values The values to publish
+ */
+void ADSBIGTelemetrySnapshot::write(const ADSBIGTelemetryValues &values)
+{
+  epicsAtomicIncrIntT(&m_sequence);
+  m_values = values;
+  epicsAtomicIncrIntT(&m_sequence);
+}
+
+/**
+ * Copy the most recently published values. This never blocks the writer.
+ * @return The values
+ */
+ADSBIGTelemetryValues ADSBIGTelemetrySnapshot::read(void) const
+{
+  ADSBIGTelemetryValues values;
+  int before = 0;
+  int after = 0;
+
+  do {
+    before = epicsAtomicGetIntT(&m_sequence);
+    epicsAtomicReadMemoryBarrier();
+    values = m_values;
+    epicsAtomicReadMemoryBarrier();
+    after = epicsAtomicGetIntT(&m_sequence);
+  } while ((before & 1) || (before != after));
+
+  return values;
+}
+
+ADSBIGTelemetrySchedule::ADSBIGTelemetrySchedule()
+{
+  for (int item=0; item<ADSBIG_TELEM_NUM_ITEMS; ++item) {
+    m_period[item] = 0.0;
+    m_next[item].secPastEpoch = 0;
+    m_next[item].nsec = 0;
+  }
+}
+
+/**
+ * Set how often an item is read. A new or shorter period takes effect
+ * straight away.
+ * @param item The telemetry item (ADSBIG_TELEM_*)
+ * @param seconds The period. Zero disables the item.
+ */
+void ADSBIGTelemetrySchedule::setPeriod(int item, double seconds)
+{
+  if (seconds < m_period[item] || m_period[item] <= 0.0) {
+    m_next[item].secPastEpoch = 0;
+    m_next[item].nsec = 0;
+  }
+  m_period[item] = (seconds > 0.0) ? seconds : 0.0;
+}
+
+double ADSBIGTelemetrySchedule::period(int item) const
+{
+  return m_period[item];
+}
+
+/**
+ * @param item The telemetry item (ADSBIG_TELEM_*)
+ * @param now The current time
+ * @return true if the item is enabled and should be read now
+ */
+bool ADSBIGTelemetrySchedule::due(int item, const epicsTimeStamp &now) const
+{
+  return (m_period[item] > 0.0) &&
+    (epicsTimeDiffInSeconds(&now, &m_next[item]) >= 0.0);
+}
+
+/**
+ * The item has been read. It is next due one period from now.
+ */
+void ADSBIGTelemetrySchedule::done(int item, const epicsTimeStamp &now)
+{
+  m_next[item] = now;
+  epicsTimeAddSeconds(&m_next[item], m_period[item]);
+}
+
+/**
+ * The item could not be read yet. Try again after a shorter time.
+ */
+void ADSBIGTelemetrySchedule::defer(int item, const epicsTimeStamp &now, double seconds)
+{
+  m_next[item] = now;
+  epicsTimeAddSeconds(&m_next[item], seconds);
+}
+
+/**
+ * @param now The current time
+ * @param maxWait The longest time to return
+ * @return The time in seconds until the next enabled item is due (0 if one is due now)
+ */
+double ADSBIGTelemetrySchedule::timeToNext(const epicsTimeStamp &now, double maxWait) const
+{
+  double wait = maxWait;
+
+  for (int item=0; item<ADSBIG_TELEM_NUM_ITEMS; ++item) {
+    if (m_period[item] > 0.0) {
+      double remaining = epicsTimeDiffInSeconds(&m_next[item], &now);
+      if (remaining < wait) {
+        wait = remaining;
+      }
+    }
+  }
+
+  return (wait > 0.0) ? wait : 0.0;
+}
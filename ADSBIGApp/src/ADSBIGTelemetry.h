@@ -0,0 +1,71 @@
+/**
+ * Camera telemetry for the ADSBIG areaDetector driver.
+ *
+ * The telemetry thread reads each item at its own rate, without the
+ * asyn port lock, and writes what it read into a snapshot. The snapshot
+ * is a sequence lock with a single writer (the telemetry thread). Readers
+ * never block the writer; they copy the values and try again if the
+ * sequence number changed while they were copying.
+ *
+ */
+
+#ifndef ADSBIG_TELEMETRY_H
+#define ADSBIG_TELEMETRY_H
+
+#include <epicsTime.h>
+
+//Telemetry items read from the camera, each at its own rate. The readout
+//progress is pushed by the readout thread instead (see ADSBIG::lineReady).
+#define ADSBIG_TELEM_TEMPERATURE 0
+#define ADSBIG_TELEM_TE_POWER    1
+#define ADSBIG_TELEM_LINK        2
+#define ADSBIG_TELEM_NUM_ITEMS   3
+
+struct ADSBIGTelemetryValues {
+  ADSBIGTelemetryValues();
+
+  bool tempValid;
+  double ccdTemp;
+  double ccdTempSetpoint;
+  bool teValid;
+  int teEnabled;
+  double tePower;
+  bool linkValid;
+  int linkEstablished;
+  unsigned long comFailed;
+  int deferred;
+};
+
+class ADSBIGTelemetrySnapshot {
+
+ public:
+  ADSBIGTelemetrySnapshot();
+
+  void write(const ADSBIGTelemetryValues &values);
+  ADSBIGTelemetryValues read(void) const;
+
+ private:
+  int m_sequence;
+  ADSBIGTelemetryValues m_values;
+
+};
+
+class ADSBIGTelemetrySchedule {
+
+ public:
+  ADSBIGTelemetrySchedule();
+
+  void setPeriod(int item, double seconds);
+  double period(int item) const;
+  bool due(int item, const epicsTimeStamp &now) const;
+  void done(int item, const epicsTimeStamp &now);
+  void defer(int item, const epicsTimeStamp &now, double seconds);
+  double timeToNext(const epicsTimeStamp &now, double maxWait) const;
+
+ private:
+  double m_period[ADSBIG_TELEM_NUM_ITEMS];
+  epicsTimeStamp m_next[ADSBIG_TELEM_NUM_ITEMS];
+
+};
+
+#endif //ADSBIG_TELEMETRY_H
@@ -18,17 +18,25 @@ example_registerRecordDeviceDriver pdbbase
 
 ADSBIGConfig("S1",-1,-1)
 
-#################################################
-# Set up the areaDetector plugins
+# To select the camera by USB slot (0-7) or by serial number
+#ADSBIGConfig("S1",-1,-1,0,1)
+#ADSBIGConfig("S1",-1,-1,0,0,"12345")
 
-NDROIConfigure("S1.ROI1", 10, 0, "S1", 0, -1, -1, 0, 0)
+# To run without a camera, use the simulated camera instead
+#ADSBIGSimConfig(3326,2504,1e6,1,1)
+#ADSBIGConfig("S1",-1,-1,1)
 
-NDStdArraysConfigure("S1.ARR1", 10, 0, "S1.ROI1", 0, -1, 0, 0)
+#################################################
+# Set up the areaDetector plugins
 
-NDStatsConfigure("S1.STATS1", 10, 0, "S1", 0, -1, -1, 0, 0)
+# Preview frames (asyn address 2 of the camera port)
+NDStdArraysConfigure("S1.ARR1", 10, 0, "S1", 2, -1, 0, 0)
 
 NDFileTIFFConfigure("S1.TIFF1", 10, 0, "S1", 0, 0, 0, 0)
 
+# Tracking CCD frames (asyn address 1 of the camera port)
+NDStdArraysConfigure("S1.TRK1", 10, 0, "S1", 1, -1, 0, 0)
+
 #################################################
 # autosave
 
@@ -63,19 +71,14 @@ create_monitor_set("$(IOCNAME).req", 10)
 # Enable plugins at startup (settings that are not autosaved)
 dbpf $(SBIG_PV):ArrayCallbacks 1
 dbpf $(SBIG_PV):TIFF1:EnableCallbacks 1
-dbpf $(SBIG_PV):Stats1:EnableCallbacks 1
-dbpf $(SBIG_PV):ROI1:EnableCallbacks 1
+dbpf $(SBIG_PV):Prv:ArrayCallbacks 1
 dbpf $(SBIG_PV):Array1:EnableCallbacks 1
+dbpf $(SBIG_PV):Trk:ArrayCallbacks 1
+dbpf $(SBIG_PV):Trk:Array1:EnableCallbacks 1
 
-# Set up ROI binning by default for the array plugin
-# We also enable scaling (divide by 4 because we are doing 2x2 binning).
-# We need to force the output data type to be UInt16, otherwise the plugin 
-# will convert to floating point.
-dbpf $(SBIG_PV):ROI1:BinX 2
-dbpf $(SBIG_PV):ROI1:BinY 2
-dbpf $(SBIG_PV):ROI1:DataTypeOut 3
-dbpf $(SBIG_PV):ROI1:EnableScale 1
-dbpf $(SBIG_PV):ROI1:Scale 4
+# Use a 2x2 preview by default for the array plugin. The driver averages
+# each 2x2 block during the readout, so the preview stays UInt16.
+dbpf $(SBIG_PV):Prv:PreviewFactor 2
 
 # Set up TIFF plugin auto increment
 dbpf $(SBIG_PV):TIFF1:AutoIncrement 1
@@ -38,17 +38,20 @@ def main():
             print "Done."
             caput(base_pv+"DarkField", 0, wait=True)
 
-            #Take light fields
+            #Take light fields, back to back in Multiple image mode
             print "Taking " + str(images) + " images..."
-            for image in range(images):
-                print "Acquire: " + str(image)
-                caput(base_pv+"Acquire", 1, wait=True, timeout=30)
-                status = caget(base_pv+"DetectorState_RBV")
-                if (status != 0):
-                    print "ERROR!"
-                    print base_pv+"DetectorState_RBV="+str(status)
-                    print str(caget(base_pv+"StatusMessage_RBV", as_string=True))
-                    sys.exit(1)
+            caput(base_pv+"ImageMode", 1, wait=True)
+            caput(base_pv+"NumImages", images, wait=True)
+            caput(base_pv+"Acquire", 1, wait=True, timeout=30*images)
+            status = caget(base_pv+"DetectorState_RBV")
+            if (status != 0):
+                print "ERROR!"
+                print base_pv+"DetectorState_RBV="+str(status)
+                print str(caget(base_pv+"StatusMessage_RBV", as_string=True))
+                sys.exit(1)
+            print "Frame rate: " + str(caget(base_pv+"FrameRate_RBV"))
+            print "Dead time: " + str(caget(base_pv+"DeadTime_RBV"))
+            caput(base_pv+"ImageMode", 0, wait=True)
 
     print "Complete."
     sys.exit(0)